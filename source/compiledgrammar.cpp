@@ -0,0 +1,78 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#include "compiledgrammar.h"
+
+namespace LSystem {
+
+//------------------------------------------------------------------------------
+CompiledGrammar::CompiledGrammar( ProductionSet productions,
+	const SymbolFrame &globals, const SlotTable &globalSlots,
+	const ModelMap &models, const ModuleString &start, int iterations )
+	:
+	myProductions( std::move( productions ) ),
+	myGlobals( globals ),
+	myGlobalSlots( globalSlots ),
+	myModels( models ),
+	myStart( start ),
+	myIterations( iterations )
+{
+}
+
+
+//------------------------------------------------------------------------------
+int CompiledGrammar::getModel( char c ) const {
+	ModelMap::const_iterator model = myModels.find( c );
+	return model == myModels.end() ? 0 : model->second;
+}
+
+
+//------------------------------------------------------------------------------
+void CompiledGrammar::derive( unsigned long long seed, ModuleString &result,
+	ModuleString &scratch, const std::bitset<256> *kept ) const
+{
+	result = myStart;
+	std::vector<double> parameters;
+	for( int j = 0; j < myIterations; ++j ) {
+		bool prune = kept && j + 1 == myIterations;
+		scratch.clear();
+		for( ModuleString::size_type i = 0; i < result.size(); ++i ) {
+			ModuleString::size_type end = myProductions.passThrough( result, i );
+			if( end > i ) {
+				if( prune ) {
+					scratch.append( result, i, end, *kept );
+				} else {
+					scratch.append( result, i, end );
+				}
+				i = end - 1;
+				continue;
+			}
+			Production *prod = myProductions.match( result.name( i ),
+				result.parameterCount( i ), seed, j, i );
+			if( prune ) {
+				ProductionSet::apply( result, i, prod, myGlobals, scratch,
+					*kept, parameters );
+			} else {
+				ProductionSet::apply( result, i, prod, myGlobals, scratch );
+			}
+		}
+		result.swap( scratch );
+	}
+}
+
+} // End of LSystem namespace
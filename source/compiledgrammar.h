@@ -0,0 +1,212 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#ifndef COMPILEDGRAMMAR_H
+#define COMPILEDGRAMMAR_H
+
+#include "productionset.h"
+#include "growthmatrix.h"
+#include "expressioncode.h"
+#include "modulestring.h"
+
+#include <bitset>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace LSystem {
+
+typedef std::map<char, int> ModelMap;
+
+class CompiledGrammar;
+
+///-----------------------------------------------------------------------------
+/// How a CompiledGrammar is shared.  The last holder to let go deletes it.
+///-----------------------------------------------------------------------------
+typedef std::shared_ptr<const CompiledGrammar> CompiledGrammarPtr;
+
+///-----------------------------------------------------------------------------
+/// A parsed LSystem, frozen.
+///
+/// Holds everything deriving needs: the productions with their compiled
+/// expressions and dispatch table, the values of the globals, the model
+/// ids, the start modules and the number of iterations.  Nothing about it
+/// changes once it is made, and deriving only reads it, so any number of
+/// threads may derive from one grammar at once without locking or copying
+/// it.  Each derivation passes its own seed and buffers.
+///
+/// Parser::parseLSystem() makes one, handed out by Parser::getGrammar(),
+/// which stays valid after the Parser is gone.
+///
+/// LSystem::CompiledGrammarPtr grammar = parser.getGrammar();
+/// ModuleString result, scratch;
+/// grammar->derive( seed, result, scratch );
+///
+/// @author Lakin Wecker aka nikal@nucleus.com
+///
+/// @see LSystem::Parser
+/// @see LSystem::ForestBatch
+///-----------------------------------------------------------------------------
+class CompiledGrammar {
+
+//==============================================================================
+// Private Variables
+//==============================================================================
+private:
+
+	const ProductionSet myProductions;
+	// The value of each global, in the slot myGlobalSlots gives it.
+	const SymbolFrame myGlobals;
+	const SlotTable myGlobalSlots;
+	const ModelMap myModels;
+	const ModuleString myStart;
+	const int myIterations;
+
+//==============================================================================
+// Public Methods
+//==============================================================================
+public:
+
+	//----------------------------------------------------------------------
+	// Constructors
+
+	///---------------------------------------------------------------------
+	/// Freezes a parsed LSystem.  productions must already be normalized,
+	/// optimized and compiled.  They are copied, unless moved in.
+	///---------------------------------------------------------------------
+	CompiledGrammar( ProductionSet productions,
+		const SymbolFrame &globals, const SlotTable &globalSlots,
+		const ModelMap &models, const ModuleString &start, int iterations );
+
+
+	//----------------------------------------------------------------------
+	// Destructor
+
+	///---------------------------------------------------------------------
+	/// Deletes a CompiledGrammar instance.
+	///---------------------------------------------------------------------
+	virtual ~CompiledGrammar()
+	{
+	}
+
+
+	//----------------------------------------------------------------------
+	// Getters
+
+	///---------------------------------------------------------------------
+	/// The productions, compiled.
+	///---------------------------------------------------------------------
+	const ProductionSet &getProductions() const {
+		return myProductions;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The values of the globals, indexed by getGlobalSlots().
+	///---------------------------------------------------------------------
+	const SymbolFrame &getGlobals() const {
+		return myGlobals;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The slot of each global in getGlobals(), by name.
+	///---------------------------------------------------------------------
+	const SlotTable &getGlobalSlots() const {
+		return myGlobalSlots;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The modules derivation starts from.
+	///---------------------------------------------------------------------
+	const ModuleString &getStart() const {
+		return myStart;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The number of iterations the LSystem asks for.
+	///---------------------------------------------------------------------
+	int getIterations() const {
+		return myIterations;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The model id set for module c, 0 if there is none.
+	///---------------------------------------------------------------------
+	int getModel( char c ) const;
+
+
+	///---------------------------------------------------------------------
+	/// The model ids set, by module.
+	///---------------------------------------------------------------------
+	const ModelMap &getModels() const {
+		return myModels;
+	}
+
+
+	//----------------------------------------------------------------------
+	// Public API
+
+	///---------------------------------------------------------------------
+	/// Derives the system with seed into result, using scratch for the
+	/// other generation.  Serial, with no budget.  Safe to call from many
+	/// threads at once as long as each has its own buffers.
+	///
+	/// If kept is given only the modules named in it are kept in the
+	/// last generation, the others are dropped as it is written.
+	///---------------------------------------------------------------------
+	void derive( unsigned long long seed, ModuleString &result,
+		ModuleString &scratch, const std::bitset<256> *kept = NULL ) const;
+
+
+	///---------------------------------------------------------------------
+	/// Predicts the size of every generation derive() would make, from
+	/// the start modules up to the last, without deriving any.
+	///
+	/// @see LSystem::GrowthMatrix
+	///---------------------------------------------------------------------
+	std::vector<GenerationSize> predict() const {
+		return GrowthMatrix( myProductions, myStart ).predict( myIterations );
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Like predict() above, for derive() keeping only the modules named
+	/// in kept in the last generation.
+	///---------------------------------------------------------------------
+	std::vector<GenerationSize> predict( const std::bitset<256> &kept ) const {
+		return GrowthMatrix( myProductions, myStart ).predict( myIterations, kept );
+	}
+
+//==============================================================================
+// Private Methods
+//==============================================================================
+private:
+
+	// Not copyable, share a CompiledGrammarPtr instead.
+	CompiledGrammar( const CompiledGrammar & );
+	CompiledGrammar &operator=( const CompiledGrammar & );
+
+}; // End of CompiledGrammar
+
+} // End of LSystem namespace
+
+#endif
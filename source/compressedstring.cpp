@@ -0,0 +1,382 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#include "compressedstring.h"
+#include "error.h"
+
+#include <cstring>
+#include <utility>
+
+#define COMPRESSED_ERROR(x) throw new Error( x, -1, -1, __FILE__, __LINE__ )
+
+namespace LSystem {
+
+//------------------------------------------------------------------------------
+// The symbol code that spells a symbol out, and the parameter code that
+// spells a value out, instead of referring to one already seen.
+static const unsigned char ESCAPE = 255;
+
+// The symbol of a name and count not in the table.
+static const unsigned char NONE = 255;
+
+// The longest record, an escaped symbol with 255 escaped parameters.
+static const CompressedString::Block::size_type MAX_RECORD = 3 + 255 * 10;
+
+
+//------------------------------------------------------------------------------
+// The raw bits of value, and back.
+static unsigned long long toBits( double value ) {
+	unsigned long long bits;
+	std::memcpy( &bits, &value, sizeof( bits ) );
+	return bits;
+}
+
+static double fromBits( unsigned long long bits ) {
+	double value;
+	std::memcpy( &value, &bits, sizeof( value ) );
+	return value;
+}
+
+
+//------------------------------------------------------------------------------
+// The dictionary slot bits goes in.
+static unsigned char slot( unsigned long long bits ) {
+	return ( ( bits * 0x9E3779B97F4A7C15ULL ) >> 56 ) % 255;
+}
+
+
+//------------------------------------------------------------------------------
+// Codes the value with bits against a column at out, returning the end of the code.
+static unsigned char *encode( unsigned char *out,
+	unsigned long long bits, unsigned long long &last,
+	unsigned long long *dictionary )
+{
+	unsigned char s = slot( bits );
+	if( dictionary[s] == bits ) {
+		*out++ = s;
+	} else {
+		unsigned long long x = bits ^ last;
+		int leading = x ? __builtin_clzll( x ) / 8 : 8;
+		int trailing = x ? __builtin_ctzll( x ) / 8 : 0;
+		*out++ = ESCAPE;
+		*out++ = ( leading << 4 ) | trailing;
+		x >>= trailing * 8;
+		for( int b = leading + trailing; b < 8; ++b, x >>= 8 ) {
+			*out++ = (unsigned char)x;
+		}
+		dictionary[s] = bits;
+	}
+	last = bits;
+	return out;
+}
+
+
+//------------------------------------------------------------------------------
+// Decodes a value coded by encode() at in, returning the end of the code.
+static const unsigned char *decode( const unsigned char *in,
+	unsigned long long &bits, unsigned long long &last,
+	unsigned long long *dictionary )
+{
+	unsigned char code = *in++;
+	if( code != ESCAPE ) {
+		bits = dictionary[code];
+	} else {
+		int leading = *in >> 4;
+		int trailing = *in++ & 15;
+		unsigned long long x = 0;
+		for( int b = 0; b < 8 - leading - trailing; ++b ) {
+			x |= (unsigned long long)*in++ << ( b * 8 );
+		}
+		bits = ( x << ( trailing * 8 ) ) ^ last;
+		dictionary[ slot( bits ) ] = bits;
+	}
+	last = bits;
+	return in;
+}
+
+
+//------------------------------------------------------------------------------
+CompressedString::Codec::Codec() {
+	std::memset( ids, NONE, sizeof( ids ) );
+}
+
+
+//------------------------------------------------------------------------------
+unsigned char CompressedString::Codec::add( char name, unsigned char count ) {
+	if( symbols.size() == NONE ) {
+		return NONE;
+	}
+	Symbol symbol = { name, count, columns.size() };
+	Column column;
+	std::memset( &column, 0, sizeof( column ) );
+	columns.insert( columns.end(), count, column );
+	symbols.push_back( symbol );
+	return ids[ (unsigned char)name ][ count ] = symbols.size() - 1;
+}
+
+
+//------------------------------------------------------------------------------
+unsigned long long CompressedString::Codec::memoryUsed() const {
+	return sizeof( Codec ) + symbols.capacity() * sizeof( Symbol )
+		+ columns.capacity() * sizeof( Column );
+}
+
+
+//------------------------------------------------------------------------------
+CompressedString::CompressedString()
+	:
+	myCount( 0 ),
+	myBytes( 0 ),
+	myCodec( new Codec() )
+{
+}
+
+
+//------------------------------------------------------------------------------
+CompressedString::CompressedString( const CompressedString &other )
+	:
+	myBlocks( other.myBlocks ),
+	myCount( other.myCount ),
+	myBytes( other.myBytes ),
+	myCodec( NULL )
+{
+}
+
+
+//------------------------------------------------------------------------------
+CompressedString::~CompressedString() {
+	delete myCodec;
+}
+
+
+//------------------------------------------------------------------------------
+unsigned long long CompressedString::memoryUsed() const {
+	unsigned long long used = myBlocks.capacity() * sizeof( Block );
+	for( std::vector<Block>::size_type b = 0; b < myBlocks.size(); ++b ) {
+		used += myBlocks[b].capacity();
+	}
+	if( myCodec ) {
+		used += myCodec->memoryUsed();
+	}
+	return used;
+}
+
+
+//------------------------------------------------------------------------------
+void CompressedString::push_back( char name, const double *params,
+	ModuleString::size_type count )
+{
+	if( !myCodec ) {
+		COMPRESSED_ERROR( "Error: Can't append to a closed compressed string." );
+	}
+	if( count > 255 ) {
+		COMPRESSED_ERROR( "Error: Can't compress a module with more than 255 parameters." );
+	}
+
+	unsigned char record[MAX_RECORD];
+	unsigned char *out = record;
+	unsigned char id = myCodec->ids[ (unsigned char)name ][ count ];
+	if( id == NONE ) {
+		*out++ = ESCAPE;
+		*out++ = name;
+		*out++ = count;
+		id = myCodec->add( name, count );
+	} else {
+		*out++ = id;
+	}
+
+	if( id == NONE ) {
+		// The table is full, so the parameters are spelt out.
+		if( count ) {
+			std::memcpy( out, params, count * sizeof( double ) );
+			out += count * sizeof( double );
+		}
+	} else {
+		// A symbol without parameters may have its columns at the end.
+		Codec::Column *column = myCodec->columns.data() + myCodec->symbols[id].column;
+		for( ModuleString::size_type p = 0; p < count; ++p, ++column ) {
+			out = encode( out, toBits( params[p] ), column->last, column->dictionary );
+		}
+	}
+
+	Block::size_type length = out - record;
+	Block &block = room( length );
+	block.insert( block.end(), record, out );
+	myBytes += length;
+	++myCount;
+}
+
+
+//------------------------------------------------------------------------------
+void CompressedString::append( const ModuleString &s ) {
+	for( ModuleString::size_type i = 0; i < s.size(); ++i ) {
+		push_back( s.name( i ), s.parameters( i ), s.parameterCount( i ) );
+	}
+}
+
+
+//------------------------------------------------------------------------------
+void CompressedString::close() {
+	if( !myBlocks.empty() ) {
+		myBlocks.back().shrink_to_fit();
+	}
+	myBlocks.shrink_to_fit();
+	delete myCodec;
+	myCodec = NULL;
+}
+
+
+//------------------------------------------------------------------------------
+void CompressedString::clear() {
+	std::vector<Block>().swap( myBlocks );
+	myCount = 0;
+	myBytes = 0;
+	delete myCodec;
+	myCodec = new Codec();
+}
+
+
+//------------------------------------------------------------------------------
+void CompressedString::swap( CompressedString &other ) {
+	myBlocks.swap( other.myBlocks );
+	std::swap( myCount, other.myCount );
+	std::swap( myBytes, other.myBytes );
+	std::swap( myCodec, other.myCodec );
+}
+
+
+//------------------------------------------------------------------------------
+CompressedString::Block &CompressedString::room( Block::size_type length ) {
+	if( myBlocks.empty() || myBlocks.back().size() + length > BLOCK_SIZE ) {
+		myBlocks.push_back( Block() );
+		myBlocks.back().reserve( BLOCK_SIZE );
+	}
+	return myBlocks.back();
+}
+
+
+//------------------------------------------------------------------------------
+CompressedReader::CompressedReader( const CompressedString &string )
+	:
+	myString( string ),
+	myBlock( 0 ),
+	myPosition( 0 )
+{
+}
+
+
+//------------------------------------------------------------------------------
+CompressedReader::~CompressedReader() {
+}
+
+
+//------------------------------------------------------------------------------
+bool CompressedReader::next( Module &mod ) {
+	char name;
+	unsigned char count;
+	std::vector<double>::size_type column;
+	bool coded;
+	if( !symbol( name, count, column, coded ) ) {
+		return false;
+	}
+	mod.name = name;
+	mod.parameters.resize( count );
+	parameters( mod.parameters.data(), count, column, coded );
+	return true;
+}
+
+
+//------------------------------------------------------------------------------
+ModuleString::size_type CompressedReader::next( ModuleString &block,
+	ModuleString::size_type max )
+{
+	block.clear();
+	char name;
+	unsigned char count;
+	std::vector<double>::size_type column;
+	bool coded;
+	while( block.size() < max && symbol( name, count, column, coded ) ) {
+		parameters( block.push_back( name, count ), count, column, coded );
+	}
+	return block.size();
+}
+
+
+//------------------------------------------------------------------------------
+void CompressedReader::rewind() {
+	myCodec = CompressedString::Codec();
+	myBlock = 0;
+	myPosition = 0;
+}
+
+
+//------------------------------------------------------------------------------
+bool CompressedReader::symbol( char &name, unsigned char &count,
+	std::vector<double>::size_type &column, bool &coded )
+{
+	const std::vector<CompressedString::Block> &blocks = myString.myBlocks;
+	while( myBlock < blocks.size() && myPosition == blocks[myBlock].size() ) {
+		++myBlock;
+		myPosition = 0;
+	}
+	if( myBlock == blocks.size() ) {
+		return false;
+	}
+
+	const unsigned char *in = blocks[myBlock].data() + myPosition;
+	unsigned char id = *in++;
+	if( id == ESCAPE ) {
+		name = *in++;
+		count = *in++;
+		id = myCodec.add( name, count );
+	} else {
+		name = myCodec.symbols[id].name;
+		count = myCodec.symbols[id].count;
+	}
+	coded = id != NONE;
+	if( coded ) {
+		column = myCodec.symbols[id].column;
+	}
+	myPosition = in - blocks[myBlock].data();
+	return true;
+}
+
+
+//------------------------------------------------------------------------------
+void CompressedReader::parameters( double *params, unsigned char count,
+	std::vector<double>::size_type column, bool coded )
+{
+	const unsigned char *start = myString.myBlocks[myBlock].data();
+	const unsigned char *in = start + myPosition;
+	if( !coded ) {
+		if( count ) {
+			std::memcpy( params, in, count * sizeof( double ) );
+			in += count * sizeof( double );
+		}
+	} else {
+		CompressedString::Codec::Column *c = myCodec.columns.data() + column;
+		for( unsigned char p = 0; p < count; ++p, ++c ) {
+			unsigned long long bits;
+			in = decode( in, bits, c->last, c->dictionary );
+			params[p] = fromBits( bits );
+		}
+	}
+	myPosition = in - start;
+}
+
+} // End of LSystem namespace
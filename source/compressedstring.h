@@ -0,0 +1,325 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#ifndef COMPRESSEDSTRING_H
+#define COMPRESSEDSTRING_H
+
+#include "modulesource.h"
+#include "modulestring.h"
+
+#include <vector>
+
+namespace LSystem {
+
+///-----------------------------------------------------------------------------
+/// A generation of modules held compressed in memory, for derivations
+/// too large to keep as a ModuleString but not worth a spill file.
+/// Modules are appended in order and read back in order with a
+/// CompressedReader, which decodes a block of them at a time.
+///
+/// Each module is coded as a one byte symbol, standing for its name and
+/// its number of parameters together, so neither the name nor the
+/// parameter offset is stored.  A symbol is spelt out, name and count,
+/// the first time it is seen.  Each parameter is coded against the
+/// others in the same column, the same parameter of the same symbol:
+/// a value recently seen in the column is one byte, its slot in a small
+/// dictionary of the column, any other is XOR'd with the column's last
+/// value and only the bytes between the leading and trailing zero bytes
+/// of the result are kept.  The codes are written into blocks of
+/// BLOCK_SIZE bytes, so the string grows a block at a time and never
+/// holds more than one block of slack.
+///
+/// The parameters come back bit for bit.  Derived systems repeat
+/// themselves enough that a generation takes from a half to an eighth of
+/// its ModuleString, under 2 bytes a module for the larger example
+/// systems against 14, the more parameters a module has and the more
+/// they vary the less it saves.  The cost is coding and decoding every
+/// module as it's written and read, some tens of millions of modules a
+/// second each way.
+///
+/// @author Lakin Wecker aka nikal@nucleus.com
+///
+/// @see LSystem::CompressedReader
+/// @see LSystem::Parser::compressSystem
+///-----------------------------------------------------------------------------
+class CompressedString {
+
+	friend class CompressedReader;
+
+//==============================================================================
+// Public Types
+//==============================================================================
+public:
+
+	typedef std::vector<unsigned char> Block;
+
+//==============================================================================
+// Private Types
+//==============================================================================
+private:
+
+	///---------------------------------------------------------------------
+	/// The symbols and columns seen so far, which the codes refer to.
+	/// Writer and reader each build their own as the modules go by.
+	///---------------------------------------------------------------------
+	class Codec {
+	public:
+		struct Symbol {
+			char name;
+			unsigned char count;
+			std::vector<double>::size_type column;
+		};
+		struct Column {
+			unsigned long long last;
+			unsigned long long dictionary[255];
+		};
+
+		std::vector<Symbol> symbols;
+		std::vector<Column> columns;
+		// The symbol for each name and count, or NONE.
+		unsigned char ids[256][256];
+
+		Codec();
+		unsigned char add( char name, unsigned char count );
+		unsigned long long memoryUsed() const;
+	};
+
+//==============================================================================
+// Private Variables
+//==============================================================================
+private:
+
+	std::vector<Block> myBlocks;
+	unsigned long long myCount;
+	unsigned long long myBytes;
+	Codec *myCodec;
+
+//==============================================================================
+// Public Methods
+//==============================================================================
+public:
+
+	///---------------------------------------------------------------------
+	/// The size of the blocks the codes are written into.
+	///---------------------------------------------------------------------
+	static const Block::size_type BLOCK_SIZE = 64 << 10;
+
+
+	//----------------------------------------------------------------------
+	// Constructors
+
+	///---------------------------------------------------------------------
+	/// Creates an empty string.
+	///---------------------------------------------------------------------
+	CompressedString();
+
+
+	///---------------------------------------------------------------------
+	/// Copies the codes of other.  A copy can be read but not appended to.
+	///---------------------------------------------------------------------
+	CompressedString( const CompressedString &other );
+
+
+	//----------------------------------------------------------------------
+	// Destructor
+
+	///---------------------------------------------------------------------
+	/// Deletes a CompressedString instance.
+	///---------------------------------------------------------------------
+	virtual ~CompressedString();
+
+
+	//----------------------------------------------------------------------
+	// Getters
+
+	///---------------------------------------------------------------------
+	/// The number of modules in the string.
+	///---------------------------------------------------------------------
+	unsigned long long size() const {
+		return myCount;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The number of bytes the modules are coded in.
+	///---------------------------------------------------------------------
+	unsigned long long bytes() const {
+		return myBytes;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The bytes of memory the string holds, its blocks and, until
+	/// close(), the symbols and columns the writer codes against.
+	///---------------------------------------------------------------------
+	unsigned long long memoryUsed() const;
+
+
+	//----------------------------------------------------------------------
+	// Public API
+
+	///---------------------------------------------------------------------
+	/// Appends a module named name with count parameters.  At most 255
+	/// parameters can be compressed.
+	///---------------------------------------------------------------------
+	void push_back( char name, const double *params, ModuleString::size_type count );
+
+
+	///---------------------------------------------------------------------
+	/// Appends all the modules of s.
+	///---------------------------------------------------------------------
+	void append( const ModuleString &s );
+
+
+	///---------------------------------------------------------------------
+	/// Finishes the string, trimming the last block and freeing what the
+	/// writer codes against.  Nothing more can be appended.
+	///---------------------------------------------------------------------
+	void close();
+
+
+	///---------------------------------------------------------------------
+	/// Removes all the modules, so the string can be written afresh.
+	///---------------------------------------------------------------------
+	void clear();
+
+
+	///---------------------------------------------------------------------
+	/// Swaps the contents of this string with other.
+	///---------------------------------------------------------------------
+	void swap( CompressedString &other );
+
+//==============================================================================
+// Private Methods
+//==============================================================================
+private:
+
+	///---------------------------------------------------------------------
+	/// The block to write a record of up to length bytes into, a new one
+	/// if the last hasn't room.
+	///---------------------------------------------------------------------
+	Block &room( Block::size_type length );
+
+	CompressedString &operator=( const CompressedString & );
+
+}; // End of CompressedString
+
+
+///-----------------------------------------------------------------------------
+/// Reads the modules of a CompressedString back, in order, decoding them
+/// as it goes.  The string must outlive the reader and not be appended
+/// to while it's read.
+///
+/// LSystem::CompressedString generation( parser.compressSystem() );
+/// LSystem::CompressedReader reader( generation );
+/// renderer.setinput( reader );
+///
+/// @author Lakin Wecker aka nikal@nucleus.com
+///
+/// @see LSystem::CompressedString
+///-----------------------------------------------------------------------------
+class CompressedReader : public ModuleSource {
+
+//==============================================================================
+// Private Variables
+//==============================================================================
+private:
+
+	const CompressedString &myString;
+	CompressedString::Codec myCodec;
+	// The block and the byte in it the next module starts at.
+	std::vector<CompressedString::Block>::size_type myBlock;
+	CompressedString::Block::size_type myPosition;
+
+//==============================================================================
+// Public Methods
+//==============================================================================
+public:
+
+	//----------------------------------------------------------------------
+	// Constructors
+
+	///---------------------------------------------------------------------
+	/// Reads string from its first module.
+	///---------------------------------------------------------------------
+	CompressedReader( const CompressedString &string );
+
+
+	//----------------------------------------------------------------------
+	// Destructor
+
+	///---------------------------------------------------------------------
+	/// Deletes a CompressedReader instance.
+	///---------------------------------------------------------------------
+	virtual ~CompressedReader();
+
+
+	//----------------------------------------------------------------------
+	// Public API
+
+	///---------------------------------------------------------------------
+	/// @see LSystem::ModuleSource::next
+	///---------------------------------------------------------------------
+	virtual bool next( Module &mod );
+
+
+	///---------------------------------------------------------------------
+	/// Decodes up to max modules into the packed block, replacing
+	/// whatever it held.
+	///
+	/// @return the number of modules read, 0 at the end.
+	///---------------------------------------------------------------------
+	ModuleString::size_type next( ModuleString &block,
+		ModuleString::size_type max );
+
+
+	///---------------------------------------------------------------------
+	/// Starts reading over from the first module.
+	///---------------------------------------------------------------------
+	void rewind();
+
+//==============================================================================
+// Private Methods
+//==============================================================================
+private:
+
+	///---------------------------------------------------------------------
+	/// Decodes the next module's symbol, moving past the string's blocks
+	/// as they run out.
+	///
+	/// @return the symbol's name and count, or false at the end.
+	///---------------------------------------------------------------------
+	bool symbol( char &name, unsigned char &count,
+		std::vector<double>::size_type &column, bool &coded );
+
+
+	///---------------------------------------------------------------------
+	/// Decodes count parameters into params.
+	///---------------------------------------------------------------------
+	void parameters( double *params, unsigned char count,
+		std::vector<double>::size_type column, bool coded );
+
+	// Not copyable, a reader keeps its own place.
+	CompressedReader( const CompressedReader & );
+	CompressedReader &operator=( const CompressedReader & );
+
+}; // End of CompressedReader
+
+} // End of LSystem namespace
+
+#endif
@@ -91,6 +91,23 @@ class Error : public std::exception
 			return myFileLine;
 		}
 };
+
+
+///-----------------------------------------------------------------------------
+/// Lets go of an exception held but never to be rethrown, deleting it if
+/// it is a pointer to an Error, as everything here throws.
+///-----------------------------------------------------------------------------
+inline void discardError( std::exception_ptr error ) {
+	if( !error ) {
+		return;
+	}
+	try {
+		std::rethrow_exception( error );
+	} catch( Error *e ) {
+		delete e;
+	} catch( ... ) {
+	}
+}
 };//end namespace LSystem
 
 
@@ -0,0 +1,287 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#include "expansiondag.h"
+
+namespace LSystem {
+
+//------------------------------------------------------------------------------
+// The memo key of a module expanded for depth generations, its name, depth
+// and the exact bits of its parameters.
+static std::string expansionKey( const ModuleString &level,
+	ModuleString::size_type i, int depth )
+{
+	std::string key;
+	key.reserve( 1 + sizeof( depth ) + level.parameterCount( i ) * sizeof( double ) );
+	key += level.name( i );
+	key.append( (const char *)&depth, sizeof( depth ) );
+	key.append( (const char *)level.parameters( i ),
+		level.parameterCount( i ) * sizeof( double ) );
+	return key;
+}
+
+
+//------------------------------------------------------------------------------
+ExpansionDag::ExpansionDag( ProductionSet &productions,
+	const SymbolFrame &globals, const ModuleString &start, int iterations )
+	:
+	myNodes(),
+	myChildren(),
+	myRoots(),
+	myLeaves(),
+	myProductionSet( &productions ),
+	myGlobals( &globals ),
+	myIterations( iterations < 0 ? 0 : iterations ),
+	myStochastic( productions.stochastic() ),
+	myCounts( myIterations + 1, 0 ),
+	myWidths(),
+	myMemo(),
+	myDeterministic(),
+	myLevels(),
+	myPending()
+{
+	myLevels.resize( myIterations + 1 );
+	myPending.resize( myIterations + 1 );
+
+	for( ModuleString::size_type i = 0; i < start.size(); ++i ) {
+		myRoots.push_back( expand( start, i, myIterations ) );
+	}
+
+	//--------------------------------------------------------------
+	// Let go of everything only needed while deriving.
+	myProductionSet = NULL;
+	myGlobals = NULL;
+	std::unordered_map<std::string, unsigned int>().swap( myMemo );
+	myDeterministic.clear();
+	std::vector<length_type>().swap( myCounts );
+	std::vector< std::vector<length_type> >().swap( myWidths );
+	std::vector<ModuleString>().swap( myLevels );
+	std::vector< std::vector<unsigned int> >().swap( myPending );
+}
+
+
+//------------------------------------------------------------------------------
+ExpansionDag::length_type ExpansionDag::length() const {
+	length_type total = 0;
+	for( std::vector<unsigned int>::size_type r = 0; r < myRoots.size(); ++r ) {
+		total += myNodes[ myRoots[r] ].length;
+	}
+	return total;
+}
+
+
+//------------------------------------------------------------------------------
+std::vector<ExpansionDag::Node>::size_type ExpansionDag::memoryUsed() const {
+	return myNodes.capacity() * sizeof( Node )
+		+ myChildren.capacity() * sizeof( unsigned int )
+		+ myRoots.capacity() * sizeof( unsigned int )
+		+ myLeaves.memoryUsed();
+}
+
+
+//------------------------------------------------------------------------------
+void ExpansionDag::flatten( ModuleString &out ) const {
+	out.clear();
+	out.reserve( length(), 0 );
+	ExpansionDagWalker walker( *this );
+	ModuleString::size_type leaf;
+	while( walker.advance( leaf ) ) {
+		out.append( myLeaves, leaf, leaf + 1 );
+	}
+}
+
+
+//------------------------------------------------------------------------------
+unsigned int ExpansionDag::expand( const ModuleString &level,
+	ModuleString::size_type i, int depth )
+{
+	char name = level.name( i );
+	ModuleString::size_type arity = level.parameterCount( i );
+	int generation = myIterations - depth;
+
+	//----------------------------------------------------------------------
+	// A module that is never rewritten is final however deep it is, so
+	// all of its copies share one leaf.
+	if( myProductionSet->matchCount( name, arity ) == 0 ) {
+		depth = 0;
+	}
+
+	bool shared = deterministic( name, arity, depth );
+	std::string key;
+	if( shared ) {
+		key = expansionKey( level, i, depth );
+		std::unordered_map<std::string, unsigned int>::iterator found =
+			myMemo.find( key );
+		if( found != myMemo.end() ) {
+			if( myStochastic ) {
+				count( found->second, generation );
+			}
+			return found->second;
+		}
+	}
+
+	unsigned int index;
+	if( depth == 0 ) {
+		Node leaf = { 1, (unsigned int)myLeaves.size(), 0 };
+		myLeaves.append( level, i, i + 1 );
+		myNodes.push_back( leaf );
+		index = myNodes.size() - 1;
+		if( myStochastic ) {
+			count( index, generation );
+		}
+	} else {
+		//--------------------------------------------------------------
+		// Expand one generation into this depth's storage, then each
+		// successor for the generations left.
+		length_type place = myCounts[ generation ]++;
+		ModuleString &successors = myLevels[ depth ];
+		successors.clear();
+		ProductionSet::apply( level, i,
+			myProductionSet->match( name, arity, generation, place ),
+			*myGlobals, successors );
+
+		std::vector<unsigned int> &children = myPending[ depth ];
+		children.clear();
+		for( ModuleString::size_type s = 0; s < successors.size(); ++s ) {
+			children.push_back( expand( successors, s, depth - 1 ) );
+		}
+		index = addNode( children );
+
+		//--------------------------------------------------------------
+		// Remember how many modules a shared node covers, to count
+		// them when it is used again.
+		if( shared && myStochastic ) {
+			myWidths.resize( myNodes.size() );
+			std::vector<length_type> &widths = myWidths[ index ];
+			widths.assign( depth + 1, 0 );
+			widths[0] = 1;
+			for( std::vector<unsigned int>::size_type c = 0; c < children.size(); ++c ) {
+				for( int k = 1; k <= depth; ++k ) {
+					widths[k] += isLeaf( children[c] ) ? 1 : myWidths[ children[c] ][k - 1];
+				}
+			}
+		}
+	}
+
+	if( shared ) {
+		myMemo[ key ] = index;
+	}
+	return index;
+}
+
+
+//------------------------------------------------------------------------------
+bool ExpansionDag::deterministic( char name, ModuleString::size_type arity,
+	int depth )
+{
+	if( depth == 0 ) {
+		return true;
+	}
+	unsigned int count = myProductionSet->matchCount( name, arity );
+	if( count != 1 ) {
+		return count == 0;
+	}
+
+	std::ostringstream key;
+	key << name << ' ' << arity << ' ' << depth;
+	std::map<std::string, bool>::iterator found = myDeterministic.find( key.str() );
+	if( found != myDeterministic.end() ) {
+		return found->second;
+	}
+
+	// With only one candidate match() draws nothing, so where doesn't matter.
+	bool result = true;
+	const SuccessorVec &v = myProductionSet->match( name, arity, 0, 0 )->getSuccessorVec();
+	for( SuccessorVec::size_type n = 0; result && n < v.size(); ++n ) {
+		result = deterministic( v[n].getName()[0],
+			v[n].getExpressionPtrVec().size(), depth - 1 );
+	}
+	myDeterministic[ key.str() ] = result;
+	return result;
+}
+
+
+//------------------------------------------------------------------------------
+unsigned int ExpansionDag::addNode( const std::vector<unsigned int> &children ) {
+	Node n = { 0, (unsigned int)myChildren.size(), (unsigned int)children.size() };
+	for( std::vector<unsigned int>::size_type c = 0; c < children.size(); ++c ) {
+		n.length += myNodes[ children[c] ].length;
+		myChildren.push_back( children[c] );
+	}
+	myNodes.push_back( n );
+	return myNodes.size() - 1;
+}
+
+
+//------------------------------------------------------------------------------
+void ExpansionDag::count( unsigned int n, int generation ) {
+	if( isLeaf( n ) ) {
+		// A leaf before the last generation is a module that is never
+		// rewritten, and is in every generation after.
+		for( int g = generation; g <= myIterations; ++g ) {
+			++myCounts[g];
+		}
+		return;
+	}
+	const std::vector<length_type> &widths = myWidths[n];
+	for( std::vector<length_type>::size_type k = 0; k < widths.size(); ++k ) {
+		myCounts[ generation + k ] += widths[k];
+	}
+}
+
+
+//------------------------------------------------------------------------------
+bool ExpansionDagWalker::next( Module &mod ) {
+	ModuleString::size_type leaf;
+	if( !advance( leaf ) ) {
+		return false;
+	}
+	myDag.leaves().getModule( leaf, mod );
+	return true;
+}
+
+
+//------------------------------------------------------------------------------
+bool ExpansionDagWalker::advance( ModuleString::size_type &leaf ) {
+	for( ;; ) {
+		if( myStack.empty() ) {
+			if( myRoot == myDag.roots().size() ) {
+				return false;
+			}
+			Frame root = { myDag.roots()[ myRoot++ ], 0 };
+			myStack.push_back( root );
+		}
+
+		Frame &top = myStack.back();
+		if( myDag.isLeaf( top.node ) ) {
+			leaf = myDag.node( top.node ).first;
+			myStack.pop_back();
+			return true;
+		}
+
+		const ExpansionDag::Node &n = myDag.node( top.node );
+		if( top.position == n.count ) {
+			myStack.pop_back();
+			continue;
+		}
+		Frame next = { myDag.child( n.first + top.position++ ), 0 };
+		myStack.push_back( next );
+	}
+}
+
+} // End of LSystem namespace
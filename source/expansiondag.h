@@ -0,0 +1,306 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#ifndef EXPANSIONDAG_H
+#define EXPANSIONDAG_H
+
+#include "modulesource.h"
+#include "productionset.h"
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace LSystem {
+
+///-----------------------------------------------------------------------------
+/// The final generation of an LSystem held as a DAG of shared expansions.
+///
+/// In a deterministic grammar a module with the same name and parameters
+/// always expands the same way in the same number of generations, and
+/// branching grammars produce the same ones over and over.  Each distinct
+/// (module, parameters, generations left) expansion is derived once and
+/// stored as a node listing the nodes of its successors, so the final
+/// string is a straight-line grammar whose size grows with the number of
+/// distinct expansions rather than with the number of modules.
+///
+/// Only subtrees in which no production is picked at random are shared,
+/// stochastic ones are derived separately each time they appear.
+///
+/// LSystem::ExpansionDag dag = parser.expandSystem();
+/// LSystem::ExpansionDagWalker walker( dag );
+/// LSystem::Module m;
+/// while( walker.next( m ) ) {
+///     ...
+/// }
+///
+/// @author Lakin Wecker aka nikal@nucleus.com
+///
+/// @see LSystem::Parser::expandSystem
+/// @see LSystem::ExpansionDagWalker
+///-----------------------------------------------------------------------------
+class ExpansionDag {
+
+//==============================================================================
+// Typedefs
+//==============================================================================
+public:
+	typedef unsigned long long length_type;
+
+	///---------------------------------------------------------------------
+	/// One expansion.  Its children are child( first ) up to
+	/// child( first + count - 1 ).  A leaf is a final module, it has no
+	/// children, a length of 1 and first is its index in leaves().
+	///---------------------------------------------------------------------
+	struct Node {
+		length_type length;
+		unsigned int first;
+		unsigned int count;
+	};
+
+//==============================================================================
+// Private Variables
+//==============================================================================
+private:
+
+	std::vector<Node> myNodes;
+	std::vector<unsigned int> myChildren;
+	std::vector<unsigned int> myRoots;
+	ModuleString myLeaves;
+
+	// Only used while deriving, and emptied once done.
+	ProductionSet *myProductionSet;
+	const SymbolFrame *myGlobals;
+	int myIterations;
+	// For stochastic systems, how many modules of each generation have
+	// been reached so far, and for each shared node how many modules it
+	// covers in each generation from its own on.  These place every
+	// random draw exactly where evaluateSystem() would make it.
+	bool myStochastic;
+	std::vector<length_type> myCounts;
+	std::vector< std::vector<length_type> > myWidths;
+	std::unordered_map<std::string, unsigned int> myMemo;
+	std::map<std::string, bool> myDeterministic;
+	std::vector<ModuleString> myLevels;
+	std::vector< std::vector<unsigned int> > myPending;
+
+//==============================================================================
+// Public Methods
+//==============================================================================
+public:
+
+	//----------------------------------------------------------------------
+	// Constructors
+
+	///---------------------------------------------------------------------
+	/// Derives start for iterations generations.
+	///---------------------------------------------------------------------
+	ExpansionDag( ProductionSet &productions, const SymbolFrame &globals,
+		const ModuleString &start, int iterations );
+
+
+	//----------------------------------------------------------------------
+	// Destructor
+
+	///---------------------------------------------------------------------
+	/// Deletes an ExpansionDag instance.
+	///---------------------------------------------------------------------
+	virtual ~ExpansionDag()
+	{
+	}
+
+
+	//----------------------------------------------------------------------
+	// Getters
+
+	///---------------------------------------------------------------------
+	/// The number of modules in the final generation.
+	///---------------------------------------------------------------------
+	length_type length() const;
+
+
+	///---------------------------------------------------------------------
+	/// The number of distinct expansions stored.
+	///---------------------------------------------------------------------
+	std::vector<Node>::size_type nodeCount() const {
+		return myNodes.size();
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Node n.
+	///---------------------------------------------------------------------
+	const Node &node( unsigned int n ) const {
+		return myNodes[n];
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Entry i of the children lists.
+	///---------------------------------------------------------------------
+	unsigned int child( unsigned int i ) const {
+		return myChildren[i];
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The nodes of the start modules, in order.
+	///---------------------------------------------------------------------
+	const std::vector<unsigned int> &roots() const {
+		return myRoots;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The distinct final modules the leaves refer to.
+	///---------------------------------------------------------------------
+	const ModuleString &leaves() const {
+		return myLeaves;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// True if node n is a final module.
+	///---------------------------------------------------------------------
+	bool isLeaf( unsigned int n ) const {
+		return myNodes[n].count == 0 && myNodes[n].length == 1;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The number of bytes used to hold the DAG.
+	///---------------------------------------------------------------------
+	std::vector<Node>::size_type memoryUsed() const;
+
+
+	//----------------------------------------------------------------------
+	// Public API
+
+	///---------------------------------------------------------------------
+	/// Writes out the whole final generation, replacing what out held.
+	///---------------------------------------------------------------------
+	void flatten( ModuleString &out ) const;
+
+//==============================================================================
+// Private Methods
+//==============================================================================
+private:
+
+	///---------------------------------------------------------------------
+	/// Returns the node for module i of level expanded for depth more
+	/// generations, deriving it if it hasn't been already.
+	///---------------------------------------------------------------------
+	unsigned int expand( const ModuleString &level, ModuleString::size_type i,
+		int depth );
+
+
+	///---------------------------------------------------------------------
+	/// True if expanding a module named name with arity parameters for
+	/// depth generations never picks a production at random.
+	///---------------------------------------------------------------------
+	bool deterministic( char name, ModuleString::size_type arity, int depth );
+
+
+	///---------------------------------------------------------------------
+	/// Adds a node whose children are children, returning its index.
+	///---------------------------------------------------------------------
+	unsigned int addNode( const std::vector<unsigned int> &children );
+
+
+	///---------------------------------------------------------------------
+	/// Counts the modules node n covers in each generation from
+	/// generation on.
+	///---------------------------------------------------------------------
+	void count( unsigned int n, int generation );
+
+}; // End of ExpansionDag
+
+
+///-----------------------------------------------------------------------------
+/// Walks an ExpansionDag depth first, handing out the modules of the final
+/// generation in order without flattening it.  The DAG must outlive the
+/// walker.
+///-----------------------------------------------------------------------------
+class ExpansionDagWalker : public ModuleSource {
+
+//==============================================================================
+// Private Variables
+//==============================================================================
+private:
+
+	struct Frame {
+		unsigned int node;
+		unsigned int position;
+	};
+
+	const ExpansionDag &myDag;
+	std::vector<Frame> myStack;
+	std::vector<unsigned int>::size_type myRoot;
+
+//==============================================================================
+// Public Methods
+//==============================================================================
+public:
+
+	//----------------------------------------------------------------------
+	// Constructors
+
+	///---------------------------------------------------------------------
+	/// Creates a walker starting at the first module.
+	///---------------------------------------------------------------------
+	ExpansionDagWalker( const ExpansionDag &dag )
+		:
+		myDag( dag ),
+		myStack(),
+		myRoot( 0 )
+	{
+	}
+
+
+	//----------------------------------------------------------------------
+	// Public API
+
+	///---------------------------------------------------------------------
+	/// @see LSystem::ModuleSource::next
+	///---------------------------------------------------------------------
+	virtual bool next( Module &mod );
+
+
+	///---------------------------------------------------------------------
+	/// Moves on to the next final module without copying it.
+	///
+	/// @return the index in the DAG's leaves() of the module, or false
+	///  once the whole generation has been walked.
+	///---------------------------------------------------------------------
+	bool advance( ModuleString::size_type &leaf );
+
+
+	///---------------------------------------------------------------------
+	/// Starts the walk over from the first module.
+	///---------------------------------------------------------------------
+	void rewind() {
+		myStack.clear();
+		myRoot = 0;
+	}
+
+}; // End of ExpansionDagWalker
+
+} // End of LSystem namespace
+
+#endif
@@ -23,6 +23,7 @@ namespace LSystem {
 //------------------------------------------------------------------------------
 Expression::Expression( const Expression &source ) {
 	myHead = clone( source.myHead );
+	myCode = source.myCode;
 }
 
 
@@ -32,6 +33,7 @@ Expression &Expression::operator= ( const Expression &source ) {
 		delete myHead;
 	}
 	myHead = clone( source.myHead );
+	myCode = source.myCode;
 	return *this;
 }
 
@@ -58,6 +60,23 @@ double Expression::evaluateExpression(
 }
 
 
+//-----------------------------------------------------------------------------
+void Expression::compile( const std::vector<std::string> &params,
+	const SlotTable &globals )
+{
+	assert( myHead );
+	myCode.compile( myHead, params, globals );
+}
+
+
+//-----------------------------------------------------------------------------
+double Expression::evaluate( const double *params,
+	const double *globals ) const
+{
+	return myCode.evaluate( params, globals );
+}
+
+
 //-----------------------------------------------------------------------------
 std::ostream &operator<<( std::ostream &out, Expression *expr ) {
 	return expr->printTree( out, expr->myHead );
@@ -67,7 +86,8 @@ std::ostream &operator<<( std::ostream &out, Expression *expr ) {
 //-----------------------------------------------------------------------------
 Expression::Expression(ExpressionNode *head)
 	:
-	myHead( head )
+	myHead( head ),
+	myCode()
 {
 }
 
@@ -92,21 +112,21 @@ ExpressionNode *Expression::parseExpressionReal(
 {
 	ExpressionNode *ret = NULL;
 	ret = parseTerm( scan );
-	Token *tok = scan.lex();
+	Lexeme tok = scan.lex();
 
 	while( ret && // Make sure we found a term to begin with
-			tok->getType() == Token::PRODUCTION &&
-			(tok->getAttribute() == "-" || 
-			tok->getAttribute() == "+") ) {
+			tok.getType() == Token::PRODUCTION &&
+			(tok.getAttribute() == "-" || 
+			tok.getAttribute() == "+") ) {
 		ExpressionNode *next;
 		next = parseTerm( scan );
 		if( !next ) { 
 			delete ret;
 			LSYSTEM_ERROR(
-				"Error: a " + tok->getAttribute()
+				"Error: a " + std::string( tok.getAttribute() )
 				+ " requires that a expression follow it." );
 		}
-		ret = new ExpressionNode( tok, ret, next );
+		ret = new ExpressionNode( tok.toToken(), ret, next );
 		tok = scan.lex();
 	}
 	scan.unlex( tok );
@@ -118,21 +138,21 @@ ExpressionNode *Expression::parseExpressionReal(
 ExpressionNode *Expression::parseTerm( Scanner &scan ) {
 	ExpressionNode *ret = NULL;
 	ret = parseFactor( scan );
-	Token *tok = scan.lex();
+	Lexeme tok = scan.lex();
 
 	while( ret &&  // Make sure we have a factor to begin with
-			tok->getType() == Token::PRODUCTION &&
-			(tok->getAttribute() == "/" ||
-			 tok->getAttribute() == "*") ) {
+			tok.getType() == Token::PRODUCTION &&
+			(tok.getAttribute() == "/" ||
+			 tok.getAttribute() == "*") ) {
 		ExpressionNode *next;
 		next = parseTerm( scan );
 		if( !next ) { 
 			delete ret;
 			LSYSTEM_ERROR(
-				"Error: a " + tok->getAttribute()
+				"Error: a " + std::string( tok.getAttribute() )
 				+ " requires that a term follow it." );
 		}
-		ret = new ExpressionNode( tok, ret, next );
+		ret = new ExpressionNode( tok.toToken(), ret, next );
 		tok = scan.lex();
 	}
 	scan.unlex( tok );
@@ -142,41 +162,37 @@ ExpressionNode *Expression::parseTerm( Scanner &scan ) {
 
 //------------------------------------------------------------------------------
 ExpressionNode *Expression::parseFactor( Scanner &scan ) {
-	Token *tok = scan.lex();
+	Lexeme tok = scan.lex();
 	// '(' Expression ')'
-	if( tok->getType() == Token::START_PARENS ) {
+	if( tok.getType() == Token::START_PARENS ) {
 		ExpressionNode *ret = NULL;
 		ret = parseExpressionReal( scan );
 		if( !ret ) {
-			std::string attr = tok->getAttribute();
-			delete tok;
+			std::string attr( tok.getAttribute() );
 			LSYSTEM_ERROR("Error: Found: '"+attr+"' expected follow up expression.");
 		}
-		delete tok;
 		tok = scan.lex();
-		if( tok->getType() != Token::END_PARENS ) {
-			std::string err = "Error: Found: '" + tok->getAttribute() + "' but expected a ')'.";
-			delete tok;
+		if( tok.getType() != Token::END_PARENS ) {
+			std::string err = "Error: Found: '" + std::string( tok.getAttribute() ) + "' but expected a ')'.";
+			delete ret;
 			LSYSTEM_ERROR(err);
 		}
-		delete tok;
 		return ret;
 	// '-' Factor
-	} else if( tok->getType() == Token::PRODUCTION && tok->getAttribute() == "-" ) {
+	} else if( tok.getType() == Token::PRODUCTION && tok.getAttribute() == "-" ) {
 		ExpressionNode *ret = NULL;
 		ret = parseFactor( scan );
 		if( !ret ) {
 			std::string err = "Error: Expecting a factor after a unary minus.";
-			delete tok;
 			LSYSTEM_ERROR(err);
 		}
-		return new ExpressionNode( tok, ret, NULL );
+		return new ExpressionNode( tok.toToken(), ret, NULL );
 	// Number
-	} else if( tok->getType() == Token::FLOAT || tok->getType() == Token::INT ) {
-		return new ExpressionNode( tok, NULL, NULL );
+	} else if( tok.getType() == Token::FLOAT || tok.getType() == Token::INT ) {
+		return new ExpressionNode( tok.toToken(), NULL, NULL );
 	// Identifier
-	} else if( tok->getType() == Token::IDENTIFIER ) {
-		return new ExpressionNode( tok, NULL, NULL );
+	} else if( tok.getType() == Token::IDENTIFIER ) {
+		return new ExpressionNode( tok.toToken(), NULL, NULL );
 	}
 	//Not a factor!!!
 	scan.unlex( tok );
@@ -20,6 +20,7 @@
 #define EXPRESSION_H
 
 #include "scanner.h"
+#include "expressioncode.h"
 
 #include <iostream>
 #include <sstream>
@@ -55,6 +56,10 @@ class Expression
 private:
 
 	ExpressionNode * myHead;
+	ExpressionCode myCode;
+
+	// Saves and loads the tree and code as they are.
+	friend class GrammarCache;
 
 //==============================================================================
 // Public Methods
@@ -101,6 +106,38 @@ public:
 		std::map<std::string, double> &lookupTable );
 
 
+	///---------------------------------------------------------------------
+	/// Compiles the expression to bytecode, resolving each identifier to
+	/// one of params or to a global.  Throws a pointer to an Error if an
+	/// identifier is neither.
+	///
+	/// @param params The names of the parameters, in order.
+	/// @param globals The slot of each global.
+	///---------------------------------------------------------------------
+	void compile( const std::vector<std::string> &params,
+		const SlotTable &globals );
+
+
+	///---------------------------------------------------------------------
+	/// Evaluate the compiled bytecode of this expression.  Gives the same
+	/// result as evaluateExpression(), which walks the tree and is kept
+	/// as the reference implementation.
+	///
+	/// @param params The values of the parameters compile() was given.
+	/// @param globals The values of the globals, indexed by slot.
+	/// @return the value that this scan evaluates to.
+	///---------------------------------------------------------------------
+	double evaluate( const double *params, const double *globals ) const;
+
+
+	///---------------------------------------------------------------------
+	/// Gets the compiled bytecode of this expression.
+	///---------------------------------------------------------------------
+	const ExpressionCode &getCode() const {
+		return myCode;
+	}
+
+
 	///---------------------------------------------------------------------
 	/// Overloaded << operator for std::ostreams. Postfix Notation.
 	///
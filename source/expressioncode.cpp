@@ -0,0 +1,601 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#include "token.h"
+#include "expressionnode.h"
+#include "expressioncode.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <map>
+#include <set>
+#include <tuple>
+
+namespace LSystem {
+
+//------------------------------------------------------------------------------
+// Helpers for looking at the tree.
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// True if node is a number.
+static bool isConstant( const ExpressionNode * const node ) {
+	Token::Type type = node->getToken()->getType();
+	return type == Token::FLOAT || type == Token::INT;
+}
+
+
+//------------------------------------------------------------------------------
+// The value of a number node, decoded the same way evaluateNode does.
+static double constantValue( const ExpressionNode * const node ) {
+	return (double)atof( node->getToken()->getAttribute().c_str() );
+}
+
+
+//------------------------------------------------------------------------------
+// The operator of an operator node.
+static char operatorOf( const ExpressionNode * const node ) {
+	return node->getToken()->getAttribute()[0];
+}
+
+
+//------------------------------------------------------------------------------
+// The values computed by a set of expressions, kept as a graph in which each
+// distinct value appears only once.  Values are numbered in the order they
+// are made, so operands always come before the values using them.
+//------------------------------------------------------------------------------
+namespace {
+
+class ValueGraph {
+public:
+	struct Value {
+		// One of CONST, PARAM, NEG, ADD, SUB, MUL or DIV.
+		ExpressionCode::OpCode op;
+		// The operands, or for PARAM the parameter slot.
+		unsigned int a;
+		unsigned int b;
+		double constant;
+	};
+
+	std::vector<Value> values;
+
+	bool isConstant( unsigned int v ) const {
+		return values[v].op == ExpressionCode::CONST;
+	}
+
+	unsigned int constant( double c ) {
+		unsigned long long bits;
+		memcpy( &bits, &c, sizeof( bits ) );
+		return intern( ExpressionCode::CONST, 0, 0, bits, c );
+	}
+
+	unsigned int param( unsigned int slot ) {
+		return intern( ExpressionCode::PARAM, slot, 0, 0, 0.0 );
+	}
+
+	unsigned int negate( unsigned int x ) {
+		if( isConstant( x ) ) {
+			return constant( -values[x].constant );
+		}
+		return intern( ExpressionCode::NEG, x, 0, 0, 0.0 );
+	}
+
+	unsigned int binary( ExpressionCode::OpCode op, unsigned int x, unsigned int y ) {
+		// Fold, unless it would hide a division by zero.
+		if( isConstant( x ) && isConstant( y ) &&
+			!( op == ExpressionCode::DIV && values[y].constant == 0.0 ) )
+		{
+			double l = values[x].constant;
+			double r = values[y].constant;
+			switch( op ) {
+				case ExpressionCode::ADD: return constant( l + r );
+				case ExpressionCode::SUB: return constant( l - r );
+				case ExpressionCode::MUL: return constant( l * r );
+				case ExpressionCode::DIV: return constant( l / r );
+				default: assert(0);
+			}
+		}
+		// Multiply by the reciprocal instead of dividing.
+		if( op == ExpressionCode::DIV && isConstant( y ) ) {
+			double reciprocal = 1.0 / values[y].constant;
+			if( values[y].constant != 0.0 && std::isfinite( reciprocal )
+				&& reciprocal != 0.0 )
+			{
+				op = ExpressionCode::MUL;
+				y = constant( reciprocal );
+			}
+		}
+		// + and * commute exactly, so x+y and y+x are the same value.
+		if( ( op == ExpressionCode::ADD || op == ExpressionCode::MUL ) && x > y ) {
+			std::swap( x, y );
+		}
+		return intern( op, x, y, 0, 0.0 );
+	}
+
+private:
+	typedef std::tuple<int, unsigned int, unsigned int, unsigned long long> Key;
+	std::map<Key, unsigned int> myIndex;
+
+	unsigned int intern( ExpressionCode::OpCode op, unsigned int a, unsigned int b,
+		unsigned long long bits, double c )
+	{
+		Key key( op, a, b, bits );
+		std::map<Key, unsigned int>::iterator i = myIndex.find( key );
+		if( i != myIndex.end() ) {
+			return i->second;
+		}
+		Value v = { op, a, b, c };
+		values.push_back( v );
+		myIndex[ key ] = values.size() - 1;
+		return values.size() - 1;
+	}
+};
+
+} // End of anonymous namespace
+
+
+//------------------------------------------------------------------------------
+// A register file of at least count registers for code too big for the stack
+// one.  Kept per thread and only ever grown, so evaluating doesn't allocate
+// after the first time.
+static double *largeRegisters( unsigned int count ) {
+	static thread_local std::vector<double> registers;
+	if( registers.size() < count ) {
+		registers.resize( count );
+	}
+	return registers.data();
+}
+
+
+//------------------------------------------------------------------------------
+ExpressionCode::ExpressionCode()
+	:
+	myInstructions(),
+	myConstants(),
+	myRegisterCount( 0 )
+{
+}
+
+
+//------------------------------------------------------------------------------
+ExpressionCode::~ExpressionCode()
+{
+}
+
+
+//------------------------------------------------------------------------------
+void ExpressionCode::compile( const ExpressionNode * const head,
+	const std::vector<std::string> &params, const SlotTable &globals )
+{
+	assert( head );
+	myInstructions.clear();
+	myConstants.clear();
+
+	myRegisterCount = registersNeeded( head );
+	emit( head, 0, params, globals );
+}
+
+
+//------------------------------------------------------------------------------
+unsigned int ExpressionCode::combine(
+	const std::vector<const ExpressionCode *> &codes, const SymbolFrame &globals )
+{
+	typedef std::vector<unsigned int> IndexVec;
+	typedef ValueGraph::Value Value;
+	ValueGraph graph;
+	IndexVec outputs;
+	unsigned int before = 0;
+
+	//--------------------------------------------------------------
+	// Run each code symbolically, building up the graph of values.
+	for( std::vector<const ExpressionCode *>::size_type c = 0; c < codes.size(); ++c ) {
+		const ExpressionCode &code = *codes[c];
+		assert( code.compiled() );
+		before += code.size();
+
+		IndexVec r( code.myRegisterCount );
+		const double *k = code.myConstants.data();
+		for( std::vector<Instruction>::size_type n = 0; n < code.size(); ++n ) {
+			const Instruction &i = code.myInstructions[n];
+			switch( i.op ) {
+				case CONST: r[i.dst] = graph.constant( k[i.a] ); break;
+				case PARAM: r[i.dst] = graph.param( i.a ); break;
+				case GLOBAL: r[i.dst] = graph.constant( globals[i.a] ); break;
+				case NEG: r[i.dst] = graph.negate( r[i.a] ); break;
+				case ADD: case SUB: case MUL: case DIV:
+					r[i.dst] = graph.binary( (OpCode)i.op, r[i.a], r[i.b] );
+					break;
+				case ADDK: case SUBK: case MULK: case DIVK:
+					r[i.dst] = graph.binary( (OpCode)( i.op - ADDK + ADD ),
+						r[i.a], graph.constant( k[i.b] ) );
+					break;
+				case KSUB:
+					r[i.dst] = graph.binary( SUB, graph.constant( k[i.a] ), r[i.b] );
+					break;
+				case KDIV:
+					r[i.dst] = graph.binary( DIV, graph.constant( k[i.a] ), r[i.b] );
+					break;
+				default:
+					assert(0);
+			}
+		}
+		outputs.push_back( r[0] );
+	}
+
+	const std::vector<Value> &values = graph.values;
+	if( values.size() > 0xffff || outputs.size() > 0xffff ) {
+		LSYSTEM_ERROR( "Error: Too many expressions to compile together." );
+	}
+
+	//--------------------------------------------------------------
+	// Work out which values are needed and how many times each is
+	// read from a register.  A constant operand is used in place
+	// where there is an opcode for it.
+	std::vector<bool> needed( values.size(), false );
+	IndexVec reads( values.size(), 0 );
+	std::vector<IndexVec> stores( values.size() );
+	for( IndexVec::size_type n = 0; n < outputs.size(); ++n ) {
+		needed[ outputs[n] ] = true;
+		stores[ outputs[n] ].push_back( n );
+	}
+	for( IndexVec::size_type v = values.size(); v-- > 0; ) {
+		const Value &val = values[v];
+		if( !needed[v] || val.op == CONST || val.op == PARAM ) {
+			continue;
+		}
+		bool leftInPlace = val.op != NEG && !graph.isConstant( val.b )
+			&& graph.isConstant( val.a );
+		bool rightInPlace = val.op != NEG && graph.isConstant( val.b );
+		if( !leftInPlace ) {
+			needed[ val.a ] = true;
+			++reads[ val.a ];
+		}
+		if( val.op != NEG && !rightInPlace ) {
+			needed[ val.b ] = true;
+			++reads[ val.b ];
+		}
+	}
+
+	//--------------------------------------------------------------
+	// Emit the needed values in order, handing out registers as
+	// values are made and taking them back after their last read.
+	myInstructions.clear();
+	myConstants.clear();
+	myRegisterCount = 0;
+
+	IndexVec reg( values.size(), 0 );
+	IndexVec pooled( values.size(), values.size() );
+	std::set<unsigned int> free;
+
+	auto read = [&]( unsigned int v ) {
+		if( --reads[v] == 0 ) {
+			free.insert( reg[v] );
+		}
+		return reg[v];
+	};
+	auto pool = [&]( unsigned int v ) {
+		if( pooled[v] == values.size() ) {
+			pooled[v] = constant( values[v].constant );
+		}
+		return pooled[v];
+	};
+
+	for( IndexVec::size_type v = 0; v < values.size(); ++v ) {
+		if( !needed[v] ) {
+			continue;
+		}
+		const Value &val = values[v];
+		OpCode op = val.op;
+		unsigned int a = 0;
+		unsigned int b = 0;
+		if( op == CONST ) {
+			a = pool( v );
+		} else if( op == PARAM ) {
+			a = val.a;
+		} else if( op == NEG ) {
+			a = read( val.a );
+		} else if( graph.isConstant( val.b ) ) {
+			a = read( val.a );
+			b = pool( val.b );
+			op = (OpCode)( op - ADD + ADDK );
+		} else if( graph.isConstant( val.a ) ) {
+			switch( op ) {
+				case ADD: op = ADDK; a = read( val.b ); b = pool( val.a ); break;
+				case MUL: op = MULK; a = read( val.b ); b = pool( val.a ); break;
+				case SUB: op = KSUB; a = pool( val.a ); b = read( val.b ); break;
+				case DIV: op = KDIV; a = pool( val.a ); b = read( val.b ); break;
+				default: assert(0);
+			}
+		} else {
+			a = read( val.a );
+			b = read( val.b );
+		}
+
+		unsigned int dst;
+		if( free.empty() ) {
+			if( myRegisterCount > 0xff ) {
+				LSYSTEM_ERROR( "Error: Too many expressions to compile together." );
+			}
+			dst = myRegisterCount++;
+		} else {
+			dst = *free.begin();
+			free.erase( free.begin() );
+		}
+		emit( op, dst, a, b );
+
+		for( IndexVec::size_type n = 0; n < stores[v].size(); ++n ) {
+			emit( STORE, 0, stores[v][n], dst );
+		}
+		reg[v] = dst;
+		if( reads[v] == 0 ) {
+			free.insert( dst );
+		}
+	}
+
+	unsigned int after = myInstructions.size() - outputs.size();
+	return before > after ? before - after : 0;
+}
+
+
+//------------------------------------------------------------------------------
+double ExpressionCode::evaluate( const double *params,
+	const double *globals ) const
+{
+	assert( compiled() );
+
+	if( myRegisterCount > MAX_REGISTERS ) {
+		double *r = largeRegisters( myRegisterCount );
+		run( r, params, globals, NULL );
+		return r[0];
+	}
+	double r[ MAX_REGISTERS ];
+	run( r, params, globals, NULL );
+	return r[0];
+}
+
+
+//------------------------------------------------------------------------------
+void ExpressionCode::evaluate( const double *params, const double *globals,
+	double *out ) const
+{
+	if( myRegisterCount > MAX_REGISTERS ) {
+		run( largeRegisters( myRegisterCount ), params, globals, out );
+		return;
+	}
+	double r[ MAX_REGISTERS ];
+	run( r, params, globals, out );
+}
+
+
+//------------------------------------------------------------------------------
+void ExpressionCode::run( double *r, const double *params,
+	const double *globals, double *out ) const
+{
+	const double *k = myConstants.data();
+	const Instruction *i = myInstructions.data();
+	const Instruction *end = i + myInstructions.size();
+
+	for( ; i != end; ++i ) {
+		switch( i->op ) {
+			case CONST:
+				r[i->dst] = k[i->a];
+				break;
+			case PARAM:
+				r[i->dst] = params[i->a];
+				break;
+			case GLOBAL:
+				r[i->dst] = globals[i->a];
+				break;
+			case NEG:
+				r[i->dst] = -r[i->a];
+				break;
+			case ADD:
+				r[i->dst] = r[i->a] + r[i->b];
+				break;
+			case SUB:
+				r[i->dst] = r[i->a] - r[i->b];
+				break;
+			case MUL:
+				r[i->dst] = r[i->a] * r[i->b];
+				break;
+			case DIV:
+				if( r[i->b] == 0.0 ) LSYSTEM_ERROR("Error: Division by zero\n");
+				r[i->dst] = r[i->a] / r[i->b];
+				break;
+			case ADDK:
+				r[i->dst] = r[i->a] + k[i->b];
+				break;
+			case SUBK:
+				r[i->dst] = r[i->a] - k[i->b];
+				break;
+			case MULK:
+				r[i->dst] = r[i->a] * k[i->b];
+				break;
+			case DIVK:
+				if( k[i->b] == 0.0 ) LSYSTEM_ERROR("Error: Division by zero\n");
+				r[i->dst] = r[i->a] / k[i->b];
+				break;
+			case KSUB:
+				r[i->dst] = k[i->a] - r[i->b];
+				break;
+			case KDIV:
+				if( r[i->b] == 0.0 ) LSYSTEM_ERROR("Error: Division by zero\n");
+				r[i->dst] = k[i->a] / r[i->b];
+				break;
+			case STORE:
+				out[i->a] = r[i->b];
+				break;
+			default:
+				assert(0);
+		}
+	}
+}
+
+
+//------------------------------------------------------------------------------
+unsigned int ExpressionCode::registersNeeded( const ExpressionNode * const node ) {
+	const ExpressionNode * const left = node->getLeftChild();
+	const ExpressionNode * const right = node->getRightChild();
+
+	//Base Case: numbers and identifiers
+	if( !left ) {
+		return 1;
+	}
+	//Unary minus works in place.
+	if( !right ) {
+		return registersNeeded( left );
+	}
+	//A constant operand doesn't need a register.
+	if( isConstant( right ) ) {
+		return registersNeeded( left );
+	}
+	if( isConstant( left ) ) {
+		return registersNeeded( right );
+	}
+	unsigned int l = registersNeeded( left );
+	unsigned int r = registersNeeded( right );
+	if( l == r ) {
+		return l + 1;
+	}
+	return l > r ? l : r;
+}
+
+
+//------------------------------------------------------------------------------
+void ExpressionCode::emit( const ExpressionNode * const node, unsigned int dst,
+	const std::vector<std::string> &params, const SlotTable &globals )
+{
+	const Token * const tok = node->getToken();
+	const ExpressionNode * const left = node->getLeftChild();
+	const ExpressionNode * const right = node->getRightChild();
+
+	//--------------------------------------------------------------
+	// Leaves
+	if( isConstant( node ) ) {
+		emit( CONST, dst, constant( constantValue( node ) ), 0 );
+		return;
+	} else if( tok->getType() == Token::IDENTIFIER ) {
+		// Parameters silently override globals.
+		const std::string &identifier = tok->getAttribute();
+		for( std::vector<std::string>::size_type p = params.size(); p > 0; --p ) {
+			if( params[p - 1] == identifier ) {
+				emit( PARAM, dst, p - 1, 0 );
+				return;
+			}
+		}
+		SlotTable::const_iterator global = globals.find( identifier );
+		if( global == globals.end() ) {
+			LSYSTEM_ERROR( "Error: Undefined identifier: '" + identifier + "'." );
+		}
+		emit( GLOBAL, dst, global->second, 0 );
+		return;
+	}
+
+	assert( tok->getType() == Token::PRODUCTION );
+	assert( left );
+	char op = operatorOf( node );
+
+	//--------------------------------------------------------------
+	// Unary minus
+	if( !right ) {
+		assert( op == '-' );
+		emit( left, dst, params, globals );
+		emit( NEG, dst, dst, 0 );
+		return;
+	}
+
+	//--------------------------------------------------------------
+	// Binary operators with a constant right hand side.
+	if( isConstant( right ) ) {
+		emit( left, dst, params, globals );
+		unsigned int k = constant( constantValue( right ) );
+		switch( op ) {
+			case '+': emit( ADDK, dst, dst, k ); return;
+			case '-': emit( SUBK, dst, dst, k ); return;
+			case '*': emit( MULK, dst, dst, k ); return;
+			case '/': emit( DIVK, dst, dst, k ); return;
+		}
+		assert(0);
+	}
+
+	//--------------------------------------------------------------
+	// Binary operators with a constant left hand side.  + and *
+	// commute exactly so they can use the same opcodes.
+	if( isConstant( left ) ) {
+		emit( right, dst, params, globals );
+		unsigned int k = constant( constantValue( left ) );
+		switch( op ) {
+			case '+': emit( ADDK, dst, dst, k ); return;
+			case '-': emit( KSUB, dst, k, dst ); return;
+			case '*': emit( MULK, dst, dst, k ); return;
+			case '/': emit( KDIV, dst, k, dst ); return;
+		}
+		assert(0);
+	}
+
+	//--------------------------------------------------------------
+	// Binary operators on two registers, evaluate the child that
+	// needs more registers first.
+	unsigned int a = dst;
+	unsigned int b = dst + 1;
+	if( registersNeeded( right ) > registersNeeded( left ) ) {
+		emit( right, dst, params, globals );
+		emit( left, dst + 1, params, globals );
+		a = dst + 1;
+		b = dst;
+	} else {
+		emit( left, dst, params, globals );
+		emit( right, dst + 1, params, globals );
+	}
+	switch( op ) {
+		case '+': emit( ADD, dst, a, b ); return;
+		case '-': emit( SUB, dst, a, b ); return;
+		case '*': emit( MUL, dst, a, b ); return;
+		case '/': emit( DIV, dst, a, b ); return;
+	}
+	assert(0);
+}
+
+
+//------------------------------------------------------------------------------
+void ExpressionCode::emit( OpCode op, unsigned int dst,
+	unsigned int a, unsigned int b )
+{
+	// The fields are narrower than what they are given, so an expression
+	// too big for them has to fail rather than wrap.
+	if( dst > 0xff || a > 0xffff || b > 0xffff ) {
+		LSYSTEM_ERROR( "Error: Too many expressions to compile together." );
+	}
+	Instruction i;
+	i.op = (unsigned char)op;
+	i.dst = (unsigned char)dst;
+	i.a = (unsigned short)a;
+	i.b = (unsigned short)b;
+	myInstructions.push_back( i );
+}
+
+
+//------------------------------------------------------------------------------
+unsigned int ExpressionCode::constant( double value ) {
+	myConstants.push_back( value );
+	return myConstants.size() - 1;
+}
+
+
+} // End of LSystem namespace
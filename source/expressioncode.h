@@ -0,0 +1,259 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#ifndef EXPRESSIONCODE_H
+#define EXPRESSIONCODE_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+
+namespace LSystem {
+
+//------------------------------------------------------------------------------
+// Predeclaration of expression node,
+class ExpressionNode;
+
+//==============================================================================
+// Typedefs
+//==============================================================================
+typedef std::vector<double> SymbolFrame;
+typedef std::map<std::string, unsigned int> SlotTable;
+
+///-----------------------------------------------------------------------------
+/// An expression tree compiled to register based bytecode.
+///
+/// Walking an ExpressionNode tree means chasing pointers and comparing token
+/// strings at every node, and re-parsing every number each time it is
+/// evaluated.  ExpressionCode flattens the tree once into a list of typed
+/// instructions over a small register file, with the numbers already decoded
+/// into a constant pool, so evaluating it is one tight loop.
+///
+/// Operations with a constant operand, such as l*0.2, get their own opcodes
+/// so the constant is used in place instead of being loaded into a register.
+///
+/// Identifiers are resolved to slots when the code is compiled, either one
+/// of the parameters of the module being rewritten or one of the globals,
+/// so evaluating them is an index into a flat array rather than a string
+/// keyed lookup.  An identifier that is neither is an error.
+///
+/// Several compiled expressions, such as all those of one production, can be
+/// combined into a single optimized program writing one value per expression.
+///
+/// @author Lakin Wecker aka nikal@nucleus.com
+///
+/// @see LSystem::Expression
+/// @see LSystem::ExpressionNode
+///-----------------------------------------------------------------------------
+class ExpressionCode
+{
+
+//==============================================================================
+// Typedefs, enums, etc.
+//==============================================================================
+public:
+	///---------------------------------------------------------------------
+	/// The instructions.  r is a register, k a constant, p a parameter
+	/// and g a global, all given as indexes.
+	///---------------------------------------------------------------------
+	enum OpCode {
+		// r[dst] = k[a]
+		CONST,
+		// r[dst] = p[a]
+		PARAM,
+		// r[dst] = g[a]
+		GLOBAL,
+		// r[dst] = -r[a]
+		NEG,
+		// r[dst] = r[a] op r[b]
+		ADD, SUB, MUL, DIV,
+		// r[dst] = r[a] op k[b]
+		ADDK, SUBK, MULK, DIVK,
+		// r[dst] = k[a] op r[b]
+		KSUB, KDIV,
+		// out[a] = r[b]
+		STORE
+	};
+
+	///---------------------------------------------------------------------
+	/// One instruction.
+	///---------------------------------------------------------------------
+	struct Instruction {
+		unsigned char op;
+		unsigned char dst;
+		unsigned short a;
+		unsigned short b;
+	};
+
+	///---------------------------------------------------------------------
+	/// Expressions needing up to this many registers keep them on the
+	/// stack, deeper ones share a register file kept per thread.
+	///---------------------------------------------------------------------
+	static const unsigned int MAX_REGISTERS = 32;
+
+//==============================================================================
+// Private Variables
+//==============================================================================
+private:
+
+	std::vector<Instruction> myInstructions;
+	std::vector<double> myConstants;
+	unsigned int myRegisterCount;
+
+	// Saves and loads the code as it is.
+	friend class GrammarCache;
+
+//==============================================================================
+// Public Methods
+//==============================================================================
+public:
+
+	//----------------------------------------------------------------------
+	// Constructors
+
+	///---------------------------------------------------------------------
+	/// Creates an empty ExpressionCode, which isn't compiled().
+	///---------------------------------------------------------------------
+	ExpressionCode();
+
+
+	//----------------------------------------------------------------------
+	// Destructor
+
+	///---------------------------------------------------------------------
+	/// Deletes an ExpressionCode instance.
+	///---------------------------------------------------------------------
+	virtual ~ExpressionCode();
+
+
+	//----------------------------------------------------------------------
+	// Public API
+
+	///---------------------------------------------------------------------
+	/// Compiles the expression tree headed by head, replacing any code
+	/// already held.  Throws a pointer to an Error if the tree uses an
+	/// identifier that is neither a parameter nor a global, or needs
+	/// more than 256 registers or 65536 constants, parameters or globals,
+	/// as combine() does.
+	///
+	/// @param params The names of the parameters, in order.  They hide
+	///  globals of the same name.
+	/// @param globals The slot of each global.
+	///---------------------------------------------------------------------
+	void compile( const ExpressionNode * const head,
+		const std::vector<std::string> &params, const SlotTable &globals );
+
+
+	///---------------------------------------------------------------------
+	/// Replaces any code held with one program computing all of codes,
+	/// the value of codes[n] going to out[n] of evaluate().  While
+	/// combining:
+	///  - globals, which are fixed once parsed, are folded into
+	///    constants along with any operation on constants only,
+	///  - identical subexpressions are computed once and shared,
+	///  - division by a constant becomes multiplication by its
+	///    reciprocal, which may differ from dividing in the last bit.
+	/// Division by a constant zero is left alone, to fail when run.
+	///
+	/// @param globals The values of the globals the codes refer to.
+	/// @return the number of instructions eliminated.
+	///---------------------------------------------------------------------
+	unsigned int combine( const std::vector<const ExpressionCode *> &codes,
+		const SymbolFrame &globals );
+
+
+	///---------------------------------------------------------------------
+	/// True if there is code to evaluate.
+	///---------------------------------------------------------------------
+	bool compiled() const {
+		return !myInstructions.empty();
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Runs the code.  Gives the same result as
+	/// ExpressionNode::evaluateNode on the tree it was compiled from.
+	///
+	/// @param params The values of the parameters.
+	/// @param globals The values of the globals, indexed by slot.
+	/// @return the value that the expression evaluates to.
+	///---------------------------------------------------------------------
+	double evaluate( const double *params, const double *globals ) const;
+
+
+	///---------------------------------------------------------------------
+	/// Runs code made by combine(), writing the value of each of the
+	/// combined expressions to out.
+	///---------------------------------------------------------------------
+	void evaluate( const double *params, const double *globals,
+		double *out ) const;
+
+
+	///---------------------------------------------------------------------
+	/// The number of instructions.
+	///---------------------------------------------------------------------
+	std::vector<Instruction>::size_type size() const {
+		return myInstructions.size();
+	}
+
+
+//==============================================================================
+// Private methods
+//==============================================================================
+private:
+
+	///---------------------------------------------------------------------
+	/// The number of registers needed to evaluate node, evaluating the
+	/// hungrier child of a binary operation first.
+	///---------------------------------------------------------------------
+	static unsigned int registersNeeded( const ExpressionNode * const node );
+
+
+	///---------------------------------------------------------------------
+	/// Emits the code that leaves the value of node in register dst,
+	/// using only registers dst and up.
+	///---------------------------------------------------------------------
+	void emit( const ExpressionNode * const node, unsigned int dst,
+		const std::vector<std::string> &params, const SlotTable &globals );
+
+
+	///---------------------------------------------------------------------
+	/// Runs the code using the register file r.
+	///---------------------------------------------------------------------
+	void run( double *r, const double *params, const double *globals,
+		double *out ) const;
+
+
+	///---------------------------------------------------------------------
+	/// Appends an instruction.
+	///---------------------------------------------------------------------
+	void emit( OpCode op, unsigned int dst, unsigned int a, unsigned int b );
+
+
+	///---------------------------------------------------------------------
+	/// Adds a constant to the pool, returning its index.
+	///---------------------------------------------------------------------
+	unsigned int constant( double value );
+
+
+}; // End of ExpressionCode
+
+} // End of LSystem namespace
+
+#endif
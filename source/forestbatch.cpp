@@ -0,0 +1,166 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#include "forestbatch.h"
+#include "error.h"
+
+#include <chrono>
+#include <iomanip>
+
+namespace LSystem {
+
+//------------------------------------------------------------------------------
+// Seconds since start.
+static double since( std::chrono::steady_clock::time_point start ) {
+	return std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - start ).count();
+}
+
+
+//------------------------------------------------------------------------------
+ForestBatch::ForestBatch( CompiledGrammarPtr grammar, unsigned int threads )
+	:
+	myGrammar( grammar ),
+	myKept( ModuleString::nameSet( TURTLE_MODULES ) ),
+	myPool( threads ),
+	myBuffers(),
+	myInstances(),
+	mySeconds( 0.0 )
+{
+}
+
+
+//------------------------------------------------------------------------------
+const std::vector<ForestInstance> &ForestBatch::run( unsigned long long firstSeed,
+	unsigned int count, Consumer consume )
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	myInstances.assign( count, ForestInstance() );
+	myBuffers.resize( myPool.threadCount() );
+
+	WorkPool::Group group;
+	for( unsigned int n = 0; n < count; ++n ) {
+		myPool.push( group, [this, n, firstSeed, &consume]() {
+			// Every thread keeps its own buffers from one instance to the
+			// next, so once they have grown deriving doesn't allocate.
+			Buffers &buffers = myBuffers[ myPool.currentQueue() ];
+			ModuleString &result = buffers.result;
+			ModuleString &scratch = buffers.scratch;
+
+			ForestInstance &instance = myInstances[n];
+			instance.seed = firstSeed + n;
+
+			// One instance failing is reported with it, the others are
+			// still made.
+			LRenderer renderer;
+			try {
+				std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+				myGrammar->derive( instance.seed, result, scratch, &myKept );
+				instance.modules = result.size();
+				instance.deriveSeconds = since( begin );
+
+				begin = std::chrono::steady_clock::now();
+				renderer.setinput( result );
+				instance.branches = renderer.branchcount();
+				instance.leaves = renderer.leafcount();
+				instance.interpretSeconds = since( begin );
+
+				if( consume ) {
+					consume( instance, renderer );
+				}
+			} catch( Error *e ) {
+				instance.error = e->getMsg();
+				delete e;
+			}
+			// The renderer doesn't let go of the turtle's geometry itself.
+			renderer.release();
+		} );
+	}
+	// The buffers may each hold a last generation, too much to keep
+	// between runs, whether or not a consumer threw.
+	try {
+		myPool.wait( group );
+	} catch( ... ) {
+		std::vector<Buffers>().swap( myBuffers );
+		throw;
+	}
+	std::vector<Buffers>().swap( myBuffers );
+
+	mySeconds = since( start );
+	return myInstances;
+}
+
+
+//------------------------------------------------------------------------------
+unsigned int ForestBatch::failures() const {
+	unsigned int failed = 0;
+	for( std::vector<ForestInstance>::size_type n = 0; n < myInstances.size(); ++n ) {
+		failed += !myInstances[n].error.empty();
+	}
+	return failed;
+}
+
+
+//------------------------------------------------------------------------------
+void ForestBatch::report( std::ostream &out ) const {
+	std::ios::fmtflags flags = out.flags();
+	std::streamsize precision = out.precision();
+	unsigned long long modules = 0;
+	double busy = 0.0;
+
+	GenerationSize all = myGrammar->predict().back();
+	GenerationSize kept = myGrammar->predict( myKept ).back();
+	out << std::fixed << std::setprecision( 0 ) << "last generation, predicted: "
+		<< all.modules << " modules in " << all.bytes << " bytes, "
+		<< kept.modules << " interpreted in " << kept.bytes << " bytes, saving "
+		<< all.bytes - kept.bytes << " bytes (" << std::setprecision( 1 )
+		<< ( all.bytes > 0.0 ? 100.0 * ( all.bytes - kept.bytes ) / all.bytes : 0.0 )
+		<< "%)" << std::endl;
+	for( std::vector<ForestInstance>::size_type n = 0; n < myInstances.size(); ++n ) {
+		const ForestInstance &i = myInstances[n];
+		if( !i.error.empty() ) {
+			out << "seed " << i.seed << ": failed: " << i.error << std::endl;
+			continue;
+		}
+		double seconds = i.deriveSeconds + i.interpretSeconds;
+		out << "seed " << i.seed << ": " << i.modules << " modules, "
+			<< i.branches << " branches, " << i.leaves << " leaves, derived in "
+			<< std::fixed << std::setprecision( 4 ) << i.deriveSeconds
+			<< "s, interpreted in " << i.interpretSeconds << "s, "
+			<< std::setprecision( 0 ) << ( seconds > 0.0 ? i.modules / seconds : 0.0 )
+			<< " modules/s" << std::endl;
+		modules += i.modules;
+		busy += seconds;
+	}
+	out << std::setprecision( 4 ) << myInstances.size() << " instances, "
+		<< modules << " modules on " << threadCount() << " threads in "
+		<< mySeconds << "s: " << std::setprecision( 1 )
+		<< ( mySeconds > 0.0 ? myInstances.size() / mySeconds : 0.0 )
+		<< " instances/s, " << std::setprecision( 0 )
+		<< ( mySeconds > 0.0 ? modules / mySeconds : 0.0 ) << " modules/s, "
+		<< std::setprecision( 2 ) << ( mySeconds > 0.0 ? busy / mySeconds : 0.0 )
+		<< " threads busy on average" << std::endl;
+	if( failures() ) {
+		out << failures() << " of " << myInstances.size() << " instances failed"
+			<< std::endl;
+	}
+	out.flags( flags );
+	out.precision( precision );
+}
+
+} // End of LSystem namespace
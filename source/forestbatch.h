@@ -0,0 +1,191 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#ifndef FORESTBATCH_H
+#define FORESTBATCH_H
+
+#include "compiledgrammar.h"
+#include "renderer.h"
+#include "workpool.h"
+
+#include <bitset>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace LSystem {
+
+///-----------------------------------------------------------------------------
+/// What deriving and interpreting one instance of a batch came to.
+///-----------------------------------------------------------------------------
+struct ForestInstance {
+	unsigned long long seed;
+	ModuleString::size_type modules;
+	size_t branches;
+	size_t leaves;
+	double deriveSeconds;
+	double interpretSeconds;
+	// Why the instance couldn't be made, empty if it was.
+	std::string error;
+};
+
+
+///-----------------------------------------------------------------------------
+/// Derives and interprets many instances of one parsed LSystem, each with
+/// its own seed, in parallel.
+///
+/// The grammar is parsed once and shared read only by every thread, each
+/// instance derives with CompiledGrammar::derive( seed, ... ) into buffers
+/// its thread reuses until run() returns and lets them go, and is
+/// interpreted by its own LRenderer.  Modules
+/// the renderer ignores are left out of the last generation.  The
+/// instances are tasks on a WorkPool, so threads that finish small trees
+/// steal the remaining ones from threads still busy with big ones.  An
+/// instance that throws an Error, dividing by zero say, is recorded as
+/// failed with its message and the rest carry on.
+///
+/// LSystem::ForestBatch batch( parser.getGrammar(), 0 );
+/// batch.run( 1, 500 );
+/// batch.report( std::cout );
+///
+/// @author Lakin Wecker aka nikal@nucleus.com
+///
+/// @see LSystem::CompiledGrammar
+/// @see LSystem::WorkPool
+///-----------------------------------------------------------------------------
+class ForestBatch {
+
+//==============================================================================
+// Typedefs
+//==============================================================================
+public:
+	///---------------------------------------------------------------------
+	/// Called on the thread that made each instance, with the instance
+	/// and the renderer holding it, before the renderer is thrown away.
+	///---------------------------------------------------------------------
+	typedef std::function<void( const ForestInstance &, LRenderer & )> Consumer;
+
+//==============================================================================
+// Private Variables
+//==============================================================================
+private:
+
+	CompiledGrammarPtr myGrammar;
+	// The modules the renderer acts on, the only ones derived into the
+	// last generation.
+	std::bitset<256> myKept;
+	WorkPool myPool;
+
+	///---------------------------------------------------------------------
+	/// What a thread derives each instance into.
+	///---------------------------------------------------------------------
+	struct Buffers {
+		ModuleString result;
+		ModuleString scratch;
+	};
+
+	// The buffers of each queue of the pool, only while run() runs.
+	std::vector<Buffers> myBuffers;
+	std::vector<ForestInstance> myInstances;
+	double mySeconds;
+
+//==============================================================================
+// Public Methods
+//==============================================================================
+public:
+
+	//----------------------------------------------------------------------
+	// Constructors
+
+	///---------------------------------------------------------------------
+	/// Creates a batch of grammar run on threads threads, 0 meaning one
+	/// per hardware core.  The batch shares grammar, so whatever parsed
+	/// it may go.
+	///---------------------------------------------------------------------
+	ForestBatch( CompiledGrammarPtr grammar, unsigned int threads );
+
+
+	//----------------------------------------------------------------------
+	// Destructor
+
+	///---------------------------------------------------------------------
+	/// Deletes a ForestBatch instance.
+	///---------------------------------------------------------------------
+	virtual ~ForestBatch()
+	{
+	}
+
+
+	//----------------------------------------------------------------------
+	// Getters
+
+	///---------------------------------------------------------------------
+	/// The instances of the last run(), in seed order.
+	///---------------------------------------------------------------------
+	const std::vector<ForestInstance> &instances() const {
+		return myInstances;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The number of instances of the last run() that failed.
+	///---------------------------------------------------------------------
+	unsigned int failures() const;
+
+
+	///---------------------------------------------------------------------
+	/// The wall clock time the last run() took, in seconds.
+	///---------------------------------------------------------------------
+	double seconds() const {
+		return mySeconds;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The number of threads instances are made on.
+	///---------------------------------------------------------------------
+	unsigned int threadCount() const {
+		return myPool.threadCount();
+	}
+
+
+	//----------------------------------------------------------------------
+	// Public API
+
+	///---------------------------------------------------------------------
+	/// Derives and interprets count instances, seeded firstSeed up to
+	/// firstSeed + count - 1, handing each that didn't fail to consume
+	/// if it is set.  Not to be called from two threads at once.
+	///---------------------------------------------------------------------
+	const std::vector<ForestInstance> &run( unsigned long long firstSeed,
+		unsigned int count, Consumer consume = Consumer() );
+
+
+	///---------------------------------------------------------------------
+	/// Writes how much memory leaving out the modules the renderer
+	/// ignores saves, the size and timings of every instance of the last
+	/// run(), then the throughput of the whole batch.
+	///---------------------------------------------------------------------
+	void report( std::ostream &out ) const;
+
+}; // End of ForestBatch
+
+} // End of LSystem namespace
+
+#endif
@@ -0,0 +1,513 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#include "grammarcache.h"
+#include "mappedfile.h"
+#include "expressionnode.h"
+#include "error.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <unistd.h>
+
+#define CACHE_ERROR(x) throw new Error( x, -1, -1, __FILE__, __LINE__ )
+
+namespace LSystem {
+
+//------------------------------------------------------------------------------
+// The header, see GrammarCache.
+static const char CACHE_MAGIC[8] = { 'L', 'S', 'Y', 'S', 'G', 'R', 'M', '1' };
+static const unsigned int CACHE_BYTE_ORDER = 0x01020304;
+static const std::string::size_type HEADER_SIZE = 48;
+
+// Tags a missing child in a saved expression tree.
+static const unsigned char NO_NODE = 0xff;
+
+
+//------------------------------------------------------------------------------
+// Appends the raw bytes of value to out.
+template <typename T>
+static void put( std::string &out, const T &value ) {
+	out.append( reinterpret_cast<const char *>( &value ), sizeof( T ) );
+}
+
+
+//------------------------------------------------------------------------------
+// Appends text to out, preceded by its length.
+static void putString( std::string &out, const std::string &text ) {
+	put<unsigned int>( out, text.size() );
+	out.append( text );
+}
+
+
+//------------------------------------------------------------------------------
+// FNV-1a over whole words, which is quick enough to check every load.
+static unsigned long long checksum( const char *data, std::string::size_type size ) {
+	unsigned long long h = 14695981039346656037ULL;
+	std::string::size_type n = 0;
+	for( ; n + sizeof( h ) <= size; n += sizeof( h ) ) {
+		unsigned long long word;
+		std::memcpy( &word, data + n, sizeof( word ) );
+		h = ( h ^ word ) * 1099511628211ULL;
+	}
+	for( ; n < size; ++n ) {
+		h = ( h ^ (unsigned char)data[n] ) * 1099511628211ULL;
+	}
+	return h;
+}
+
+
+//------------------------------------------------------------------------------
+// Reads values back out of a saved grammar, throwing if it runs short.
+class GrammarCache::Reader {
+	const char *myPosition;
+	const char *myEnd;
+public:
+	Reader( const char *begin, const char *end )
+		:
+		myPosition( begin ),
+		myEnd( end )
+	{
+	}
+
+	void bytes( void *to, std::string::size_type count ) {
+		if( (std::string::size_type)( myEnd - myPosition ) < count ) {
+			CACHE_ERROR( "Error: The cached grammar is cut short." );
+		}
+		if( count > 0 ) {
+			std::memcpy( to, myPosition, count );
+		}
+		myPosition += count;
+	}
+
+	template <typename T>
+	T get() {
+		T value;
+		bytes( &value, sizeof( T ) );
+		return value;
+	}
+
+	std::string string() {
+		std::string::size_type length = get<unsigned int>();
+		if( (std::string::size_type)( myEnd - myPosition ) < length ) {
+			CACHE_ERROR( "Error: The cached grammar is cut short." );
+		}
+		std::string text( myPosition, length );
+		myPosition += length;
+		return text;
+	}
+
+	// A count of things at least size bytes each, which has to fit.
+	template <typename T>
+	T count( std::string::size_type size ) {
+		T value = get<T>();
+		if( value > (unsigned long long)( myEnd - myPosition ) / size ) {
+			CACHE_ERROR( "Error: The cached grammar has a bad count." );
+		}
+		return value;
+	}
+
+	bool atEnd() const {
+		return myPosition == myEnd;
+	}
+};
+
+
+//------------------------------------------------------------------------------
+const unsigned int GrammarCache::GRAMMAR_CACHE_VERSION;
+
+
+//------------------------------------------------------------------------------
+GrammarCache::GrammarCache( const std::string &directory )
+	:
+	myDirectory( directory )
+{
+}
+
+
+//------------------------------------------------------------------------------
+unsigned long long GrammarCache::hash( std::string_view text ) {
+	unsigned long long h = 14695981039346656037ULL;
+	for( std::string_view::size_type i = 0; i < text.size(); ++i ) {
+		h = ( h ^ (unsigned char)text[i] ) * 1099511628211ULL;
+	}
+	return h;
+}
+
+
+//------------------------------------------------------------------------------
+std::string GrammarCache::path( std::string_view text ) const {
+	char name[32];
+	std::snprintf( name, sizeof( name ), "%016llx.lgc", hash( text ) );
+	return myDirectory + "/" + name;
+}
+
+
+//------------------------------------------------------------------------------
+CompiledGrammarPtr GrammarCache::load( std::string_view text ) const {
+	std::string file = path( text );
+	if( access( file.c_str(), R_OK ) != 0 ) {
+		return CompiledGrammarPtr();
+	}
+
+	try {
+		MappedFile mapped( file );
+		std::string_view data = mapped.getText();
+		Reader in( data.data(), data.data() + data.size() );
+
+		//--------------------------------------------------------------
+		// Anything but an exact match is a miss.
+		char magic[ sizeof( CACHE_MAGIC ) ];
+		in.bytes( magic, sizeof( magic ) );
+		if( std::memcmp( magic, CACHE_MAGIC, sizeof( magic ) ) != 0
+			|| in.get<unsigned int>() != GRAMMAR_CACHE_VERSION
+			|| in.get<unsigned int>() != CACHE_BYTE_ORDER
+			|| in.get<unsigned long long>() != hash( text )
+			|| in.get<unsigned long long>() != text.size()
+			|| in.get<unsigned long long>() != data.size() - HEADER_SIZE
+			|| in.get<unsigned long long>() != checksum( data.data() + HEADER_SIZE,
+				data.size() - HEADER_SIZE ) ) {
+			return CompiledGrammarPtr();
+		}
+
+		int iterations = in.get<int>();
+
+		ModuleString start;
+		unsigned long long modules = in.count<unsigned long long>( 5 );
+		for( unsigned long long m = 0; m < modules; ++m ) {
+			char name = in.get<char>();
+			unsigned int count = in.count<unsigned int>( sizeof( double ) );
+			in.bytes( start.push_back( name, count ), count * sizeof( double ) );
+		}
+
+		SymbolFrame globals( in.count<unsigned long long>( sizeof( double ) ) );
+		in.bytes( globals.data(), globals.size() * sizeof( double ) );
+
+		SlotTable slots;
+		unsigned long long slotCount = in.count<unsigned long long>( 8 );
+		for( unsigned long long s = 0; s < slotCount; ++s ) {
+			std::string name = in.string();
+			slots[ name ] = in.get<unsigned int>();
+		}
+
+		ModelMap models;
+		unsigned long long modelCount = in.count<unsigned long long>( 5 );
+		for( unsigned long long m = 0; m < modelCount; ++m ) {
+			char name = in.get<char>();
+			models[ name ] = in.get<int>();
+		}
+
+		//--------------------------------------------------------------
+		// The productions are read into place, as copying one copies
+		// all of its expressions.
+		ProductionSet productions;
+		unsigned long long keys = in.count<unsigned long long>( 12 );
+		for( unsigned long long k = 0; k < keys; ++k ) {
+			std::list<Production> &list = productions.myProductions[ in.string() ];
+			unsigned long long count = in.count<unsigned long long>( 1 );
+			for( unsigned long long p = 0; p < count; ++p ) {
+				list.push_back( Production( "", 0.0 ) );
+				read( in, list.back(), globals.size() );
+				// The table dispatches on the first's name and arity.
+				Production &first = list.front();
+				if( list.back().getName().empty()
+					|| list.back().getName()[0] != first.getName()[0]
+					|| list.back().getIdentVec().size() != first.getIdentVec().size() ) {
+					return CompiledGrammarPtr();
+				}
+			}
+		}
+		if( !in.atEnd() ) {
+			return CompiledGrammarPtr();
+		}
+		productions.compile();
+
+		return std::make_shared<const CompiledGrammar>( std::move( productions ),
+			globals, slots, models, start, iterations );
+
+	} catch ( Error *e ) {
+		// A damaged file is a miss, the grammar is just parsed again.
+		delete e;
+		return CompiledGrammarPtr();
+	}
+}
+
+
+//------------------------------------------------------------------------------
+void GrammarCache::store( std::string_view text,
+	const CompiledGrammar &grammar ) const
+{
+	std::string out;
+	out.append( CACHE_MAGIC, sizeof( CACHE_MAGIC ) );
+	put<unsigned int>( out, GRAMMAR_CACHE_VERSION );
+	put<unsigned int>( out, CACHE_BYTE_ORDER );
+	put<unsigned long long>( out, hash( text ) );
+	put<unsigned long long>( out, text.size() );
+	// The body length and checksum are filled in once the body is written.
+	put<unsigned long long>( out, 0 );
+	put<unsigned long long>( out, 0 );
+
+	put<int>( out, grammar.getIterations() );
+
+	const ModuleString &start = grammar.getStart();
+	put<unsigned long long>( out, start.size() );
+	for( ModuleString::size_type m = 0; m < start.size(); ++m ) {
+		put<char>( out, start.name( m ) );
+		put<unsigned int>( out, start.parameterCount( m ) );
+		out.append( reinterpret_cast<const char *>( start.parameters( m ) ),
+			start.parameterCount( m ) * sizeof( double ) );
+	}
+
+	const SymbolFrame &globals = grammar.getGlobals();
+	put<unsigned long long>( out, globals.size() );
+	out.append( reinterpret_cast<const char *>( globals.data() ),
+		globals.size() * sizeof( double ) );
+
+	const SlotTable &slots = grammar.getGlobalSlots();
+	put<unsigned long long>( out, slots.size() );
+	for( SlotTable::const_iterator s = slots.begin(); s != slots.end(); ++s ) {
+		putString( out, s->first );
+		put<unsigned int>( out, s->second );
+	}
+
+	const ModelMap &models = grammar.getModels();
+	put<unsigned long long>( out, models.size() );
+	for( ModelMap::const_iterator m = models.begin(); m != models.end(); ++m ) {
+		put<char>( out, m->first );
+		put<int>( out, m->second );
+	}
+
+	const ProductionMap &productions = grammar.getProductions().myProductions;
+	put<unsigned long long>( out, productions.size() );
+	for( ProductionMap::const_iterator k = productions.begin(); k != productions.end(); ++k ) {
+		putString( out, k->first );
+		put<unsigned long long>( out, k->second.size() );
+		std::list<Production>::const_iterator p;
+		for( p = k->second.begin(); p != k->second.end(); ++p ) {
+			write( out, *p );
+		}
+	}
+
+	unsigned long long body = out.size() - HEADER_SIZE;
+	unsigned long long sum = checksum( out.data() + HEADER_SIZE, body );
+	std::memcpy( &out[ HEADER_SIZE - 2 * sizeof( body ) ], &body, sizeof( body ) );
+	std::memcpy( &out[ HEADER_SIZE - sizeof( sum ) ], &sum, sizeof( sum ) );
+
+	//----------------------------------------------------------------------
+	// Written aside and renamed, which replaces the file in one step.
+	std::string file = path( text );
+	std::string temporary = file + ".tmp" + std::to_string( getpid() );
+	{
+		std::ofstream stream( temporary.c_str(), std::ios::binary | std::ios::trunc );
+		stream.write( out.data(), out.size() );
+		stream.close();
+		if( !stream ) {
+			std::remove( temporary.c_str() );
+			CACHE_ERROR( "Error: Couldn't write grammar cache file '" + temporary + "'." );
+		}
+	}
+	if( std::rename( temporary.c_str(), file.c_str() ) != 0 ) {
+		std::string msg = "Error: Couldn't rename grammar cache file to '"
+			+ file + "': " + std::strerror( errno );
+		std::remove( temporary.c_str() );
+		CACHE_ERROR( msg );
+	}
+}
+
+
+//------------------------------------------------------------------------------
+void GrammarCache::write( std::string &out, const ExpressionNode *node ) {
+	//----------------------------------------------------------------------
+	// Preorder, each node's token then its left and right subtrees.
+	if( !node ) {
+		put<unsigned char>( out, NO_NODE );
+		return;
+	}
+	put<unsigned char>( out, node->getToken()->getType() );
+	putString( out, node->getToken()->getAttribute() );
+	write( out, node->getLeftChild() );
+	write( out, node->getRightChild() );
+}
+
+
+//------------------------------------------------------------------------------
+void GrammarCache::write( std::string &out, const ExpressionCode &code ) {
+	put<unsigned int>( out, code.myRegisterCount );
+	put<unsigned long long>( out, code.myInstructions.size() );
+	out.append( reinterpret_cast<const char *>( code.myInstructions.data() ),
+		code.myInstructions.size() * sizeof( ExpressionCode::Instruction ) );
+	put<unsigned long long>( out, code.myConstants.size() );
+	out.append( reinterpret_cast<const char *>( code.myConstants.data() ),
+		code.myConstants.size() * sizeof( double ) );
+}
+
+
+//------------------------------------------------------------------------------
+void GrammarCache::write( std::string &out, const Production &production ) {
+	putString( out, production.myName );
+	put<double>( out, production.myProbability );
+
+	put<unsigned int>( out, production.myIdentifierVec.size() );
+	for( IdentVec::size_type i = 0; i < production.myIdentifierVec.size(); ++i ) {
+		putString( out, production.myIdentifierVec[i] );
+	}
+
+	put<unsigned int>( out, production.mySuccessorVec.size() );
+	for( SuccessorVec::size_type s = 0; s < production.mySuccessorVec.size(); ++s ) {
+		const Successor &successor = production.mySuccessorVec[s];
+		putString( out, successor.getName() );
+		const ExpressionPtrVec &ev = successor.getExpressionPtrVec();
+		put<unsigned int>( out, ev.size() );
+		for( ExpressionPtrVec::size_type e = 0; e < ev.size(); ++e ) {
+			write( out, ev[e]->myHead );
+			write( out, ev[e]->myCode );
+		}
+	}
+
+	write( out, production.myCode );
+}
+
+
+//------------------------------------------------------------------------------
+ExpressionNode *GrammarCache::readNode( Reader &in ) {
+	unsigned char type = in.get<unsigned char>();
+	if( type == NO_NODE ) {
+		return NULL;
+	}
+	if( type > Token::WHITESPACE ) {
+		CACHE_ERROR( "Error: The cached grammar has a bad token." );
+	}
+	std::string attribute = in.string();
+	ExpressionNode *left = readNode( in );
+	ExpressionNode *right = NULL;
+	try {
+		right = readNode( in );
+	} catch ( Error * ) {
+		delete left;
+		throw;
+	}
+	return new ExpressionNode( new Token( (Token::Type)type, attribute ),
+		left, right );
+}
+
+
+//------------------------------------------------------------------------------
+void GrammarCache::read( Reader &in, ExpressionCode &code, unsigned int params,
+	unsigned long long globals, unsigned int outputs )
+{
+	code.myRegisterCount = in.get<unsigned int>();
+	code.myInstructions.resize(
+		in.count<unsigned long long>( sizeof( ExpressionCode::Instruction ) ) );
+	in.bytes( code.myInstructions.data(),
+		code.myInstructions.size() * sizeof( ExpressionCode::Instruction ) );
+	code.myConstants.resize( in.count<unsigned long long>( sizeof( double ) ) );
+	in.bytes( code.myConstants.data(),
+		code.myConstants.size() * sizeof( double ) );
+
+	//----------------------------------------------------------------------
+	// run() indexes with the operands unchecked, so they have to be in
+	// range here.  A register is one of the at most 256 dst can name.
+	unsigned long long registers = code.myRegisterCount;
+	unsigned long long constants = code.myConstants.size();
+	if( registers > 0x100 ) {
+		CACHE_ERROR( "Error: The cached grammar has bad bytecode." );
+	}
+	for( std::vector<ExpressionCode::Instruction>::size_type n = 0;
+		n < code.myInstructions.size(); ++n ) {
+		const ExpressionCode::Instruction &i = code.myInstructions[n];
+		// The limits on dst, a and b, those an opcode doesn't use being 0.
+		unsigned long long dst = registers, a = 1, b = 1;
+		switch( i.op ) {
+			case ExpressionCode::CONST: a = constants; break;
+			case ExpressionCode::PARAM: a = params; break;
+			case ExpressionCode::GLOBAL: a = globals; break;
+			case ExpressionCode::NEG: a = registers; break;
+			case ExpressionCode::ADD: case ExpressionCode::SUB:
+			case ExpressionCode::MUL: case ExpressionCode::DIV:
+				a = registers;
+				b = registers;
+				break;
+			case ExpressionCode::ADDK: case ExpressionCode::SUBK:
+			case ExpressionCode::MULK: case ExpressionCode::DIVK:
+				a = registers;
+				b = constants;
+				break;
+			case ExpressionCode::KSUB: case ExpressionCode::KDIV:
+				a = constants;
+				b = registers;
+				break;
+			case ExpressionCode::STORE:
+				dst = 1;
+				a = outputs;
+				b = registers;
+				break;
+			default:
+				CACHE_ERROR( "Error: The cached grammar has bad bytecode." );
+		}
+		if( i.dst >= dst || i.a >= a || i.b >= b ) {
+			CACHE_ERROR( "Error: The cached grammar has bad bytecode." );
+		}
+	}
+}
+
+
+//------------------------------------------------------------------------------
+void GrammarCache::read( Reader &in, Production &production,
+	unsigned long long globals )
+{
+	production.myName = in.string();
+	production.myProbability = in.get<double>();
+
+	production.myIdentifierVec.resize( in.count<unsigned int>( 4 ) );
+	for( IdentVec::size_type i = 0; i < production.myIdentifierVec.size(); ++i ) {
+		production.myIdentifierVec[i] = in.string();
+	}
+
+	//----------------------------------------------------------------------
+	// Successors are made in place, copying one copies its expressions.
+	// The combined code stores one output per expression of them all.
+	unsigned int params = production.myIdentifierVec.size();
+	unsigned int outputs = 0;
+	unsigned int successors = in.count<unsigned int>( 8 );
+	production.mySuccessorVec.reserve( successors );
+	for( unsigned int s = 0; s < successors; ++s ) {
+		std::string name = in.string();
+		ExpressionPtrVec ev;
+		try {
+			unsigned int count = in.count<unsigned int>( 1 );
+			for( unsigned int e = 0; e < count; ++e ) {
+				ev.push_back( new Expression( readNode( in ) ) );
+				read( in, ev.back()->myCode, params, globals, 0 );
+				++outputs;
+			}
+		} catch ( Error * ) {
+			for( ExpressionPtrVec::size_type e = 0; e < ev.size(); ++e ) {
+				delete ev[e];
+			}
+			throw;
+		}
+		production.mySuccessorVec.emplace_back( name, ev );
+	}
+
+	read( in, production.myCode, params, globals, outputs );
+}
+
+} // End of LSystem namespace
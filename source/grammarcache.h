@@ -0,0 +1,154 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#ifndef GRAMMARCACHE_H
+#define GRAMMARCACHE_H
+
+#include "compiledgrammar.h"
+
+#include <string>
+#include <string_view>
+
+namespace LSystem {
+
+class ExpressionNode;
+
+///-----------------------------------------------------------------------------
+/// A directory of parsed LSystems saved in binary, so a grammar seen
+/// before can be loaded without scanning, parsing or optimizing it again.
+///
+/// Each grammar is saved to its own file named after a hash of its source
+/// text.  The file has a 48 byte header: the magic "LSYSGRM1", the format
+/// version, a byte order mark, the hash and length of the source, and the
+/// length and checksum of the body.  The body holds the iterations, start modules,
+/// globals, models, and every production with its expression trees, their
+/// bytecode and the production's combined bytecode, all packed as raw
+/// host order numbers.  Loading maps the file and copies it straight into
+/// the objects, nothing is converted from text.
+///
+/// A file whose version, byte order, source hash, source length or body
+/// checksum doesn't match is a miss, as is a damaged one, and the grammar
+/// is parsed again.  Every index the bytecode holds is checked against the
+/// registers, constants, parameters, globals and outputs it refers to, so
+/// a file that passes the checksum but wasn't written by store() is a miss
+/// too, rather than code reading out of bounds when run.
+/// Bump GRAMMAR_CACHE_VERSION whenever what parsing produces changes, such
+/// as the optimizer, so old files stop matching.
+///
+/// LSystem::GrammarCache cache( "/var/cache/tree" );
+/// LSystem::CompiledGrammarPtr grammar = cache.load( text );
+/// if( !grammar ) { ...parse...; cache.store( text, *grammar ); }
+///
+/// Parser::setGrammarCache() does this for parseLSystem().
+///
+/// @author Lakin Wecker aka nikal@nucleus.com
+///
+/// @see LSystem::CompiledGrammar
+/// @see LSystem::Parser
+///-----------------------------------------------------------------------------
+class GrammarCache {
+
+//==============================================================================
+// Private Variables
+//==============================================================================
+private:
+
+	std::string myDirectory;
+
+//==============================================================================
+// Public Methods
+//==============================================================================
+public:
+
+	///---------------------------------------------------------------------
+	/// The version of the file format, and of what it holds.
+	///---------------------------------------------------------------------
+	static const unsigned int GRAMMAR_CACHE_VERSION = 1;
+
+
+	//----------------------------------------------------------------------
+	// Constructors
+
+	///---------------------------------------------------------------------
+	/// Creates a cache keeping its files in directory, which must exist.
+	///---------------------------------------------------------------------
+	GrammarCache( const std::string &directory );
+
+
+	//----------------------------------------------------------------------
+	// Destructor
+
+	///---------------------------------------------------------------------
+	/// Deletes a GrammarCache instance.
+	///---------------------------------------------------------------------
+	virtual ~GrammarCache()
+	{
+	}
+
+
+	//----------------------------------------------------------------------
+	// Public API
+
+	///---------------------------------------------------------------------
+	/// The 64 bit FNV-1a hash of text, which keys its file.
+	///---------------------------------------------------------------------
+	static unsigned long long hash( std::string_view text );
+
+
+	///---------------------------------------------------------------------
+	/// The file the grammar parsed from text is saved in.
+	///---------------------------------------------------------------------
+	std::string path( std::string_view text ) const;
+
+
+	///---------------------------------------------------------------------
+	/// Loads the grammar parsed from text.
+	///
+	/// @return the grammar, or an empty pointer if it isn't cached.
+	///---------------------------------------------------------------------
+	CompiledGrammarPtr load( std::string_view text ) const;
+
+
+	///---------------------------------------------------------------------
+	/// Saves grammar, parsed from text.  The file is written under another
+	/// name and renamed into place, so a reader never sees half of one.
+	/// Throws a pointer to an Error if it can't be written.
+	///---------------------------------------------------------------------
+	void store( std::string_view text, const CompiledGrammar &grammar ) const;
+
+//==============================================================================
+// Private Methods
+//==============================================================================
+private:
+
+	class Reader;
+
+	static void write( std::string &out, const ExpressionNode *node );
+	static void write( std::string &out, const ExpressionCode &code );
+	static void write( std::string &out, const Production &production );
+	static ExpressionNode *readNode( Reader &in );
+	static void read( Reader &in, ExpressionCode &code, unsigned int params,
+		unsigned long long globals, unsigned int outputs );
+	static void read( Reader &in, Production &production,
+		unsigned long long globals );
+
+}; // End of GrammarCache
+
+} // End of LSystem namespace
+
+#endif
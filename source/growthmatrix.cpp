@@ -0,0 +1,118 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#include "growthmatrix.h"
+
+#include <map>
+
+namespace LSystem {
+
+//------------------------------------------------------------------------------
+GrowthMatrix::GrowthMatrix( const ProductionSet &productions,
+	const ModuleString &start )
+	:
+	myGraph( productions, start ),
+	myRows( myGraph.symbolCount() ),
+	myStart( myGraph.symbolCount(), 0.0 ),
+	myExact( true )
+{
+	const std::vector<unsigned int> &roots = myGraph.start();
+	for( std::vector<unsigned int>::size_type i = 0; i < roots.size(); ++i ) {
+		myStart[ roots[i] ] += 1.0;
+	}
+
+	//----------------------------------------------------------------------
+	// Fill in a row for every symbol, every production weighted by the
+	// chance of it being picked.
+	for( std::vector<SymbolGraph::Symbol>::size_type s = 0;
+		s < myGraph.symbolCount(); ++s ) {
+		const std::vector<Production *> &candidates = myGraph.productions( s );
+		unsigned int count = candidates.size();
+
+		std::map<unsigned int, double> row;
+		if( count == 0 ) {
+			row[s] = 1.0;
+		}
+		if( count > 1 ) {
+			myExact = false;
+		}
+		for( unsigned int n = 0; n < count; ++n ) {
+			double weight = count == 1 ? 1.0 : candidates[n]->getProbability();
+			const std::vector<unsigned int> &children = myGraph.children( s, n );
+			for( std::vector<unsigned int>::size_type c = 0; c < children.size(); ++c ) {
+				row[ children[c] ] += weight;
+			}
+		}
+		myRows[s].assign( row.begin(), row.end() );
+	}
+}
+
+
+//------------------------------------------------------------------------------
+std::vector<GenerationSize> GrowthMatrix::predict( int iterations ) const {
+	return predict( iterations, std::bitset<256>().set() );
+}
+
+
+//------------------------------------------------------------------------------
+std::vector<GenerationSize> GrowthMatrix::predict( int iterations,
+	const std::bitset<256> &kept ) const
+{
+	std::vector<GenerationSize> sizes;
+	std::vector<double> counts( myStart );
+	std::vector<double> next( counts.size() );
+	double previous = 0.0;
+
+	for( int g = 0; g <= iterations; ++g ) {
+		GenerationSize size = { 0.0, 0.0, 0.0, 0.0 };
+		for( std::vector<double>::size_type s = 0; s < counts.size(); ++s ) {
+			// With no iterations nothing is rewritten, so nothing is filtered.
+			if( g == iterations && g > 0 && !kept[ (unsigned char)myGraph.symbol( s ).first ] ) {
+				continue;
+			}
+			size.modules += counts[s];
+			size.parameters += counts[s] * myGraph.symbol( s ).second;
+		}
+		// The same as ModuleString::memoryNeeded().
+		size.bytes = size.modules * sizeof( char )
+			+ ( size.modules + 1 ) * sizeof( ModuleString::size_type )
+			+ size.parameters * sizeof( double );
+		size.peakBytes = previous + size.bytes;
+		previous = size.bytes;
+		sizes.push_back( size );
+
+		if( g == iterations ) {
+			break;
+		}
+		std::fill( next.begin(), next.end(), 0.0 );
+		for( std::vector<double>::size_type s = 0; s < counts.size(); ++s ) {
+			if( counts[s] == 0.0 ) {
+				continue;
+			}
+			const std::vector< std::pair<unsigned int, double> > &row = myRows[s];
+			for( std::vector< std::pair<unsigned int, double> >::size_type r = 0;
+				r < row.size(); ++r ) {
+				next[ row[r].first ] += counts[s] * row[r].second;
+			}
+		}
+		counts.swap( next );
+	}
+	return sizes;
+}
+
+} // End of LSystem namespace
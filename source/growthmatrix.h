@@ -0,0 +1,146 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#ifndef GROWTHMATRIX_H
+#define GROWTHMATRIX_H
+
+#include "productionset.h"
+#include "symbolgraph.h"
+
+#include <bitset>
+#include <utility>
+#include <vector>
+
+namespace LSystem {
+
+///-----------------------------------------------------------------------------
+/// The predicted size of one generation.  Counts are doubles as deep
+/// systems easily outgrow any integer.
+///-----------------------------------------------------------------------------
+struct GenerationSize {
+	double modules;
+	double parameters;
+	// The bytes a ModuleString holding the generation needs.
+	double bytes;
+	// The bytes evaluateSystem() holds while writing the generation, it
+	// and the one it is rewritten from.
+	double peakBytes;
+};
+
+
+///-----------------------------------------------------------------------------
+/// Predicts how an LSystem grows without deriving it.
+///
+/// Every (module name, arity) pair reachable from the start modules is a
+/// symbol of a SymbolGraph, and row s of the matrix is how many of each symbol one s is
+/// rewritten into, every production weighted by its probability.  The
+/// symbol counts of a generation times the matrix are those of the next,
+/// so the size of every generation comes out of a few small vector matrix
+/// products.
+///
+/// For a system without stochastic productions the prediction is exact,
+/// otherwise it is the expected size.
+///
+/// @author Lakin Wecker aka nikal@nucleus.com
+///
+/// @see LSystem::Parser::predictSystem
+/// @see LSystem::SymbolGraph
+///-----------------------------------------------------------------------------
+class GrowthMatrix {
+
+//==============================================================================
+// Private Variables
+//==============================================================================
+private:
+
+	SymbolGraph myGraph;
+	// myRows[s] lists ( symbol, expected count ) of what s becomes.
+	std::vector< std::vector< std::pair<unsigned int, double> > > myRows;
+	std::vector<double> myStart;
+	bool myExact;
+
+//==============================================================================
+// Public Methods
+//==============================================================================
+public:
+
+	//----------------------------------------------------------------------
+	// Constructors
+
+	///---------------------------------------------------------------------
+	/// Builds the matrix for start rewritten by productions, which has to
+	/// have been compiled.
+	///---------------------------------------------------------------------
+	GrowthMatrix( const ProductionSet &productions, const ModuleString &start );
+
+
+	//----------------------------------------------------------------------
+	// Destructor
+
+	///---------------------------------------------------------------------
+	/// Deletes a GrowthMatrix instance.
+	///---------------------------------------------------------------------
+	virtual ~GrowthMatrix()
+	{
+	}
+
+
+	//----------------------------------------------------------------------
+	// Getters
+
+	///---------------------------------------------------------------------
+	/// True if the predictions are exact, which they are unless a
+	/// reachable module has more than one production to pick from.
+	///---------------------------------------------------------------------
+	bool exact() const {
+		return myExact;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The number of distinct (name, arity) symbols reachable.
+	///---------------------------------------------------------------------
+	std::vector<SymbolGraph::Symbol>::size_type symbolCount() const {
+		return myGraph.symbolCount();
+	}
+
+
+	//----------------------------------------------------------------------
+	// Public API
+
+	///---------------------------------------------------------------------
+	/// Predicts the size of generations 0, the start modules, up to and
+	/// including iterations.
+	///---------------------------------------------------------------------
+	std::vector<GenerationSize> predict( int iterations ) const;
+
+
+	///---------------------------------------------------------------------
+	/// Like predict() above, but counts only the modules whose names are
+	/// in kept in the last generation, as written when the rest are
+	/// filtered out of it.  With no iterations the start modules are all
+	/// counted, as they are never rewritten and so never filtered.
+	///---------------------------------------------------------------------
+	std::vector<GenerationSize> predict( int iterations,
+		const std::bitset<256> &kept ) const;
+
+}; // End of GrowthMatrix
+
+} // End of LSystem namespace
+
+#endif
@@ -0,0 +1,472 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#include "livesystem.h"
+#include "scanner.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+namespace LSystem {
+
+//------------------------------------------------------------------------------
+LiveSystem::LiveSystem()
+	:
+	myParsed(),
+	myRules(),
+	myGlobals(),
+	myGlobalSlots(),
+	myGrammar(),
+	myGenerations(),
+	myNames(),
+	myComplete( false ),
+	myThreadCount( 1 ),
+	myCancel( NULL ),
+	myProgress(),
+	myStatements( 0 ),
+	myReparsed( 0 ),
+	myReusedGenerations( 0 ),
+	myUnchanged( false ),
+	myParametersOnly( false )
+{
+}
+
+
+//------------------------------------------------------------------------------
+void LiveSystem::clear() {
+	myParsed.clear();
+	myRules.clear();
+	myGlobals.clear();
+	myGlobalSlots.clear();
+	myGrammar.reset();
+	myGenerations.clear();
+	myNames.clear();
+	myProvenance.clear();
+	myComplete = false;
+}
+
+
+//------------------------------------------------------------------------------
+const ModuleString &LiveSystem::update( std::string_view text ) {
+	myReparsed = 0;
+	myReusedGenerations = 0;
+	myUnchanged = false;
+	myParametersOnly = false;
+
+	std::vector<Statement> start;
+	std::vector<Statement> productions;
+	if( !split( text, start, productions ) || productions.empty() ) {
+		parseAll( text );
+		return myGenerations.back();
+	}
+	myStatements = start.size() + productions.size();
+
+	//----------------------------------------------------------------------
+	// The start state runs up to the start modules, so it is the front of
+	// the text and errors in it are on the right line.
+	Parser header( std::string_view( text.data(),
+		start.back().text.data() + start.back().text.size() - text.data() ) );
+	header.parseStart();
+
+	//----------------------------------------------------------------------
+	// A global changed if its value or its slot did.
+	std::set<std::string> changedGlobals;
+	const SlotTable &slots = header.getGlobalSlots();
+	const SymbolFrame &globals = header.getGlobals();
+	for( SlotTable::const_iterator s = slots.begin(); s != slots.end(); ++s ) {
+		SlotTable::const_iterator old = myGlobalSlots.find( s->first );
+		if( old == myGlobalSlots.end() || old->second != s->second
+			|| std::memcmp( &myGlobals[ old->second ], &globals[ s->second ],
+				sizeof( double ) ) != 0 ) {
+			changedGlobals.insert( s->first );
+		}
+	}
+	for( SlotTable::const_iterator s = myGlobalSlots.begin(); s != myGlobalSlots.end(); ++s ) {
+		if( slots.find( s->first ) == slots.end() ) {
+			changedGlobals.insert( s->first );
+		}
+	}
+
+	//----------------------------------------------------------------------
+	// Parse the productions that are new, or use a global that changed.
+	std::map<std::string, Parsed> parsed;
+	std::map<char, std::vector<std::string> > rules;
+	std::bitset<256> changed;
+	try {
+		for( std::vector<Statement>::size_type p = 0; p < productions.size(); ++p ) {
+			const Statement &statement = productions[p];
+			std::map<std::string, Parsed>::iterator done = parsed.find( statement.key );
+			if( done == parsed.end() ) {
+				std::map<std::string, Parsed>::iterator old = myParsed.find( statement.key );
+				bool stale = old == myParsed.end();
+				std::set<std::string>::const_iterator i;
+				for( i = statement.identifiers.begin(); !stale && i != statement.identifiers.end(); ++i ) {
+					stale = changedGlobals.count( *i ) > 0;
+				}
+				if( stale ) {
+					Parser one( statement.text );
+					one.parseProductions( globals, slots );
+					const ProductionMap &map = one.getProductionSet().getProductions();
+					Parsed &entry = parsed[ statement.key ];
+					entry.production = map.begin()->second;
+					entry.name = entry.production.front().getName()[0];
+					entry.identifiers = statement.identifiers;
+					changed.set( (unsigned char)entry.name );
+					++myReparsed;
+				} else {
+					Parsed &entry = parsed[ statement.key ];
+					entry.production.swap( old->second.production );
+					entry.name = old->second.name;
+					entry.identifiers.swap( old->second.identifiers );
+					myParsed.erase( old );
+				}
+				done = parsed.find( statement.key );
+			}
+			rules[ done->second.name ].push_back( statement.key );
+		}
+	} catch ( Error *e ) {
+		// Alone, the statement's lines are off, so let the whole text say.
+		delete e;
+		parseAll( text );
+		return myGenerations.back();
+	}
+
+	//----------------------------------------------------------------------
+	// A name whose productions were added, removed or moved changed too.
+	std::map<char, std::vector<std::string> >::const_iterator r;
+	for( r = rules.begin(); r != rules.end(); ++r ) {
+		std::map<char, std::vector<std::string> >::const_iterator old = myRules.find( r->first );
+		if( old == myRules.end() || old->second != r->second ) {
+			changed.set( (unsigned char)r->first );
+		}
+	}
+	for( r = myRules.begin(); r != myRules.end(); ++r ) {
+		if( rules.find( r->first ) == rules.end() ) {
+			changed.set( (unsigned char)r->first );
+		}
+	}
+
+	//----------------------------------------------------------------------
+	// Put the productions together in the order the text has them.
+	ProductionSet set;
+	for( std::vector<Statement>::size_type p = 0; p < productions.size(); ++p ) {
+		set.push_back( parsed[ productions[p].key ].production.front() );
+	}
+	set.normalize();
+	set.compile();
+
+	bool startChanged = myGenerations.empty()
+		|| !same( header.getStartList(), myGenerations.front(), true );
+
+	//----------------------------------------------------------------------
+	// Which production rewrites which module never depends on parameters,
+	// so if only numbers changed the modules stay where they are.
+	bool parametersOnly = myComplete && ( startChanged || changed.any() )
+		&& sameShape( rules, myRules ) && slots == myGlobalSlots
+		&& header.getIterations() == myGrammar->getIterations()
+		&& same( header.getStartList(), myGenerations.front(), false );
+
+	myParsed.swap( parsed );
+	myRules.swap( rules );
+	myGlobals = globals;
+	myGlobalSlots = slots;
+	myGrammar = std::make_shared<const CompiledGrammar>( std::move( set ),
+		globals, slots, header.getModels(), header.getStartList(),
+		header.getIterations() );
+
+	if( parametersOnly ) {
+		reevaluate( startChanged ? 0 : reusable( changed ) );
+	} else {
+		derive( changed, startChanged );
+	}
+	return myGenerations.back();
+}
+
+
+//------------------------------------------------------------------------------
+bool LiveSystem::split( std::string_view text, std::vector<Statement> &start,
+	std::vector<Statement> &productions )
+{
+	Scanner scanner( text );
+	// The start state ends with the start modules, after the iterations.
+	bool header = true;
+	bool iterations = false;
+	bool isIterations = false;
+	Statement statement;
+	const char *begin = NULL;
+	for( ;; ) {
+		Lexeme tok;
+		try {
+			tok = scanner.lex();
+		} catch ( Error *e ) {
+			// The Parser may come across another error first.
+			delete e;
+			return false;
+		}
+		if( tok.getType() == Token::END_OF_FILE ) {
+			return begin == NULL && !header;
+		}
+		std::string_view attribute = tok.getAttribute();
+		if( begin == NULL ) {
+			begin = attribute.data();
+			isIterations = tok.getType() == Token::IDENTIFIER
+				&& attribute == "iterations";
+		}
+		statement.key += (char)tok.getType();
+		statement.key.append( attribute.data(), attribute.size() );
+		statement.key += '\0';
+		if( tok.getType() == Token::IDENTIFIER ) {
+			statement.identifiers.insert( std::string( attribute ) );
+		}
+		if( !tok.isPunctuation( ";" ) ) {
+			continue;
+		}
+
+		statement.text = std::string_view( begin,
+			attribute.data() + attribute.size() - begin );
+		if( !header ) {
+			productions.push_back( statement );
+		} else {
+			start.push_back( statement );
+			header = !iterations;
+			iterations = iterations || isIterations;
+		}
+		statement = Statement();
+		begin = NULL;
+	}
+}
+
+
+//------------------------------------------------------------------------------
+void LiveSystem::parseAll( std::string_view text ) {
+	clear();
+	Parser p( text );
+	p.parseLSystem();
+
+	std::vector<Statement> start;
+	std::vector<Statement> productions;
+	myStatements = split( text, start, productions )
+		? start.size() + productions.size() : 0;
+	myReparsed = productions.size();
+	myGrammar = p.getGrammar();
+	std::bitset<256> changed;
+	derive( changed.set(), true );
+}
+
+
+//------------------------------------------------------------------------------
+void LiveSystem::derive( const std::bitset<256> &changed, bool startChanged ) {
+	int iterations = myGrammar->getIterations();
+	bool complete = myComplete;
+	int last = myGenerations.size() - 1;
+	myComplete = false;
+
+	int keep = startChanged ? 0 : reusable( changed );
+	if( keep > iterations ) {
+		keep = iterations;
+	}
+	myUnchanged = complete && !startChanged && keep == iterations && last == iterations;
+	myReusedGenerations = keep;
+	if( startChanged ) {
+		myGenerations.clear();
+		myNames.clear();
+	} else {
+		myGenerations.resize( keep + 1 );
+		myNames.resize( keep + 1 );
+	}
+	// The productions were added, removed or moved, so even the slots of
+	// the generations kept may be another production's now.
+	myProvenance.clear();
+
+	Parser p( "" );
+	p.setGrammar( myGrammar );
+	p.setThreadCount( myThreadCount );
+	p.setCancel( myCancel );
+	p.setProgress( myProgress );
+	try {
+		p.evaluateSystem( myGenerations );
+	} catch ( Error * ) {
+		// What was finished is good for next time.
+		noteNames();
+		throw;
+	}
+	noteNames();
+	myComplete = true;
+}
+
+
+//------------------------------------------------------------------------------
+int LiveSystem::reusable( const std::bitset<256> &changed ) const {
+	//----------------------------------------------------------------------
+	// Every generation up to and including the first that has a module
+	// whose productions changed.
+	int last = myGenerations.size() - 1;
+	for( int k = 0; k < last; ++k ) {
+		if( ( myNames[k] & changed ).any() ) {
+			return k;
+		}
+	}
+	return last;
+}
+
+
+//------------------------------------------------------------------------------
+void LiveSystem::reevaluate( int first ) {
+	const ProductionSet &productions = myGrammar->getProductions();
+	const SymbolFrame &globals = myGrammar->getGlobals();
+	int iterations = myGrammar->getIterations();
+	myComplete = false;
+	myParametersOnly = true;
+	myReusedGenerations = first;
+
+	//----------------------------------------------------------------------
+	// Note which production rewrote each module, the first time only.
+	for( int k = myProvenance.size(); k < iterations; ++k ) {
+		const ModuleString &in = myGenerations[k];
+		myProvenance.push_back( std::vector<unsigned int>( in.size() ) );
+		std::vector<unsigned int> &slots = myProvenance.back();
+		for( ModuleString::size_type i = 0; i < in.size(); ++i ) {
+			slots[i] = productions.matchSlot( in.name( i ), in.parameterCount( i ),
+				productions.getSeed(), k, i );
+		}
+	}
+
+	if( first == 0 ) {
+		myGenerations[0] = myGrammar->getStart();
+	}
+	for( int k = first; k < iterations; ++k ) {
+		if( myCancel && *myCancel ) {
+			// The generations after k are out of date.
+			myGenerations.resize( k + 1 );
+			myNames.resize( k + 1 );
+			std::ostringstream msg;
+			msg << "Error: Derivation stopped after " << k << " of "
+				<< iterations << " iterations: it was cancelled.";
+			throw new Error( msg.str(), -1, -1, __FILE__, __LINE__ );
+		}
+
+		//--------------------------------------------------------------
+		// Only the parameters are written, in one pass, each module's
+		// successors where they already are.
+		const ModuleString &in = myGenerations[k];
+		ModuleString &out = myGenerations[k + 1];
+		const std::vector<unsigned int> &slots = myProvenance[k];
+		ModuleString::size_type j = 0;
+		for( ModuleString::size_type i = 0; i < in.size(); ++i ) {
+			if( slots[i] == ProductionSet::NO_CANDIDATE ) {
+				const double *params = in.parameters( i );
+				std::copy( params, params + in.parameterCount( i ), out.parameters( j ) );
+				++j;
+			} else {
+				Production *prod = productions.candidate( slots[i] );
+				prod->evaluate( in.parameters( i ), globals.data(), out.parameters( j ) );
+				j += prod->getSuccessorVec().size();
+			}
+		}
+
+		if( myProgress ) {
+			myProgress( k + 1, iterations, out.size() );
+		}
+	}
+	myComplete = true;
+}
+
+
+//------------------------------------------------------------------------------
+void LiveSystem::noteNames() {
+	for( std::vector<ModuleString>::size_type k = myNames.size(); k < myGenerations.size(); ++k ) {
+		const ModuleString &generation = myGenerations[k];
+		std::bitset<256> names;
+		for( ModuleString::size_type i = 0; i < generation.size(); ++i ) {
+			names.set( (unsigned char)generation.name( i ) );
+		}
+		myNames.push_back( names );
+	}
+}
+
+
+//------------------------------------------------------------------------------
+bool LiveSystem::sameShape( const std::map<char, std::vector<std::string> > &a,
+	const std::map<char, std::vector<std::string> > &b )
+{
+	if( a.size() != b.size() ) {
+		return false;
+	}
+	std::map<char, std::vector<std::string> >::const_iterator i, j;
+	for( i = a.begin(), j = b.begin(); i != a.end(); ++i, ++j ) {
+		if( i->first != j->first || i->second.size() != j->second.size() ) {
+			return false;
+		}
+		for( std::vector<std::string>::size_type n = 0; n < i->second.size(); ++n ) {
+			if( shape( i->second[n] ) != shape( j->second[n] ) ) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+
+//------------------------------------------------------------------------------
+std::string LiveSystem::shape( const std::string &key ) {
+	//----------------------------------------------------------------------
+	// The key is each token's type, its text and a '\0'.  The numbers
+	// before the '=>' are probabilities, which do change the shape.
+	std::string result;
+	bool successors = false;
+	std::string::size_type token = 0;
+	while( token < key.size() ) {
+		std::string::size_type end = key.find( '\0', token );
+		char type = key[ token ];
+		if( successors && ( type == Token::INT || type == Token::FLOAT ) ) {
+			result += type;
+		} else {
+			result.append( key, token, end - token );
+		}
+		result += '\0';
+		if( type == Token::PUNCTUATION && key.compare( token + 1, end - token - 1, "=>" ) == 0 ) {
+			successors = true;
+		}
+		token = end + 1;
+	}
+	return result;
+}
+
+
+//------------------------------------------------------------------------------
+bool LiveSystem::same( const ModuleString &a, const ModuleString &b,
+	bool parameters )
+{
+	if( a.size() != b.size() ) {
+		return false;
+	}
+	for( ModuleString::size_type i = 0; i < a.size(); ++i ) {
+		if( a.name( i ) != b.name( i )
+			|| a.parameterCount( i ) != b.parameterCount( i ) ) {
+			return false;
+		}
+		if( parameters && std::memcmp( a.parameters( i ), b.parameters( i ),
+				a.parameterCount( i ) * sizeof( double ) ) != 0 ) {
+			return false;
+		}
+	}
+	return true;
+}
+
+} // End of LSystem namespace
@@ -0,0 +1,349 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#ifndef LIVESYSTEM_H
+#define LIVESYSTEM_H
+
+#include "parser.h"
+
+#include <atomic>
+#include <bitset>
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace LSystem {
+
+///-----------------------------------------------------------------------------
+/// An LSystem being edited, which update() parses and derives again after
+/// each edit, redoing only what the edit changed.
+///
+/// The text is split into statements at each ';'.  Statements are compared
+/// by their tokens, so changing only whitespace changes nothing.  The start
+/// state is small and is always parsed again.  A production is parsed
+/// again only if its statement is new, or if it uses a global whose value
+/// changed.  Every other production is reused as it was compiled last time.
+///
+/// Every generation of the last derivation is kept, along with which
+/// module names appear in it.  Generation k + 1 depends only on generation
+/// k and on the productions of the names in it.  Say the start modules are
+/// the same and no changed production's name appears before generation k.
+/// Then generations 0 up to k are the same as last time, and derivation
+/// picks up from generation k.  The random draws depend only on the seed,
+/// the generation and the index, so stochastic systems give the same
+/// modules as deriving from scratch.  If the last generation is the same,
+/// isUnchanged() says so, and the turtle's geometry can be kept too.
+///
+/// No production is picked by its parameters, so when only numbers
+/// change, in the globals, the start modules or the successors, every
+/// module stays where it was.  The slot of the production that rewrote
+/// each module is noted the first time that happens, and from then on the
+/// parameters are evaluated again in one pass per generation, with no
+/// matching and no allocating.  isParametersOnly() says so.
+///
+/// Keeping the generations costs memory, about half as much again as the
+/// last generation for a system that grows, and a slot per module once
+/// parameters alone change.
+///
+/// LSystem::LiveSystem live;
+/// const LSystem::ModuleString &modules = live.update( text );
+/// ...edit...
+/// if( !live.update( text2 ).empty() && !live.isUnchanged() ) { ... }
+///
+/// @author Lakin Wecker aka nikal@nucleus.com
+///
+/// @see LSystem::Parser
+///-----------------------------------------------------------------------------
+class LiveSystem {
+
+//==============================================================================
+// Private Variables
+//==============================================================================
+private:
+
+	///---------------------------------------------------------------------
+	/// One statement of the text, up to and including its ';'.
+	///---------------------------------------------------------------------
+	struct Statement {
+		// Its tokens, each its type and text, layout aside.
+		std::string key;
+		std::string_view text;
+		// The identifiers it uses, which may be globals.
+		std::set<std::string> identifiers;
+	};
+
+	///---------------------------------------------------------------------
+	/// A production statement, parsed and compiled.
+	///---------------------------------------------------------------------
+	struct Parsed {
+		std::list<Production> production;
+		char name;
+		std::set<std::string> identifiers;
+	};
+
+	// Every production statement parsed, by key.
+	std::map<std::string, Parsed> myParsed;
+	// The keys of the productions of each name, in the order they came.
+	std::map<char, std::vector<std::string> > myRules;
+	SymbolFrame myGlobals;
+	SlotTable myGlobalSlots;
+	CompiledGrammarPtr myGrammar;
+
+	// Every generation of the last derivation, and the names in each.
+	std::vector<ModuleString> myGenerations;
+	std::vector<std::bitset<256> > myNames;
+	// The slot of the production that rewrote each module of each
+	// generation, noted the first time only the parameters change.  Only
+	// good for the productions it was noted against, so any derive()
+	// forgets it.
+	std::vector<std::vector<unsigned int> > myProvenance;
+	// Whether the last update() derived every generation.
+	bool myComplete;
+
+	unsigned int myThreadCount;
+	const std::atomic<bool> *myCancel;
+	ProgressCallback myProgress;
+
+	// What the last update() did.
+	unsigned int myStatements;
+	unsigned int myReparsed;
+	int myReusedGenerations;
+	bool myUnchanged;
+	bool myParametersOnly;
+
+//==============================================================================
+// Public Methods
+//==============================================================================
+public:
+
+	//----------------------------------------------------------------------
+	// Constructors
+
+	///---------------------------------------------------------------------
+	/// Creates a LiveSystem with nothing parsed yet.
+	///---------------------------------------------------------------------
+	LiveSystem();
+
+
+	//----------------------------------------------------------------------
+	// Destructor
+
+	///---------------------------------------------------------------------
+	/// Deletes a LiveSystem instance.
+	///---------------------------------------------------------------------
+	virtual ~LiveSystem()
+	{
+	}
+
+
+	//----------------------------------------------------------------------
+	// Public API
+
+	///---------------------------------------------------------------------
+	/// Parses and derives text, reusing whatever the last update() left
+	/// that the changes since can't have affected.
+	///
+	/// Throws pointers to Error's as Parser::parseLSystem() and
+	/// Parser::evaluateSystem() do, with the same lines.  A derivation
+	/// that is cancelled keeps the generations it finished, for next time.
+	///
+	/// @return the last generation, valid until the next update().
+	///---------------------------------------------------------------------
+	const ModuleString &update( std::string_view text );
+
+
+	///---------------------------------------------------------------------
+	/// Forgets everything, so the next update() starts from scratch.
+	///---------------------------------------------------------------------
+	void clear();
+
+
+	//----------------------------------------------------------------------
+	// Getters
+
+	///---------------------------------------------------------------------
+	/// The LSystem the last update() parsed.  Empty until one parses.
+	///---------------------------------------------------------------------
+	CompiledGrammarPtr getGrammar() const {
+		return myGrammar;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The model id set for module c, 0 if there is none.
+	///---------------------------------------------------------------------
+	int getModel( char c ) const {
+		return myGrammar ? myGrammar->getModel( c ) : 0;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The number of statements in the text the last update() was given.
+	///---------------------------------------------------------------------
+	unsigned int getStatementCount() const {
+		return myStatements;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The number of production statements the last update() parsed,
+	/// rather than reused.
+	///---------------------------------------------------------------------
+	unsigned int getReparsedCount() const {
+		return myReparsed;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The number of generations the last update() reused, not counting
+	/// the start modules.
+	///---------------------------------------------------------------------
+	int getReusedGenerations() const {
+		return myReusedGenerations;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Whether the last generation update() returned is the same as the
+	/// one the update() before returned.
+	///---------------------------------------------------------------------
+	bool isUnchanged() const {
+		return myUnchanged;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Whether the last update() only evaluated parameters again, every
+	/// module staying where it was.
+	///---------------------------------------------------------------------
+	bool isParametersOnly() const {
+		return myParametersOnly;
+	}
+
+
+	//----------------------------------------------------------------------
+	// Setters
+
+	///---------------------------------------------------------------------
+	/// @see Parser::setThreadCount
+	///---------------------------------------------------------------------
+	void setThreadCount( unsigned int threads ) {
+		myThreadCount = threads;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// @see Parser::setCancel
+	///---------------------------------------------------------------------
+	void setCancel( const std::atomic<bool> *cancel ) {
+		myCancel = cancel;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// @see Parser::setProgress
+	///---------------------------------------------------------------------
+	void setProgress( ProgressCallback progress ) {
+		myProgress = progress;
+	}
+
+//==============================================================================
+// Private Methods
+//==============================================================================
+private:
+
+	///---------------------------------------------------------------------
+	/// Splits text into statements.
+	///
+	/// @return false if text doesn't end with a ';', or has no start
+	///  state, leaving the Parser to say what is wrong.
+	///---------------------------------------------------------------------
+	static bool split( std::string_view text, std::vector<Statement> &start,
+		std::vector<Statement> &productions );
+
+
+	///---------------------------------------------------------------------
+	/// Parses all of text as Parser::parseLSystem() does, forgetting what
+	/// was there before.  Used when the statements don't make sense alone,
+	/// so the error comes from the whole text and has the right line.
+	///---------------------------------------------------------------------
+	void parseAll( std::string_view text );
+
+
+	///---------------------------------------------------------------------
+	/// Derives from the last generation kept that the changes to the
+	/// productions of changed, and to the start modules, leave alone.
+	///---------------------------------------------------------------------
+	void derive( const std::bitset<256> &changed, bool startChanged );
+
+
+	///---------------------------------------------------------------------
+	/// The last generation kept that the changes to the productions of
+	/// changed leave alone.
+	///---------------------------------------------------------------------
+	int reusable( const std::bitset<256> &changed ) const;
+
+
+	///---------------------------------------------------------------------
+	/// Evaluates the parameters of every generation after first again,
+	/// leaving every module where it is.  Only for when no statement
+	/// changed but for numbers, so the same production rewrites the same
+	/// module as before.
+	///---------------------------------------------------------------------
+	void reevaluate( int first );
+
+
+	///---------------------------------------------------------------------
+	/// Notes the names in each generation kept that aren't noted yet.
+	///---------------------------------------------------------------------
+	void noteNames();
+
+
+	///---------------------------------------------------------------------
+	/// Whether the productions keyed by a and by b differ only in the
+	/// numbers in their successors.
+	///---------------------------------------------------------------------
+	static bool sameShape( const std::map<char, std::vector<std::string> > &a,
+		const std::map<char, std::vector<std::string> > &b );
+
+
+	///---------------------------------------------------------------------
+	/// The statement key with the numbers in its successors left out.
+	///---------------------------------------------------------------------
+	static std::string shape( const std::string &key );
+
+
+	///---------------------------------------------------------------------
+	/// Whether a and b hold the same modules, and if parameters is set
+	/// the same parameters too.
+	///---------------------------------------------------------------------
+	static bool same( const ModuleString &a, const ModuleString &b,
+		bool parameters );
+
+	// Not copyable, the generations can be large.
+	LiveSystem( const LiveSystem & );
+	LiveSystem &operator=( const LiveSystem & );
+
+}; // End of LiveSystem
+
+} // End of LSystem namespace
+
+#endif
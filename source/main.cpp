@@ -29,12 +29,80 @@
 //-----------------------------------------------------------------------------
 // gtkmm includes.
 #include <gtkmm/main.h>
+#include <glibmm/thread.h>
 #include <gtkglmm.h>
 
 
 //-----------------------------------------------------------------------------
 // std c++ includes.
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <string>
+
+
+//-----------------------------------------------------------------------------
+// LSystem includes.
+#include "forestbatch.h"
+#include "mappedfile.h"
+#include "parser.h"
+
+
+///-----------------------------------------------------------------------------
+/// tree --batch <file> <count> [<first seed> [<threads> [<cache>]]]
+///
+/// Derives and interprets count instances of the LSystem in file, seeded
+/// one after the other from first seed, on threads threads without opening
+/// a window, and reports how long they took.  Given a cache directory the
+/// parsed LSystem is saved there, and loaded from there next time.  Exits
+/// with 1 if any instance failed.
+///-----------------------------------------------------------------------------
+static int runBatch( int argc, char *argv[] )
+{
+	if( argc < 4 ) {
+		std::cerr << "Usage: " << argv[0]
+			<< " --batch <file> <count> [<first seed> [<threads> [<cache>]]]"
+			<< std::endl;
+		return 1;
+	}
+	unsigned int count = std::strtoul( argv[3], NULL, 10 );
+	unsigned long long seed = argc > 4 ? std::strtoull( argv[4], NULL, 10 ) : 0;
+	unsigned int threads = argc > 5 ? std::strtoul( argv[5], NULL, 10 ) : 0;
+
+	// The grammar is scanned straight out of the mapping.
+	std::unique_ptr<LSystem::MappedFile> file;
+	try {
+		file.reset( new LSystem::MappedFile( argv[2] ) );
+	} catch ( LSystem::Error *e ) {
+		std::cerr << e->getMsg() << std::endl;
+		delete e;
+		return 1;
+	}
+
+	LSystem::Parser p( file->getText() );
+	if( argc > 6 ) {
+		p.setGrammarCache( argv[6] );
+	}
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	try {
+		p.parseLSystem();
+	} catch ( LSystem::Error *e ) {
+		std::cerr << argv[2] << ":" << e->getLine() << ": error: "
+			<< e->getMsg() << std::endl;
+		delete e;
+		return 1;
+	}
+	std::cout << ( p.getCached() ? "loaded from cache in " : "parsed in " )
+		<< std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - start ).count()
+		<< "s" << std::endl;
+
+	LSystem::ForestBatch batch( p.getGrammar(), threads );
+	batch.run( seed, count );
+	batch.report( std::cout );
+	return batch.failures() ? 1 : 0;
+}
 
 
 
@@ -46,6 +114,19 @@
 ///-----------------------------------------------------------------------------
 int main (int argc, char *argv[])
 {
+	//----------------------------------------------------------------------
+	// Batch generation doesn't need a display.
+	if( argc > 1 && std::string( argv[1] ) == "--batch" ) {
+		return runBatch( argc, argv );
+	}
+
+	//----------------------------------------------------------------------
+	// Renders derive on a thread of their own, which glib must know about
+	// before anything else uses it.
+	if( !Glib::thread_supported() ) {
+		Glib::thread_init();
+	}
+
 	//----------------------------------------------------------------------
 	// Create and make sure that we have an instance of Gtk's Main.
 	Gtk::Main *kit = new Gtk::Main(argc, argv);
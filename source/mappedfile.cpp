@@ -0,0 +1,76 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#include "mappedfile.h"
+#include "error.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace LSystem {
+
+//------------------------------------------------------------------------------
+MappedFile::MappedFile( const std::string &path )
+	:
+	myData( NULL ),
+	mySize( 0 )
+{
+	int file = open( path.c_str(), O_RDONLY );
+	struct stat info;
+	if( file < 0 || fstat( file, &info ) != 0 ) {
+		std::string msg = "Error: Couldn't open '" + path + "': "
+			+ std::strerror( errno );
+		if( file >= 0 ) {
+			::close( file );
+		}
+		throw new Error( msg, -1, -1, __FILE__, __LINE__ );
+	}
+
+	//----------------------------------------------------------------------
+	// An empty file can't be mapped, but then there is nothing to map.
+	mySize = info.st_size;
+	if( mySize > 0 ) {
+		myData = mmap( NULL, mySize, PROT_READ, MAP_PRIVATE, file, 0 );
+		if( myData == MAP_FAILED ) {
+			std::string msg = "Error: Couldn't map '" + path + "': "
+				+ std::strerror( errno );
+			myData = NULL;
+			::close( file );
+			throw new Error( msg, -1, -1, __FILE__, __LINE__ );
+		}
+		// The scanner reads it once, front to back.
+		madvise( myData, mySize, MADV_SEQUENTIAL );
+	}
+	// The mapping stays valid without the descriptor.
+	::close( file );
+}
+
+
+//------------------------------------------------------------------------------
+MappedFile::~MappedFile() {
+	if( myData ) {
+		munmap( myData, mySize );
+	}
+}
+
+} // End of LSystem namespace
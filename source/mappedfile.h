@@ -0,0 +1,96 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <string_view>
+
+namespace LSystem {
+
+///-----------------------------------------------------------------------------
+/// A whole file mapped read only into memory, for scanning in place.
+///
+/// LSystem::MappedFile file( "tree.lang" );
+/// LSystem::Parser p( file.getText() );
+/// p.parseLSystem();
+///
+/// Throws pointers to Error's if the file can't be opened or mapped.
+///
+/// @author Lakin Wecker aka nikal@nucleus.com
+///
+/// @see LSystem::Scanner
+///-----------------------------------------------------------------------------
+class MappedFile {
+
+//==============================================================================
+// Private Variables
+//==============================================================================
+private:
+
+	void *myData;
+	std::string::size_type mySize;
+
+//==============================================================================
+// Public Methods
+//==============================================================================
+public:
+
+	//----------------------------------------------------------------------
+	// Constructors
+
+	///---------------------------------------------------------------------
+	/// Maps the file at path.
+	///---------------------------------------------------------------------
+	MappedFile( const std::string &path );
+
+
+	//----------------------------------------------------------------------
+	// Destructor
+
+	///---------------------------------------------------------------------
+	/// Unmaps the file.
+	///---------------------------------------------------------------------
+	virtual ~MappedFile();
+
+
+	//----------------------------------------------------------------------
+	// Getters
+
+	///---------------------------------------------------------------------
+	/// The contents of the file.
+	///---------------------------------------------------------------------
+	std::string_view getText() const {
+		return std::string_view( static_cast<const char *>( myData ), mySize );
+	}
+
+//==============================================================================
+// Private Methods
+//==============================================================================
+private:
+
+	// Not copyable, the mapping belongs to one instance.
+	MappedFile( const MappedFile & );
+	MappedFile &operator=( const MappedFile & );
+
+}; // End of MappedFile
+
+} // End of LSystem namespace
+
+#endif
@@ -0,0 +1,134 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#include "moduleindex.h"
+#include "error.h"
+
+#include <limits>
+#include <sstream>
+
+namespace LSystem {
+
+//------------------------------------------------------------------------------
+ModuleIndex::ModuleIndex( const ProductionSet &productions,
+	const SymbolFrame &globals, const ModuleString &start, int iterations )
+	:
+	myProductionSet( productions ),
+	myGlobals( globals ),
+	myStart( start ),
+	myIterations( iterations ),
+	myGraph( productions, start ),
+	myLengths()
+{
+	for( std::vector<SymbolGraph::Symbol>::size_type s = 0;
+		s < myGraph.symbolCount(); ++s ) {
+		unsigned int count = myGraph.productions( s ).size();
+		if( count > 1 ) {
+			std::ostringstream msg;
+			msg << "Error: Can't index a system in which '" << myGraph.symbol( s ).first
+				<< "' with " << myGraph.symbol( s ).second
+				<< " parameters is rewritten by one of "
+				<< count << " productions picked at random";
+			throw new Error( msg.str(), -1, -1, __FILE__, __LINE__ );
+		}
+	}
+	myLengths = myGraph.lengths( iterations );
+}
+
+
+//------------------------------------------------------------------------------
+ModuleIndex::length_type ModuleIndex::length( int generation ) const {
+	if( generation < 0 || generation > myIterations ) {
+		std::ostringstream msg;
+		msg << "Error: Generation " << generation << " is not between 0 and "
+			<< myIterations;
+		throw new Error( msg.str(), -1, -1, __FILE__, __LINE__ );
+	}
+	const std::vector<length_type> &lengths = myLengths[ generation ];
+	const std::vector<unsigned int> &roots = myGraph.start();
+	length_type length = 0;
+	for( std::vector<unsigned int>::size_type i = 0; i < roots.size(); ++i ) {
+		length_type add = lengths[ roots[i] ];
+		if( add >= SymbolGraph::MOST - length ) {
+			return std::numeric_limits<length_type>::max();
+		}
+		length += add;
+	}
+	return length;
+}
+
+
+//------------------------------------------------------------------------------
+void ModuleIndex::module( int generation, length_type k, Module &mod ) const {
+	ModuleString found;
+	if( range( generation, k, 1, found ) == 0 ) {
+		std::ostringstream msg;
+		msg << "Error: Generation " << generation << " has no module " << k;
+		throw new Error( msg.str(), -1, -1, __FILE__, __LINE__ );
+	}
+	found.getModule( 0, mod );
+}
+
+
+//------------------------------------------------------------------------------
+ModuleIndex::length_type ModuleIndex::range( int generation, length_type k,
+	length_type count, ModuleString &out ) const
+{
+	length( generation );	// Throws if there is no such generation.
+
+	std::vector<ModuleString> scratch( generation );
+	length_type skip = k;
+	length_type left = count;
+	for( ModuleString::size_type i = 0; i < myStart.size() && left > 0; ++i ) {
+		extract( myStart, i, myGraph.start()[i], generation, skip, left, out, scratch );
+	}
+	return count - left;
+}
+
+
+//------------------------------------------------------------------------------
+void ModuleIndex::extract( const ModuleString &level, ModuleString::size_type i,
+	unsigned int symbol, int depth, length_type &skip, length_type &count,
+	ModuleString &out, std::vector<ModuleString> &scratch ) const
+{
+	length_type length = myLengths[ depth ][ symbol ];
+	if( skip >= length ) {
+		skip -= length;
+		return;
+	}
+
+	const std::vector<Production *> &candidates = myGraph.productions( symbol );
+	if( depth == 0 || candidates.empty() ) {
+		out.append( level, i, i + 1 );
+		--count;
+		return;
+	}
+
+	//----------------------------------------------------------------------
+	// Rewrite only this module, then go on into the successors whose
+	// expansions overlap the range.
+	ModuleString &successors = scratch[ depth - 1 ];
+	successors.clear();
+	ProductionSet::apply( level, i, candidates[0], myGlobals, successors );
+	const std::vector<unsigned int> &children = myGraph.children( symbol, 0 );
+	for( ModuleString::size_type s = 0; s < successors.size() && count > 0; ++s ) {
+		extract( successors, s, children[s], depth - 1, skip, count, out, scratch );
+	}
+}
+
+} // End of LSystem namespace
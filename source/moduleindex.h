@@ -0,0 +1,166 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#ifndef MODULEINDEX_H
+#define MODULEINDEX_H
+
+#include "productionset.h"
+#include "symbolgraph.h"
+
+#include <vector>
+
+namespace LSystem {
+
+///-----------------------------------------------------------------------------
+/// Answers "what is module k of generation n?" without deriving the
+/// generation.
+///
+/// Every (module name, arity) pair reachable from the start modules is a
+/// symbol of a SymbolGraph, and for every generation the index knows how many modules one
+/// of each symbol expands into.  Finding module k is then a walk down from
+/// the start module holding it, rewriting only the one module at each
+/// generation whose expansion holds k, so it takes time proportional to
+/// the number of generations times the length of the successors rather
+/// than to the size of the generation.  A range of modules is found the
+/// same way, the walk only descending into expansions overlapping it.
+///
+/// Only systems in which no module has productions to pick from at random
+/// can be indexed, as elsewhere the lengths depend on the draws.  The
+/// index refers to the productions, globals and start modules it was
+/// built from, which must outlive it.  Its queries change nothing, so
+/// any number of threads can query one index at once, for example each
+/// extracting its own slice of a generation too big to hold whole.
+///
+/// LSystem::ModuleIndex index = parser.indexSystem();
+/// LSystem::Module m;
+/// index.module( index.getIterations(), index.length( index.getIterations() ) / 2, m );
+///
+/// @author Lakin Wecker aka nikal@nucleus.com
+///
+/// @see LSystem::Parser::indexSystem
+/// @see LSystem::SymbolGraph
+///-----------------------------------------------------------------------------
+class ModuleIndex {
+
+//==============================================================================
+// Typedefs
+//==============================================================================
+public:
+	typedef SymbolGraph::length_type length_type;
+
+//==============================================================================
+// Private Variables
+//==============================================================================
+private:
+
+	const ProductionSet &myProductionSet;
+	const SymbolFrame &myGlobals;
+	const ModuleString &myStart;
+	int myIterations;
+
+	SymbolGraph myGraph;
+	// myLengths[g][s] is how many modules one s is after g generations,
+	// or SymbolGraph::MOST if it doesn't fit.
+	std::vector< std::vector<length_type> > myLengths;
+
+//==============================================================================
+// Public Methods
+//==============================================================================
+public:
+
+	//----------------------------------------------------------------------
+	// Constructors
+
+	///---------------------------------------------------------------------
+	/// Indexes start rewritten by productions, which has to have been
+	/// compiled, for up to iterations generations.  Throws an Error if
+	/// a reachable module is rewritten by a production picked at random.
+	///---------------------------------------------------------------------
+	ModuleIndex( const ProductionSet &productions, const SymbolFrame &globals,
+		const ModuleString &start, int iterations );
+
+
+	//----------------------------------------------------------------------
+	// Destructor
+
+	///---------------------------------------------------------------------
+	/// Deletes a ModuleIndex instance.
+	///---------------------------------------------------------------------
+	virtual ~ModuleIndex()
+	{
+	}
+
+
+	//----------------------------------------------------------------------
+	// Getters
+
+	///---------------------------------------------------------------------
+	/// The last generation which can be queried.
+	///---------------------------------------------------------------------
+	int getIterations() const {
+		return myIterations;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The number of modules in generation, or the largest length_type
+	/// if there are more than it can count.
+	///---------------------------------------------------------------------
+	length_type length( int generation ) const;
+
+
+	//----------------------------------------------------------------------
+	// Public API
+
+	///---------------------------------------------------------------------
+	/// Sets mod to module k of generation, the start modules being
+	/// generation 0.  Throws an Error if there is no such module.
+	///---------------------------------------------------------------------
+	void module( int generation, length_type k, Module &mod ) const;
+
+
+	///---------------------------------------------------------------------
+	/// Appends modules k up to but not including k + count of generation
+	/// to out, or up to the end of the generation if it is shorter.
+	///
+	/// @return the number of modules appended.
+	///---------------------------------------------------------------------
+	length_type range( int generation, length_type k, length_type count,
+		ModuleString &out ) const;
+
+//==============================================================================
+// Private Methods
+//==============================================================================
+private:
+
+	///---------------------------------------------------------------------
+	/// Skips the first skip modules of what module i of level, a symbol,
+	/// expands into in depth generations and appends up to count of the
+	/// rest to out, taking what it skips off skip and what it appends
+	/// off count.  scratch[d] holds the successors rewritten d
+	/// generations before the end.
+	///---------------------------------------------------------------------
+	void extract( const ModuleString &level, ModuleString::size_type i,
+		unsigned int symbol, int depth, length_type &skip, length_type &count,
+		ModuleString &out, std::vector<ModuleString> &scratch ) const;
+
+}; // End of ModuleIndex
+
+} // End of LSystem namespace
+
+#endif
@@ -0,0 +1,297 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#include "modulerope.h"
+
+namespace LSystem {
+
+/**
+ * Subtrees of at least this many final modules are derived as tasks of
+ * their own, smaller ones by the task they are in.
+ */
+static const ModuleRope::length_type TASK_MODULES = 8192;
+
+
+//------------------------------------------------------------------------------
+ModuleRope::ModuleRope( const ProductionSet &productions,
+	const SymbolFrame &globals, const ModuleString &start, int iterations,
+	unsigned int threads )
+	:
+	mySegments(),
+	myLength( 0 ),
+	myTaskCount( 0 ),
+	myProductionSet( &productions ),
+	myGlobals( &globals ),
+	myIterations( iterations < 0 ? 0 : iterations ),
+	myPool( NULL ),
+	myGroup( NULL ),
+	myGraph( NULL ),
+	myLengths(),
+	myCounts(),
+	myChoices(),
+	myLevels()
+{
+	SymbolGraph graph( productions, start );
+	const std::vector<unsigned int> &roots = graph.start();
+	myGraph = &graph;
+	myLengths = graph.lengths( myIterations );
+
+	//----------------------------------------------------------------------
+	// Make the picks in order, then replay the start modules, wait for
+	// the tasks handed out on the way and string their buffers together.
+	myCounts.assign( myIterations + 1, 0 );
+	for( ModuleString::size_type i = 0; i < start.size(); ++i ) {
+		walk( roots[i], myIterations );
+	}
+
+	WorkPool pool( threads );
+	WorkPool::Group group;
+	myPool = &pool;
+	myGroup = &group;
+	myLevels.resize( myIterations + 1 );
+
+	Piece root;
+	root.symbol = 0;
+	root.depth = 0;
+	root.choice = 0;
+	root.buffers.resize( 1 );
+	ModuleString::size_type choice = 0;
+	try {
+		for( ModuleString::size_type i = 0; i < start.size(); ++i ) {
+			replay( root, start, i, roots[i], myIterations, choice, myLevels, false );
+		}
+	} catch( ... ) {
+		// The tasks handed out so far write into root, so they must be
+		// done with it before it goes.  The first error is the one to say.
+		try {
+			pool.wait( group );
+		} catch( ... ) {
+			discardError( std::current_exception() );
+		}
+		throw;
+	}
+	pool.wait( group );
+
+	std::vector<ModuleString *> buffers;
+	gather( root, buffers );
+	mySegments.resize( buffers.size() );
+	for( std::vector<ModuleString *>::size_type n = 0; n < buffers.size(); ++n ) {
+		mySegments[n].swap( *buffers[n] );
+		myLength += mySegments[n].size();
+	}
+
+	//--------------------------------------------------------------
+	// Let go of everything only needed while deriving.
+	myProductionSet = NULL;
+	myGlobals = NULL;
+	myPool = NULL;
+	myGroup = NULL;
+	myGraph = NULL;
+	std::vector< std::vector<length_type> >().swap( myLengths );
+	std::vector<length_type>().swap( myCounts );
+	std::vector<Choice>().swap( myChoices );
+	std::vector<ModuleString>().swap( myLevels );
+}
+
+
+//------------------------------------------------------------------------------
+ModuleString::size_type ModuleRope::memoryUsed() const {
+	ModuleString::size_type bytes = mySegments.capacity() * sizeof( ModuleString );
+	for( std::vector<ModuleString>::size_type n = 0; n < mySegments.size(); ++n ) {
+		bytes += mySegments[n].memoryUsed();
+	}
+	return bytes;
+}
+
+
+//------------------------------------------------------------------------------
+void ModuleRope::flatten( ModuleString &out ) const {
+	ModuleString::size_type parameters = 0;
+	for( std::vector<ModuleString>::size_type n = 0; n < mySegments.size(); ++n ) {
+		parameters += mySegments[n].parameterTotal();
+	}
+	out.clear();
+	out.reserve( myLength, parameters );
+	for( std::vector<ModuleString>::size_type n = 0; n < mySegments.size(); ++n ) {
+		out.append( mySegments[n], 0, mySegments[n].size() );
+	}
+}
+
+
+//------------------------------------------------------------------------------
+void ModuleRope::walk( unsigned int symbol, int depth ) {
+	int generation = myIterations - depth;
+
+	//----------------------------------------------------------------------
+	// Nothing below is picked at random, so only count its modules.
+	if( myLengths[ depth ][ symbol ] != SymbolGraph::RANDOM ) {
+		for( int k = 0; k <= depth; ++k ) {
+			myCounts[ generation + k ] += myLengths[k][ symbol ];
+		}
+		return;
+	}
+
+	//----------------------------------------------------------------------
+	// Picked by its place in its generation, then each successor in turn.
+	// Once they are done it is known how long the subtree is.
+	ModuleString::size_type index = myChoices.size();
+	length_type before = myCounts[ myIterations ];
+	const SymbolGraph::Symbol &key = myGraph->symbol( symbol );
+	Production *prod = myProductionSet->match( key.first, key.second,
+		myProductionSet->getSeed(), generation, myCounts[ generation ]++ );
+	const std::vector<Production *> &candidates = myGraph->productions( symbol );
+	Choice pick = { 0, 0 };
+	while( candidates[ pick.candidate ] != prod ) {
+		++pick.candidate;
+	}
+	myChoices.push_back( pick );
+
+	const std::vector<unsigned int> &children = myGraph->children( symbol, pick.candidate );
+	for( std::vector<unsigned int>::size_type c = 0; c < children.size(); ++c ) {
+		walk( children[c], depth - 1 );
+	}
+	if( myCounts[ myIterations ] - before >= TASK_MODULES ) {
+		myChoices[ index ].end = myChoices.size();
+	}
+}
+
+
+//------------------------------------------------------------------------------
+void ModuleRope::replay( Piece &piece, const ModuleString &level,
+	ModuleString::size_type i, unsigned int symbol, int depth,
+	ModuleString::size_type &choice, std::vector<ModuleString> &levels,
+	bool top )
+{
+	length_type length = myLengths[ depth ][ symbol ];
+	if( length != SymbolGraph::RANDOM ) {
+		if( !top && depth > 0 && length >= TASK_MODULES ) {
+			spawn( piece, level, i, symbol, depth, choice );
+		} else {
+			expand( piece, level, i, symbol, depth, levels );
+		}
+		return;
+	}
+
+	const Choice &pick = myChoices[ choice ];
+	if( !top && pick.end ) {
+		spawn( piece, level, i, symbol, depth, choice );
+		choice = pick.end;
+		return;
+	}
+	++choice;
+
+	ModuleString &successors = levels[ depth - 1 ];
+	successors.clear();
+	ProductionSet::apply( level, i, myGraph->productions( symbol )[ pick.candidate ],
+		*myGlobals, successors );
+
+	const std::vector<unsigned int> &children = myGraph->children( symbol, pick.candidate );
+	for( ModuleString::size_type s = 0; s < successors.size(); ++s ) {
+		replay( piece, successors, s, children[s], depth - 1, choice, levels, false );
+	}
+}
+
+
+//------------------------------------------------------------------------------
+void ModuleRope::expand( Piece &piece, const ModuleString &level,
+	ModuleString::size_type i, unsigned int symbol, int depth,
+	std::vector<ModuleString> &levels )
+{
+	const std::vector<Production *> &candidates = myGraph->productions( symbol );
+	if( depth == 0 || candidates.empty() ) {
+		piece.buffers.back().append( level, i, i + 1 );
+		return;
+	}
+
+	ModuleString &successors = levels[ depth - 1 ];
+	successors.clear();
+	ProductionSet::apply( level, i, candidates[0], *myGlobals, successors );
+
+	const std::vector<unsigned int> &children = myGraph->children( symbol, 0 );
+	for( ModuleString::size_type s = 0; s < successors.size(); ++s ) {
+		if( depth > 1 && myLengths[ depth - 1 ][ children[s] ] >= TASK_MODULES ) {
+			spawn( piece, successors, s, children[s], depth - 1, 0 );
+		} else {
+			expand( piece, successors, s, children[s], depth - 1, levels );
+		}
+	}
+}
+
+
+//------------------------------------------------------------------------------
+void ModuleRope::spawn( Piece &piece, const ModuleString &level,
+	ModuleString::size_type i, unsigned int symbol, int depth,
+	ModuleString::size_type choice )
+{
+	std::unique_ptr<Piece> child( new Piece );
+	child->root.append( level, i, i + 1 );
+	child->symbol = symbol;
+	child->depth = depth;
+	child->choice = choice;
+	child->buffers.resize( 1 );
+
+	// What piece derives next goes after the task, in a buffer of its own.
+	Piece *task = child.get();
+	piece.children.push_back( std::move( child ) );
+	piece.buffers.resize( piece.buffers.size() + 1 );
+	myPool->push( *myGroup, [this, task]() { run( *task ); } );
+}
+
+
+//------------------------------------------------------------------------------
+void ModuleRope::run( Piece &piece ) {
+	// Tasks never wait, so one thread never runs two at once and can
+	// keep its successor buffers from one to the next.
+	static thread_local std::vector<ModuleString> levels;
+	if( levels.size() < (std::vector<ModuleString>::size_type)piece.depth ) {
+		levels.resize( piece.depth );
+	}
+	ModuleString::size_type choice = piece.choice;
+	replay( piece, piece.root, 0, piece.symbol, piece.depth, choice, levels, true );
+}
+
+
+//------------------------------------------------------------------------------
+void ModuleRope::gather( Piece &piece, std::vector<ModuleString *> &buffers ) {
+	for( std::deque<ModuleString>::size_type n = 0; n < piece.buffers.size(); ++n ) {
+		if( !piece.buffers[n].empty() ) {
+			buffers.push_back( &piece.buffers[n] );
+		}
+		if( n < piece.children.size() ) {
+			++myTaskCount;
+			gather( *piece.children[n], buffers );
+		}
+	}
+}
+
+
+//------------------------------------------------------------------------------
+bool ModuleRopeWalker::next( Module &mod ) {
+	while( mySegment < myRope.segmentCount()
+		&& myPosition >= myRope.segment( mySegment ).size() ) {
+		++mySegment;
+		myPosition = 0;
+	}
+	if( mySegment == myRope.segmentCount() ) {
+		return false;
+	}
+	myRope.segment( mySegment ).getModule( myPosition++, mod );
+	return true;
+}
+
+} // End of LSystem namespace
@@ -0,0 +1,322 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#ifndef MODULEROPE_H
+#define MODULEROPE_H
+
+#include "modulesource.h"
+#include "productionset.h"
+#include "symbolgraph.h"
+#include "workpool.h"
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace LSystem {
+
+///-----------------------------------------------------------------------------
+/// The final generation of an LSystem derived as tasks on a WorkPool and
+/// held as a rope, an ordered list of segments.
+///
+/// Each start module, and any successor whose expansion is long enough, is
+/// a task that derives its subtree depth first into buffers of its own,
+/// handing the long subtrees below it out as tasks in turn.  Idle threads
+/// steal the oldest, so biggest, tasks left, which keeps every thread busy
+/// however lopsided the tree is.  When all are done the buffers are moved,
+/// not copied, into the list of segments in derivation order.
+///
+/// A stochastic production is picked by where its module is in its
+/// generation, which depends on everything derived to its left.  So first
+/// the calling thread walks the modules that may be rewritten at random in
+/// order, counting the modules of every generation, and records each pick.
+/// It skips over the subtrees in which nothing is picked at random, whose
+/// sizes in every generation are worked out up front, and it evaluates no
+/// parameters.  The tasks then replay the picks, and any subtree the walk
+/// found to be long enough becomes a task, whether or not something in it
+/// is picked at random.  The result is the same as evaluateSystem()'s with
+/// any number of threads.
+///
+/// LSystem::ModuleRope rope = parser.ropeSystem();
+/// LSystem::ModuleRopeWalker walker( rope );
+/// LSystem::Module m;
+/// while( walker.next( m ) ) {
+///     ...
+/// }
+///
+/// @author Lakin Wecker aka nikal@nucleus.com
+///
+/// @see LSystem::Parser::ropeSystem
+/// @see LSystem::ModuleRopeWalker
+/// @see LSystem::WorkPool
+/// @see LSystem::SymbolGraph
+///-----------------------------------------------------------------------------
+class ModuleRope {
+
+//==============================================================================
+// Typedefs
+//==============================================================================
+public:
+	typedef SymbolGraph::length_type length_type;
+
+//==============================================================================
+// Private Variables
+//==============================================================================
+private:
+
+	///---------------------------------------------------------------------
+	/// Which of its symbol's productions was picked for a module rewritten
+	/// at random.  If the module's subtree is long enough to be a task of
+	/// its own, end is the choice after the last in it, otherwise 0.
+	///---------------------------------------------------------------------
+	struct Choice {
+		unsigned int candidate;
+		ModuleString::size_type end;
+	};
+
+	///---------------------------------------------------------------------
+	/// What one task derives.  Its subtree is the module in root expanded
+	/// for depth generations, into buffers, with the subtree of child n
+	/// coming after buffer n.  If something in it is picked at random its
+	/// picks start at choice.  The calling thread's piece has no root.
+	///---------------------------------------------------------------------
+	struct Piece {
+		ModuleString root;
+		unsigned int symbol;
+		int depth;
+		ModuleString::size_type choice;
+		// A deque, so buffers already written never move.
+		std::deque<ModuleString> buffers;
+		std::vector< std::unique_ptr<Piece> > children;
+	};
+
+	std::vector<ModuleString> mySegments;
+	length_type myLength;
+	unsigned int myTaskCount;
+
+	// Only used while deriving, and emptied once done.
+	const ProductionSet *myProductionSet;
+	const SymbolFrame *myGlobals;
+	int myIterations;
+	WorkPool *myPool;
+	WorkPool::Group *myGroup;
+	const SymbolGraph *myGraph;
+	// myLengths[d][s] is how many modules one s is after d generations,
+	// or SymbolGraph::RANDOM if something is picked at random on the way.
+	std::vector< std::vector<length_type> > myLengths;
+	// How many modules of each generation the walk has reached, and the
+	// picks it made, in order.
+	std::vector<length_type> myCounts;
+	std::vector<Choice> myChoices;
+	std::vector<ModuleString> myLevels;
+
+//==============================================================================
+// Public Methods
+//==============================================================================
+public:
+
+	//----------------------------------------------------------------------
+	// Constructors
+
+	///---------------------------------------------------------------------
+	/// Derives start, rewritten by productions, which has to have been
+	/// compiled, for iterations generations on threads threads, 0 meaning
+	/// one per hardware core.
+	///---------------------------------------------------------------------
+	ModuleRope( const ProductionSet &productions, const SymbolFrame &globals,
+		const ModuleString &start, int iterations, unsigned int threads );
+
+
+	//----------------------------------------------------------------------
+	// Destructor
+
+	///---------------------------------------------------------------------
+	/// Deletes a ModuleRope instance.
+	///---------------------------------------------------------------------
+	virtual ~ModuleRope()
+	{
+	}
+
+
+	//----------------------------------------------------------------------
+	// Getters
+
+	///---------------------------------------------------------------------
+	/// The number of modules in the final generation.
+	///---------------------------------------------------------------------
+	length_type length() const {
+		return myLength;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The number of segments, none of them empty.
+	///---------------------------------------------------------------------
+	std::vector<ModuleString>::size_type segmentCount() const {
+		return mySegments.size();
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Segment n, the final generation being every segment in order.
+	///---------------------------------------------------------------------
+	const ModuleString &segment( std::vector<ModuleString>::size_type n ) const {
+		return mySegments[n];
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The number of tasks the derivation was split into.
+	///---------------------------------------------------------------------
+	unsigned int taskCount() const {
+		return myTaskCount;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The number of bytes held by the segments.
+	///---------------------------------------------------------------------
+	ModuleString::size_type memoryUsed() const;
+
+
+	//----------------------------------------------------------------------
+	// Public API
+
+	///---------------------------------------------------------------------
+	/// Copies the whole final generation into out, replacing what it held.
+	///---------------------------------------------------------------------
+	void flatten( ModuleString &out ) const;
+
+//==============================================================================
+// Private Methods
+//==============================================================================
+private:
+
+	///---------------------------------------------------------------------
+	/// Walks what a symbol expands into in depth generations, counting
+	/// the modules of each generation and adding a Choice for every one
+	/// rewritten at random.
+	///---------------------------------------------------------------------
+	void walk( unsigned int symbol, int depth );
+
+
+	///---------------------------------------------------------------------
+	/// Expands module i of level, a symbol, for depth generations into
+	/// piece, taking the picks from choice on and moving choice past
+	/// them.  Subtrees the walk marked as tasks are handed out, unless
+	/// it is the one the piece was made for, which is the case if top.
+	///---------------------------------------------------------------------
+	void replay( Piece &piece, const ModuleString &level,
+		ModuleString::size_type i, unsigned int symbol, int depth,
+		ModuleString::size_type &choice,
+		std::vector<ModuleString> &levels, bool top );
+
+
+	///---------------------------------------------------------------------
+	/// Expands module i of level, a symbol in whose subtree nothing is
+	/// picked at random, for depth generations into piece.  Successors
+	/// with long enough subtrees are handed out as tasks, the rest are
+	/// expanded here.  levels[d] holds the successors of the module
+	/// being expanded d generations before the end.
+	///---------------------------------------------------------------------
+	void expand( Piece &piece, const ModuleString &level,
+		ModuleString::size_type i, unsigned int symbol, int depth,
+		std::vector<ModuleString> &levels );
+
+
+	///---------------------------------------------------------------------
+	/// Adds a task to piece deriving module i of level, a symbol, for
+	/// depth generations, with its picks starting at choice.
+	///---------------------------------------------------------------------
+	void spawn( Piece &piece, const ModuleString &level,
+		ModuleString::size_type i, unsigned int symbol, int depth,
+		ModuleString::size_type choice );
+
+
+	///---------------------------------------------------------------------
+	/// Runs the task deriving piece.
+	///---------------------------------------------------------------------
+	void run( Piece &piece );
+
+
+	///---------------------------------------------------------------------
+	/// Adds the buffers of piece and its children that aren't empty to
+	/// buffers, in order, counting the tasks.
+	///---------------------------------------------------------------------
+	void gather( Piece &piece, std::vector<ModuleString *> &buffers );
+
+}; // End of ModuleRope
+
+
+///-----------------------------------------------------------------------------
+/// Hands out the modules of a ModuleRope in order.  The rope must outlive
+/// the walker.
+///-----------------------------------------------------------------------------
+class ModuleRopeWalker : public ModuleSource {
+
+//==============================================================================
+// Private Variables
+//==============================================================================
+private:
+
+	const ModuleRope &myRope;
+	std::vector<ModuleString>::size_type mySegment;
+	ModuleString::size_type myPosition;
+
+//==============================================================================
+// Public Methods
+//==============================================================================
+public:
+
+	//----------------------------------------------------------------------
+	// Constructors
+
+	///---------------------------------------------------------------------
+	/// Creates a walker starting at the first module.
+	///---------------------------------------------------------------------
+	ModuleRopeWalker( const ModuleRope &rope )
+		:
+		myRope( rope ),
+		mySegment( 0 ),
+		myPosition( 0 )
+	{
+	}
+
+
+	//----------------------------------------------------------------------
+	// Public API
+
+	///---------------------------------------------------------------------
+	/// @see LSystem::ModuleSource::next
+	///---------------------------------------------------------------------
+	virtual bool next( Module &mod );
+
+
+	///---------------------------------------------------------------------
+	/// Starts the walk over from the first module.
+	///---------------------------------------------------------------------
+	void rewind() {
+		mySegment = 0;
+		myPosition = 0;
+	}
+
+}; // End of ModuleRopeWalker
+
+} // End of LSystem namespace
+
+#endif
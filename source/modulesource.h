@@ -0,0 +1,124 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#ifndef MODULESOURCE_H
+#define MODULESOURCE_H
+
+#include "module.h"
+
+#include <vector>
+
+namespace LSystem {
+
+///-----------------------------------------------------------------------------
+/// Something that hands out the modules of a derivation one at a time, in
+/// order.  Lets consumers such as the renderer walk a derivation without
+/// caring whether it is held in memory or produced on the fly.
+///
+/// LSystem::Module m;
+/// while( source.next( m ) ) {
+///     ...
+/// }
+///
+/// @author Lakin Wecker aka nikal@nucleus.com
+///
+/// @see LSystem::Module
+///-----------------------------------------------------------------------------
+class ModuleSource {
+
+//==============================================================================
+// Public Methods
+//==============================================================================
+public:
+
+	//----------------------------------------------------------------------
+	// Destructor
+
+	///---------------------------------------------------------------------
+	/// Deletes a ModuleSource instance.
+	///---------------------------------------------------------------------
+	virtual ~ModuleSource()
+	{
+	}
+
+
+	//----------------------------------------------------------------------
+	// Public API
+
+	///---------------------------------------------------------------------
+	/// Copies the next module into mod.
+	///
+	/// @return false once there are no modules left, mod is untouched.
+	///---------------------------------------------------------------------
+	virtual bool next( Module &mod ) = 0;
+
+}; // End of ModuleSource
+
+
+///-----------------------------------------------------------------------------
+/// Adapts an in memory std::vector<Module> to a ModuleSource.  The vector
+/// must outlive the source.
+///-----------------------------------------------------------------------------
+class ModuleVecSource : public ModuleSource {
+
+//==============================================================================
+// Private Variables
+//==============================================================================
+private:
+
+	const std::vector<Module> &myModules;
+	std::vector<Module>::size_type myPosition;
+
+//==============================================================================
+// Public Methods
+//==============================================================================
+public:
+
+	//----------------------------------------------------------------------
+	// Constructors
+
+	///---------------------------------------------------------------------
+	/// Creates a source that walks modules from the beginning.
+	///---------------------------------------------------------------------
+	ModuleVecSource( const std::vector<Module> &modules )
+		:
+		myModules( modules ),
+		myPosition( 0 )
+	{
+	}
+
+
+	//----------------------------------------------------------------------
+	// Public API
+
+	///---------------------------------------------------------------------
+	/// @see LSystem::ModuleSource::next
+	///---------------------------------------------------------------------
+	virtual bool next( Module &mod ) {
+		if( myPosition >= myModules.size() ) {
+			return false;
+		}
+		mod = myModules[ myPosition++ ];
+		return true;
+	}
+
+}; // End of ModuleVecSource
+
+} // End of LSystem namespace
+
+#endif
@@ -0,0 +1,132 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#include "modulestream.h"
+
+namespace LSystem {
+
+//------------------------------------------------------------------------------
+ModuleStream::ModuleStream( ProductionSet &productions,
+	const SymbolFrame &globals, const ModuleString &start, int iterations )
+	:
+	myProductionSet( productions ),
+	myGlobals( globals ),
+	myIterations( iterations < 0 ? 0 : iterations ),
+	myLevels( myIterations + 1 ),
+	myPositions( myIterations + 1, 0 ),
+	myCounts( myIterations + 1, 0 ),
+	myDepth( 0 )
+{
+	myLevels[0] = start;
+}
+
+
+//------------------------------------------------------------------------------
+bool ModuleStream::next( Module &mod ) {
+	const ModuleString *level;
+	ModuleString::size_type index;
+	if( !advance( level, index ) ) {
+		return false;
+	}
+	level->getModule( index, mod );
+	return true;
+}
+
+
+//------------------------------------------------------------------------------
+ModuleVec::size_type ModuleStream::next( ModuleVec &block,
+	ModuleVec::size_type max )
+{
+	block.resize( max );
+	ModuleVec::size_type count = 0;
+	while( count < max && next( block[ count ] ) ) {
+		++count;
+	}
+	block.resize( count );
+	return count;
+}
+
+
+//------------------------------------------------------------------------------
+ModuleString::size_type ModuleStream::next( ModuleString &block,
+	ModuleString::size_type max )
+{
+	block.clear();
+	const ModuleString *level;
+	ModuleString::size_type index;
+	while( block.size() < max && advance( level, index ) ) {
+		block.append( *level, index, index + 1 );
+	}
+	return block.size();
+}
+
+
+//------------------------------------------------------------------------------
+void ModuleStream::rewind() {
+	myDepth = 0;
+	myPositions[0] = 0;
+	myCounts.assign( myCounts.size(), 0 );
+}
+
+
+//------------------------------------------------------------------------------
+bool ModuleStream::advance( const ModuleString *&level,
+	ModuleString::size_type &index )
+{
+	while( myDepth >= 0 ) {
+		const ModuleString &current = myLevels[ myDepth ];
+		ModuleString::size_type &position = myPositions[ myDepth ];
+
+		//----------------------------------------------------------------------
+		// Done with this module's successors, go back up.
+		if( position == current.size() ) {
+			--myDepth;
+			continue;
+		}
+
+		level = &current;
+		index = position++;
+		ModuleString::size_type place = myCounts[ myDepth ]++;
+		if( myDepth == myIterations ) {
+			return true;
+		}
+
+		//----------------------------------------------------------------------
+		// A module without a production is copied unchanged into every
+		// following generation, so it is already final.
+		Production *prod = myProductionSet.match( current.name( index ),
+			current.parameterCount( index ), myDepth, place );
+		if( !prod ) {
+			for( int d = myDepth + 1; d <= myIterations; ++d ) {
+				++myCounts[d];
+			}
+			return true;
+		}
+
+		//----------------------------------------------------------------------
+		// Expand it one level deeper, reusing that level's storage.
+		ModuleString &successors = myLevels[ myDepth + 1 ];
+		successors.clear();
+		ProductionSet::apply( current, index, prod, myGlobals, successors );
+		++myDepth;
+		myPositions[ myDepth ] = 0;
+	}
+	return false;
+}
+
+} // End of LSystem namespace
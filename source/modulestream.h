@@ -0,0 +1,150 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#ifndef MODULESTREAM_H
+#define MODULESTREAM_H
+
+#include "modulesource.h"
+#include "productionset.h"
+
+#include <vector>
+
+namespace LSystem {
+
+///-----------------------------------------------------------------------------
+/// Lazily derives the final generation of an LSystem depth first.
+///
+/// Instead of rewriting whole generations, each start module is expanded
+/// recursively down to the last generation and the final modules are handed
+/// out as they are reached.  Only the successors along the current path are
+/// held, so memory use is bounded by iterations * the longest successor list
+/// no matter how long the final string is.
+///
+/// LSystem::ModuleStream stream = parser.streamSystem();
+/// LSystem::Module m;
+/// while( stream.next( m ) ) {
+///     ...
+/// }
+///
+/// The ProductionSet and globals are referenced, not copied, so the Parser
+/// they came from has to outlive the stream.
+///
+/// @author Lakin Wecker aka nikal@nucleus.com
+///
+/// @see LSystem::Parser::streamSystem
+/// @see LSystem::ModuleSource
+///-----------------------------------------------------------------------------
+class ModuleStream : public ModuleSource {
+
+//==============================================================================
+// Private Variables
+//==============================================================================
+private:
+
+	ProductionSet &myProductionSet;
+	const SymbolFrame &myGlobals;
+	int myIterations;
+	// myLevels[0] is the start list, myLevels[d] holds the successors of
+	// the module currently being expanded at depth d - 1.
+	std::vector<ModuleString> myLevels;
+	std::vector<ModuleString::size_type> myPositions;
+	// How many modules of each generation have been reached so far, which
+	// is the index of the next one in its generation.
+	std::vector<ModuleString::size_type> myCounts;
+	int myDepth;
+
+//==============================================================================
+// Public Methods
+//==============================================================================
+public:
+
+	//----------------------------------------------------------------------
+	// Constructors
+
+	///---------------------------------------------------------------------
+	/// Creates a stream which derives start for iterations generations.
+	///---------------------------------------------------------------------
+	ModuleStream( ProductionSet &productions, const SymbolFrame &globals,
+		const ModuleString &start, int iterations );
+
+
+	//----------------------------------------------------------------------
+	// Destructor
+
+	///---------------------------------------------------------------------
+	/// Deletes a ModuleStream instance.
+	///---------------------------------------------------------------------
+	virtual ~ModuleStream()
+	{
+	}
+
+
+	//----------------------------------------------------------------------
+	// Public API
+
+	///---------------------------------------------------------------------
+	/// Derives the next module of the final generation.
+	///
+	/// @return false once the whole generation has been handed out.
+	///---------------------------------------------------------------------
+	virtual bool next( Module &mod );
+
+
+	///---------------------------------------------------------------------
+	/// Derives up to max modules of the final generation into block,
+	/// replacing whatever it held.
+	///
+	/// @return the number of modules derived, 0 at the end.
+	///---------------------------------------------------------------------
+	ModuleVec::size_type next( ModuleVec &block, ModuleVec::size_type max );
+
+
+	///---------------------------------------------------------------------
+	/// Derives up to max modules of the final generation into the packed
+	/// block, replacing whatever it held.
+	///
+	/// @return the number of modules derived, 0 at the end.
+	///---------------------------------------------------------------------
+	ModuleString::size_type next( ModuleString &block,
+		ModuleString::size_type max );
+
+
+	///---------------------------------------------------------------------
+	/// Starts the derivation over from the start modules.
+	///---------------------------------------------------------------------
+	void rewind();
+
+//==============================================================================
+// Private Methods
+//==============================================================================
+private:
+
+	///---------------------------------------------------------------------
+	/// Expands the derivation until the next final module is found.
+	///
+	/// @param level Set to the level holding the module.
+	/// @param index Set to the index of the module within level.
+	/// @return false once the whole generation has been handed out.
+	///---------------------------------------------------------------------
+	bool advance( const ModuleString *&level, ModuleString::size_type &index );
+
+}; // End of ModuleStream
+
+} // End of LSystem namespace
+
+#endif
@@ -0,0 +1,491 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#ifndef MODULESTRING_H
+#define MODULESTRING_H
+
+#include "module.h"
+#include "modulesource.h"
+
+#include <vector>
+#include <algorithm>
+#include <bitset>
+#include <string>
+
+namespace LSystem {
+
+///-----------------------------------------------------------------------------
+/// A packed string of modules, one generation of an LSystem.
+///
+/// Rather than a std::vector<Module>, where every module carries a vtable
+/// pointer and its own heap allocated parameter vector, the modules are
+/// stored as three flat arrays: the module names, the offset of each
+/// module's parameters, and one pool holding all of the parameters.  A
+/// generation of millions of modules is then three allocations.
+///
+/// Module i is named name( i ) and has parameterCount( i ) parameters
+/// starting at parameters( i ).
+///
+/// LSystem::ModuleString s;
+/// double *p = s.push_back( 'F', 1 );
+/// p[0] = 10.0;
+///
+/// @author Lakin Wecker aka nikal@nucleus.com
+///
+/// @see LSystem::Module
+///-----------------------------------------------------------------------------
+class ModuleString {
+
+//==============================================================================
+// Typedefs
+//==============================================================================
+public:
+	typedef std::vector<double>::size_type size_type;
+
+//==============================================================================
+// Private Variables
+//==============================================================================
+private:
+
+	std::vector<char> myNames;
+	// myOffsets[i] is where module i's parameters start and myOffsets[i+1]
+	// where they end, so there is always one more offset than modules.
+	std::vector<size_type> myOffsets;
+	std::vector<double> myParameters;
+
+//==============================================================================
+// Public Methods
+//==============================================================================
+public:
+
+	//----------------------------------------------------------------------
+	// Constructors
+
+	///---------------------------------------------------------------------
+	/// Creates an empty ModuleString.
+	///---------------------------------------------------------------------
+	ModuleString()
+		:
+		myNames(),
+		myOffsets( 1, 0 ),
+		myParameters()
+	{
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Packs a std::vector<Module>.
+	///---------------------------------------------------------------------
+	explicit ModuleString( const std::vector<Module> &modules )
+		:
+		myNames(),
+		myOffsets( 1, 0 ),
+		myParameters()
+	{
+		myNames.reserve( modules.size() );
+		myOffsets.reserve( modules.size() + 1 );
+		for( std::vector<Module>::size_type i = 0; i < modules.size(); ++i ) {
+			push_back( modules[i] );
+		}
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Copies other.
+	///---------------------------------------------------------------------
+	ModuleString( const ModuleString &other ) = default;
+
+
+	///---------------------------------------------------------------------
+	/// Takes the modules of other without copying them.  other must be
+	/// clear()'d or assigned to before it is used again.
+	///---------------------------------------------------------------------
+	ModuleString( ModuleString &&other ) = default;
+
+
+	//----------------------------------------------------------------------
+	// Destructor
+
+	///---------------------------------------------------------------------
+	/// Deletes a ModuleString instance.
+	///---------------------------------------------------------------------
+	virtual ~ModuleString()
+	{
+	}
+
+
+	//----------------------------------------------------------------------
+	// Getters
+
+	///---------------------------------------------------------------------
+	/// The number of modules in the string.
+	///---------------------------------------------------------------------
+	size_type size() const {
+		return myNames.size();
+	}
+
+
+	///---------------------------------------------------------------------
+	/// True if there are no modules in the string.
+	///---------------------------------------------------------------------
+	bool empty() const {
+		return myNames.empty();
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The total number of parameters of all the modules.
+	///---------------------------------------------------------------------
+	size_type parameterTotal() const {
+		return myOffsets.back();
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The name of module i.
+	///---------------------------------------------------------------------
+	char name( size_type i ) const {
+		return myNames[i];
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The number of parameters module i has.
+	///---------------------------------------------------------------------
+	size_type parameterCount( size_type i ) const {
+		return myOffsets[i + 1] - myOffsets[i];
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Where module i's parameters start in the parameter pool.
+	///---------------------------------------------------------------------
+	size_type parameterOffset( size_type i ) const {
+		return myOffsets[i];
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The parameters of module i.
+	///---------------------------------------------------------------------
+	const double *parameters( size_type i ) const {
+		return myParameters.data() + myOffsets[i];
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The parameters of module i.
+	///---------------------------------------------------------------------
+	double *parameters( size_type i ) {
+		return myParameters.data() + myOffsets[i];
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Copies module i into mod.
+	///---------------------------------------------------------------------
+	void getModule( size_type i, Module &mod ) const {
+		mod.name = myNames[i];
+		mod.parameters.assign( parameters( i ), parameters( i ) + parameterCount( i ) );
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Unpacks the string into a std::vector<Module>.
+	///---------------------------------------------------------------------
+	std::vector<Module> toModuleVec() const {
+		std::vector<Module> ret( size() );
+		for( size_type i = 0; i < size(); ++i ) {
+			getModule( i, ret[i] );
+		}
+		return ret;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The number of bytes held by the three arrays.
+	///---------------------------------------------------------------------
+	size_type memoryUsed() const {
+		return myNames.capacity() * sizeof( char )
+			+ myOffsets.capacity() * sizeof( size_type )
+			+ myParameters.capacity() * sizeof( double );
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The number of bytes a string of modules modules with parameters
+	/// parameters in all needs, if allocated at exactly that size.
+	///---------------------------------------------------------------------
+	static size_type memoryNeeded( size_type modules, size_type parameters ) {
+		return modules * sizeof( char )
+			+ ( modules + 1 ) * sizeof( size_type )
+			+ parameters * sizeof( double );
+	}
+
+
+	//----------------------------------------------------------------------
+	// Modifiers
+
+	///---------------------------------------------------------------------
+	/// Appends a module named name with count parameters and returns
+	/// where to write the parameters.
+	///---------------------------------------------------------------------
+	double *push_back( char name, size_type count ) {
+		size_type offset = myOffsets.back();
+		myNames.push_back( name );
+		myOffsets.push_back( offset + count );
+		myParameters.resize( offset + count );
+		return myParameters.data() + offset;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Appends a module named name with a copy of count parameters.
+	///---------------------------------------------------------------------
+	void push_back( char name, const double *params, size_type count ) {
+		std::copy( params, params + count, push_back( name, count ) );
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Appends a copy of mod.
+	///---------------------------------------------------------------------
+	void push_back( const Module &mod ) {
+		push_back( mod.name, mod.parameters.data(), mod.parameters.size() );
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Appends a copy of modules [begin, end) of source.
+	///---------------------------------------------------------------------
+	void append( const ModuleString &source, size_type begin, size_type end ) {
+		if( begin >= end ) {
+			return;
+		}
+		size_type base = myOffsets.back();
+		size_type from = source.myOffsets[begin];
+		myNames.insert( myNames.end(),
+			source.myNames.begin() + begin, source.myNames.begin() + end );
+		for( size_type i = begin + 1; i <= end; ++i ) {
+			myOffsets.push_back( base + source.myOffsets[i] - from );
+		}
+		myParameters.insert( myParameters.end(),
+			source.myParameters.begin() + from,
+			source.myParameters.begin() + source.myOffsets[end] );
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Appends a copy of the modules of [begin, end) of source whose
+	/// names are in keep, each run of them copied at once.
+	///---------------------------------------------------------------------
+	void append( const ModuleString &source, size_type begin, size_type end,
+		const std::bitset<256> &keep ) {
+		while( begin < end ) {
+			while( begin < end && !keep[ (unsigned char)source.myNames[begin] ] ) {
+				++begin;
+			}
+			size_type run = begin;
+			while( run < end && keep[ (unsigned char)source.myNames[run] ] ) {
+				++run;
+			}
+			append( source, begin, run );
+			begin = run;
+		}
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Like assign() below, but sets modules index onwards of a resize()d
+	/// string to copies of modules [begin, end) of source, with their
+	/// parameters starting at offset.
+	///---------------------------------------------------------------------
+	void assign( size_type index, size_type offset, const ModuleString &source,
+		size_type begin, size_type end ) {
+		size_type from = source.myOffsets[begin];
+		std::copy( source.myNames.begin() + begin, source.myNames.begin() + end,
+			myNames.begin() + index );
+		for( size_type i = begin + 1; i <= end; ++i ) {
+			myOffsets[++index] = offset + source.myOffsets[i] - from;
+		}
+		std::copy( source.myParameters.begin() + from,
+			source.myParameters.begin() + source.myOffsets[end],
+			myParameters.begin() + offset );
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Removes the modules from first on whose names are not in keep,
+	/// moving the rest down in place.
+	///---------------------------------------------------------------------
+	void filter( size_type first, const std::bitset<256> &keep ) {
+		size_type to = first;
+		size_type offset = myOffsets[first];
+		size_type begin = offset;
+		for( size_type i = first; i < myNames.size(); ++i ) {
+			size_type end = myOffsets[i + 1];
+			if( keep[ (unsigned char)myNames[i] ] ) {
+				myNames[to] = myNames[i];
+				std::copy( myParameters.begin() + begin, myParameters.begin() + end,
+					myParameters.begin() + offset );
+				offset += end - begin;
+				myOffsets[++to] = offset;
+			}
+			begin = end;
+		}
+		myNames.resize( to );
+		myOffsets.resize( to + 1 );
+		myParameters.resize( offset );
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The set of the module names in names, for filter().
+	///---------------------------------------------------------------------
+	static std::bitset<256> nameSet( const std::string &names ) {
+		std::bitset<256> set;
+		for( std::string::size_type i = 0; i < names.size(); ++i ) {
+			set.set( (unsigned char)names[i] );
+		}
+		return set;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Resizes the string to modules modules and parameters parameters,
+	/// to be filled in afterwards with assign().
+	///---------------------------------------------------------------------
+	void resize( size_type modules, size_type parameters ) {
+		myNames.resize( modules );
+		myOffsets.resize( modules + 1 );
+		myOffsets[0] = 0;
+		myParameters.resize( parameters );
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Sets module i, whose parameters start at offset, to be named name
+	/// with count parameters and returns where to write the parameters.
+	/// Only writes the end offset of module i, so different threads may
+	/// assign different modules of a resize()d string at the same time as
+	/// long as every offset passed in is the previous module's end.
+	///---------------------------------------------------------------------
+	double *assign( size_type i, size_type offset, char name, size_type count ) {
+		myNames[i] = name;
+		myOffsets[i + 1] = offset + count;
+		return myParameters.data() + offset;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Reserves room for modules modules and parameters parameters.
+	///---------------------------------------------------------------------
+	void reserve( size_type modules, size_type parameters ) {
+		myNames.reserve( modules );
+		myOffsets.reserve( modules + 1 );
+		myParameters.reserve( parameters );
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Removes all of the modules, keeping the memory for reuse.
+	///---------------------------------------------------------------------
+	void clear() {
+		myNames.clear();
+		myOffsets.resize( 1 );
+		myParameters.clear();
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Copies other.
+	///---------------------------------------------------------------------
+	ModuleString &operator=( const ModuleString &other ) = default;
+
+
+	///---------------------------------------------------------------------
+	/// Takes the modules of other without copying them, as the move
+	/// constructor does.
+	///---------------------------------------------------------------------
+	ModuleString &operator=( ModuleString &&other ) = default;
+
+
+	///---------------------------------------------------------------------
+	/// Swaps contents with other.
+	///---------------------------------------------------------------------
+	void swap( ModuleString &other ) {
+		myNames.swap( other.myNames );
+		myOffsets.swap( other.myOffsets );
+		myParameters.swap( other.myParameters );
+	}
+
+}; // End of ModuleString
+
+
+///-----------------------------------------------------------------------------
+/// Adapts a ModuleString to a ModuleSource.  The string must outlive the
+/// source.
+///-----------------------------------------------------------------------------
+class ModuleStringSource : public ModuleSource {
+
+//==============================================================================
+// Private Variables
+//==============================================================================
+private:
+
+	const ModuleString &myModules;
+	ModuleString::size_type myPosition;
+
+//==============================================================================
+// Public Methods
+//==============================================================================
+public:
+
+	//----------------------------------------------------------------------
+	// Constructors
+
+	///---------------------------------------------------------------------
+	/// Creates a source that walks modules from the beginning.
+	///---------------------------------------------------------------------
+	ModuleStringSource( const ModuleString &modules )
+		:
+		myModules( modules ),
+		myPosition( 0 )
+	{
+	}
+
+
+	//----------------------------------------------------------------------
+	// Public API
+
+	///---------------------------------------------------------------------
+	/// @see LSystem::ModuleSource::next
+	///---------------------------------------------------------------------
+	virtual bool next( Module &mod ) {
+		if( myPosition >= myModules.size() ) {
+			return false;
+		}
+		myModules.getModule( myPosition++, mod );
+		return true;
+	}
+
+}; // End of ModuleStringSource
+
+} // End of LSystem namespace
+
+#endif
@@ -20,7 +20,13 @@
  **************************************************************************/
 
 #include "parser.h"
+#include "grammarcache.h"
+#include <charconv>
+#include <cstdio>
+#include <exception>
+#include <iomanip>
 #include <sstream>
+#include <thread>
 
 using namespace LSystem;
 
@@ -30,9 +36,79 @@ using namespace LSystem;
 #endif
 #define SCANNER_ERROR(x) myScanner.createError(x, __FILE__,__LINE__)
 /**
- * Forward Declaration
+ * Generations smaller than this are not worth starting threads for.
  */
-void seedrand( );
+static const ModuleString::size_type MIN_PARALLEL_MODULES = 4096;
+
+/**
+ * How many modules are rewritten serially between checks of the budget.
+ */
+static const ModuleString::size_type BUDGET_CHECK_MODULES = 4096;
+
+/**
+ * How many modules spillSystem() and compressSystem() read and rewrite at
+ * a time.
+ */
+static const ModuleString::size_type SPILL_BLOCK_MODULES = 65536;
+
+/**
+ * Calls work( chunk ) for every chunk in [0, chunks) on its own thread
+ * and waits for all of them to finish.  Whatever a chunk throws is held
+ * until every chunk is done, then the first chunk's is rethrown on the
+ * calling thread, so the chunks never outlive the caller's frame.  The
+ * others are discarded.
+ */
+template <typename Work>
+static void runChunks( unsigned int chunks, Work work ) {
+	std::vector<std::exception_ptr> errors( chunks );
+	auto guarded = [&]( unsigned int c ) {
+		try {
+			work( c );
+		} catch( ... ) {
+			errors[c] = std::current_exception();
+		}
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve( chunks - 1 );
+	for( unsigned int c = 1; c < chunks; ++c ) {
+		threads.push_back( std::thread( guarded, c ) );
+	}
+	// The calling thread does the first chunk itself.
+	guarded( 0 );
+	for( std::vector<std::thread>::size_type t = 0; t < threads.size(); ++t ) {
+		threads[t].join();
+	}
+	std::exception_ptr first;
+	for( unsigned int c = 0; c < chunks; ++c ) {
+		if( !first ) {
+			first = errors[c];
+		} else {
+			discardError( errors[c] );
+		}
+	}
+	if( first ) {
+		std::rethrow_exception( first );
+	}
+}
+
+/**
+ * The value of an INT lexeme.
+ */
+static int parseInt( std::string_view text ) {
+	int value = 0;
+	std::from_chars( text.data(), text.data() + text.size(), value );
+	return value;
+}
+
+/**
+ * The value of a FLOAT or INT lexeme.
+ */
+static double parseDouble( std::string_view text ) {
+	double value = 0.0;
+	std::from_chars( text.data(), text.data() + text.size(), value );
+	return value;
+}
 
 /**
  * Operator for token type
@@ -82,24 +158,28 @@ std::ostream &operator<<( std::ostream &out, Token::Type t ) {
 	return out;
 }
 
-ModuleVec Parser::evaluateSystem() {
-	//Start the random number generator
-	seedrand();
+ModuleString Parser::evaluateSystem() {
 	//Temp Work Vectors
-	ModuleVec work1Vector = myStartList;
-	ModuleVec work2Vector;
+	ModuleString work1Vector = myStartList;
+	ModuleString work2Vector;
+
+	std::vector<GenerationSize> predicted;
+	unsigned int threads = startDerivation( predicted );
+
+	if( myProgress ) {
+		myProgress( 0, myIterations, work1Vector.size() );
+	}
 
 	//References
-	ModuleVec *currentVector = &work1Vector;
-	ModuleVec *tempVector = &work2Vector;
-	ModuleVec *newVector = &work2Vector;
+	ModuleString *currentVector = &work1Vector;
+	ModuleString *tempVector = &work2Vector;
+	ModuleString *newVector = &work2Vector;
 	//Do this as many times as required.
 	for( int j = 0; j < myIterations; ++j ) {
-		//Go through each of the modules in the current working
-		//module vector replacing them with their productions.
-		for( ModuleVec::size_type i = 0; i < currentVector->size(); ++i ) {
-			ModuleVec tmp = myProductionSet.evaluate( (*currentVector)[i], myGlobals );
-			newVector->insert( newVector->end(), tmp.begin(), tmp.end() );
+		if( !deriveGeneration( *currentVector, *newVector, j, predicted, threads ) ) {
+			newVector->clear();
+			myPartialResult.swap( *currentVector );
+			stopDerivation( j );
 		}
 		currentVector->clear();
 
@@ -107,21 +187,356 @@ ModuleVec Parser::evaluateSystem() {
 		tempVector = newVector;
 		newVector = currentVector;
 		currentVector = tempVector;
+
+		if( myProgress ) {
+			myProgress( j + 1, myIterations, currentVector->size() );
+		}
 	}
 	///////////////////////////////////////////////////////////////////////////////////////
 	// Print out the new list of modules
 	LDEBUG( 
-	for( ModuleVec::size_type i = 0; i < currentVector->size(); ++i ) {
-		std::cout << (*currentVector)[i].name;
+	for( ModuleString::size_type i = 0; i < currentVector->size(); ++i ) {
+		std::cout << currentVector->name( i );
 		std::cout << "(";
-		for( NumberVec::size_type j = 0; j < (*currentVector)[i].parameters.size(); ++j ) {
-			std::cout << (*currentVector)[i].parameters[j] << ",";
+		for( ModuleString::size_type j = 0; j < currentVector->parameterCount( i ); ++j ) {
+			std::cout << currentVector->parameters( i )[j] << ",";
 		}
 		std::cout << ")";
 	} )
-	return *currentVector;
+	// Moved out rather than copied, so the last generation is never held
+	// twice.
+	ModuleString result;
+	result.swap( *currentVector );
+	return result;
 }
 
+void Parser::evaluateSystem( std::vector<ModuleString> &generations ) {
+	if( generations.empty() ) {
+		generations.push_back( myStartList );
+	}
+
+	std::vector<GenerationSize> predicted;
+	unsigned int threads = startDerivation( predicted );
+
+	// Reserved up front, so the generation being read from never moves.
+	int first = generations.size() - 1;
+	if( first < myIterations ) {
+		generations.reserve( myIterations + 1 );
+	}
+	if( myProgress ) {
+		myProgress( first, myIterations, generations.back().size() );
+	}
+
+	for( int j = first; j < myIterations; ++j ) {
+		generations.push_back( ModuleString() );
+		if( !deriveGeneration( generations[j], generations[j + 1], j, predicted, threads ) ) {
+			generations.pop_back();
+			myPartialResult = generations.back();
+			stopDerivation( j );
+		}
+		if( myProgress ) {
+			myProgress( j + 1, myIterations, generations.back().size() );
+		}
+	}
+}
+
+unsigned int Parser::startDerivation( std::vector<GenerationSize> &predicted ) {
+	myStartTime = std::chrono::steady_clock::now();
+	myPartialResult.clear();
+	myCompletedIterations = 0;
+
+	///////////////////////////////////////////////////////////////////////////
+	// When the system has no stochastic productions the size of every
+	// generation is known up front, so a generation over budget is never
+	// started and each one is allocated at exactly its size.
+	GrowthMatrix growth( myProductionSet, myStartList );
+	predicted.clear();
+	if( growth.exact() ) {
+		predicted = growth.predict( myIterations, myKept );
+	}
+
+	unsigned int threads = myThreadCount;
+	if( threads == 0 ) {
+		threads = std::thread::hardware_concurrency();
+	}
+	return threads;
+}
+
+bool Parser::deriveGeneration( const ModuleString &current, ModuleString &next,
+	int generation, const std::vector<GenerationSize> &predicted,
+	unsigned int threads )
+{
+	if( !withinBudget( current.size(), current.memoryUsed(), generation ) ) {
+		return false;
+	}
+	if( !predicted.empty() ) {
+		const GenerationSize &size = predicted[generation + 1];
+		if( !withinBudget( size.modules, current.memoryUsed() + size.bytes,
+				generation + 1 ) ) {
+			return false;
+		}
+		// next is empty, but may still hold an older generation's buffer.
+		// Growing it would hold that and the new one at once, so it is
+		// given up first and the peak stays what was predicted.
+		if( next.memoryUsed() < size.bytes ) {
+			ModuleString().swap( next );
+		}
+		next.reserve( (ModuleString::size_type)size.modules,
+			(ModuleString::size_type)size.parameters );
+	}
+
+	//Go through each of the modules in the current working
+	//module vector replacing them with their productions.
+	if( threads > 1 && current.size() >= MIN_PARALLEL_MODULES ) {
+		return evaluateGenerationParallel( current, next, generation, threads );
+	}
+	return evaluateGeneration( current, next, generation );
+}
+
+void Parser::stopDerivation( int generation ) {
+	///////////////////////////////////////////////////////////////////////
+	// Out of budget, keep the last whole generation and give up.
+	myCompletedIterations = generation;
+	std::ostringstream msg;
+	msg << "Error: Derivation stopped after " << generation << " of "
+		<< myIterations << " iterations: " << myBudgetMessage;
+	throw new Error( msg.str(), -1, -1, __FILE__, __LINE__ );
+}
+
+void Parser::evaluateSystem( unsigned long long seed, ModuleString &result,
+	ModuleString &scratch ) const
+{
+	if( !myGrammar ) {
+		result.clear();
+		return;
+	}
+	myGrammar->derive( seed, result, scratch );
+}
+
+std::string Parser::spillSystem( const std::string &prefix ) {
+	std::string paths[2] = { prefix + ".0", prefix + ".1" };
+	{
+		SpillWriter start( paths[0] );
+		start.append( myStartList );
+		start.close();
+	}
+
+	ModuleString block;
+	ModuleString next;
+	for( int j = 0; j < myIterations; ++j ) {
+		SpillReader current( paths[ j % 2 ] );
+		SpillWriter out( paths[ ( j + 1 ) % 2 ] );
+
+		///////////////////////////////////////////////////////////////////////
+		// Rewrite a block at a time, the index of each module in its
+		// generation placing its random draw as evaluateSystem() would.
+		ModuleString::size_type index = 0;
+		while( current.next( block, SPILL_BLOCK_MODULES ) ) {
+			next.clear();
+			for( ModuleString::size_type i = 0; i < block.size(); ++i ) {
+				ProductionSet::apply( block, i,
+					myProductionSet.match( block.name( i ),
+						block.parameterCount( i ), j, index++ ),
+					myGlobals, next );
+			}
+			out.append( next );
+		}
+		out.close();
+	}
+
+	std::remove( paths[ ( myIterations + 1 ) % 2 ].c_str() );
+	return paths[ myIterations % 2 ];
+}
+
+CompressedString Parser::compressSystem() {
+	CompressedString result;
+	result.append( myStartList );
+	result.close();
+
+	CompressedString out;
+	ModuleString block;
+	ModuleString next;
+	for( int j = 0; j < myIterations; ++j ) {
+		CompressedReader current( result );
+		out.clear();
+
+		///////////////////////////////////////////////////////////////////////
+		// Rewrite a block at a time, as spillSystem() does.
+		ModuleString::size_type index = 0;
+		while( current.next( block, SPILL_BLOCK_MODULES ) ) {
+			next.clear();
+			for( ModuleString::size_type i = 0; i < block.size(); ++i ) {
+				ProductionSet::apply( block, i,
+					myProductionSet.match( block.name( i ),
+						block.parameterCount( i ), j, index++ ),
+					myGlobals, next );
+			}
+			out.append( next );
+		}
+		out.close();
+		result.swap( out );
+	}
+	return result;
+}
+
+ModuleStream Parser::streamSystem() {
+	return ModuleStream( myProductionSet, myGlobals, myStartList, myIterations );
+}
+
+ExpansionDag Parser::expandSystem() {
+	return ExpansionDag( myProductionSet, myGlobals, myStartList, myIterations );
+}
+
+bool Parser::evaluateGeneration( const ModuleString &current, ModuleString &next,
+	unsigned int generation )
+{
+	// The last generation is filtered as it is written, so the modules
+	// dropped never take up room in it.
+	bool prune = (int)generation + 1 == myIterations && !myKept.all();
+	std::vector<double> scratch;
+	ModuleString::size_type check = BUDGET_CHECK_MODULES;
+	for( ModuleString::size_type i = 0; i < current.size(); ++i ) {
+		if( i >= check ) {
+			check = i + BUDGET_CHECK_MODULES;
+			if( !withinBudget( next.size(),
+					current.memoryUsed() + next.memoryUsed(), generation + 1 ) ) {
+				return false;
+			}
+		}
+
+		// Modules no production rewrites, most of a late generation, are
+		// copied through a run at a time.
+		ModuleString::size_type end = myProductionSet.passThrough( current, i );
+		if( end > i ) {
+			if( prune ) {
+				next.append( current, i, end, myKept );
+			} else {
+				next.append( current, i, end );
+			}
+			i = end - 1;
+			continue;
+		}
+
+		if( prune ) {
+			ProductionSet::apply( current, i, myProductionSet.match( current.name( i ),
+					current.parameterCount( i ), generation, i ),
+				myGlobals, next, myKept, scratch );
+		} else {
+			myProductionSet.evaluate( current, i, myGlobals, next, generation );
+		}
+	}
+	return withinBudget( next.size(), current.memoryUsed() + next.memoryUsed(),
+		generation + 1 );
+}
+
+bool Parser::evaluateGenerationParallel( const ModuleString &current,
+	ModuleString &next, unsigned int generation, unsigned int threads )
+{
+	const ModuleString::size_type size = current.size();
+	std::vector<Production *> matches( size );
+	std::vector<ModuleString::size_type> offsets( threads + 1, 0 );
+	std::vector<ModuleString::size_type> parameterOffsets( threads + 1, 0 );
+
+	///////////////////////////////////////////////////////////////////////////
+	// Pass one: pick the production for every module and count how many
+	// modules and parameters each chunk will produce.  The production has
+	// to be picked up front so a stochastic choice doesn't change between
+	// the passes.
+	runChunks( threads, [&]( unsigned int c ) {
+		ModuleString::size_type begin = size * c / threads;
+		ModuleString::size_type end = size * ( c + 1 ) / threads;
+		ModuleString::size_type count = 0;
+		ModuleString::size_type parameters = 0;
+		for( ModuleString::size_type i = begin; i < end; ++i ) {
+			matches[i] = myProductionSet.match( current.name( i ),
+				current.parameterCount( i ), generation, i );
+			count += ProductionSet::successorCount( matches[i] );
+			parameters += ProductionSet::parameterCount( matches[i],
+				current.parameterCount( i ) );
+		}
+		offsets[c + 1] = count;
+		parameterOffsets[c + 1] = parameters;
+	} );
+
+	///////////////////////////////////////////////////////////////////////////
+	// Prefix sum the counts into the offsets each chunk starts writing at.
+	for( unsigned int c = 0; c < threads; ++c ) {
+		offsets[c + 1] += offsets[c];
+		parameterOffsets[c + 1] += parameterOffsets[c];
+	}
+	if( !withinBudget( offsets[threads], current.memoryUsed()
+			+ ModuleString::memoryNeeded( offsets[threads], parameterOffsets[threads] ),
+			generation + 1 ) ) {
+		return false;
+	}
+	next.resize( offsets[threads], parameterOffsets[threads] );
+
+	///////////////////////////////////////////////////////////////////////////
+	// Pass two: every chunk writes its successors into its own slice.
+	runChunks( threads, [&]( unsigned int c ) {
+		ModuleString::size_type begin = size * c / threads;
+		ModuleString::size_type end = size * ( c + 1 ) / threads;
+		ModuleString::size_type index = offsets[c];
+		ModuleString::size_type offset = parameterOffsets[c];
+		for( ModuleString::size_type i = begin; i < end; ++i ) {
+			if( !matches[i] ) {
+				ModuleString::size_type run = i + 1;
+				while( run < end && !matches[run] ) {
+					++run;
+				}
+				next.assign( index, offset, current, i, run );
+				index += run - i;
+				offset += current.parameterOffset( run ) - current.parameterOffset( i );
+				i = run - 1;
+				continue;
+			}
+			ProductionSet::apply( current, i, matches[i], myGlobals,
+				next, index, offset );
+			index += ProductionSet::successorCount( matches[i] );
+			offset += ProductionSet::parameterCount( matches[i],
+				current.parameterCount( i ) );
+		}
+	} );
+
+	// Chunks write to offsets counted before pruning, so the last
+	// generation is filtered once it is whole.
+	if( (int)generation + 1 == myIterations && !myKept.all() ) {
+		next.filter( 0, myKept );
+	}
+	return true;
+}
+
+bool Parser::withinBudget( double modules, double bytes, unsigned int generation ) {
+	double seconds = 0.0;
+	if( myBudget.maxSeconds > 0.0 ) {
+		seconds = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - myStartTime ).count();
+	}
+	bool overModules = myBudget.maxModules != 0 && modules > myBudget.maxModules;
+	bool overBytes = myBudget.maxBytes != 0 && bytes > myBudget.maxBytes;
+	bool overTime = myBudget.maxSeconds > 0.0 && seconds > myBudget.maxSeconds;
+	bool cancelled = myCancel && *myCancel;
+	if( !overModules && !overBytes && !overTime && !cancelled ) {
+		return true;
+	}
+
+	std::ostringstream msg;
+	msg << std::fixed << std::setprecision( 0 );
+	if( cancelled ) {
+		msg << "it was cancelled.";
+	} else if( overModules ) {
+		msg << "generation " << generation << " has " << modules
+			<< " modules, more than the limit of " << myBudget.maxModules << ".";
+	} else if( overBytes ) {
+		msg << "generation " << generation << " needs " << bytes
+			<< " bytes, more than the limit of " << myBudget.maxBytes << ".";
+	} else {
+		msg << std::setprecision( 3 ) << "it took " << seconds
+			<< " seconds, more than the limit of " << myBudget.maxSeconds << ".";
+	}
+	myBudgetMessage = msg.str();
+	return false;
+}
 
 //L-System => StartState Production { Production } EndOfFile
 void Parser::parseLSystem() {
@@ -129,7 +544,24 @@ void Parser::parseLSystem() {
 	//Start anew
 	myProductionSet.clear();
 	myStartList.clear();
+	myGlobals.clear();
+	myGlobalSlots.clear();
+	myModels.clear();
 	myIterations = 0;
+	myGrammar.reset();
+	myCached = false;
+
+	////////////////////////////////////
+	// Load it instead if it was parsed before.
+	if( !myCacheDirectory.empty() ) {
+		CompiledGrammarPtr grammar = GrammarCache( myCacheDirectory ).load(
+			myScanner.getText() );
+		if( grammar ) {
+			setGrammar( grammar );
+			myCached = true;
+			return;
+		}
+	}
 
 	////////////////////////////////////
 	// Parse the initial states.
@@ -148,89 +580,157 @@ void Parser::parseLSystem() {
 
 	/////////////////////////////////////////////////////////////
 	// Now we should be at the end of the l-system
-	Token *tok = myScanner.lex();
-	if( tok->getType() != Token::END_OF_FILE ) {
-		std::string a = tok->getAttribute();
-		delete tok;
+	Lexeme tok = myScanner.lex();
+	if( tok.getType() != Token::END_OF_FILE ) {
+		std::string a( tok.getAttribute() );
 		throw SCANNER_ERROR( "Error: Expected end of file, got: " + a );
 	}
-	delete tok;
 	
 	////////////////////////////////////////////////////////////
 	// Normalize the probabilities
 	myProductionSet.normalize();
+
+	////////////////////////////////////////////////////////////
+	// Optimize the successors now that the globals are known.
+	myEliminatedInstructions = myProductionSet.optimize( myGlobals );
+	LDEBUG( std::cout << "Optimizer eliminated " << myEliminatedInstructions << " instructions"; )
+
+	////////////////////////////////////////////////////////////
+	// Build the dispatch table used to match modules.
+	myProductionSet.compile();
+
+	////////////////////////////////////////////////////////////
+	// Freeze it all for whoever derives it from other threads.
+	myGrammar = std::make_shared<const CompiledGrammar>( myProductionSet,
+		myGlobals, myGlobalSlots, myModels, myStartList, myIterations );
+
+	////////////////////////////////////////////////////////////
+	// A cache that can't be written only costs the next parse.
+	if( !myCacheDirectory.empty() ) {
+		try {
+			GrammarCache( myCacheDirectory ).store( myScanner.getText(), *myGrammar );
+		} catch ( Error *e ) {
+			LDEBUG( std::cout << e->getMsg(); )
+			delete e;
+		}
+	}
+}
+
+void Parser::setGrammar( CompiledGrammarPtr grammar ) {
+	unsigned long long seed = myProductionSet.getSeed();
+	myProductionSet = grammar->getProductions();
+	myProductionSet.setSeed( seed );
+	myGlobals = grammar->getGlobals();
+	myGlobalSlots = grammar->getGlobalSlots();
+	myModels = grammar->getModels();
+	myStartList = grammar->getStart();
+	myIterations = grammar->getIterations();
+	myEliminatedInstructions = 0;
+	myCached = false;
+	myGrammar = grammar;
+}
+
+void Parser::parseStart() {
+	myProductionSet.clear();
+	myStartList.clear();
+	myGlobals.clear();
+	myGlobalSlots.clear();
+	myModels.clear();
+	myIterations = 0;
+	myGrammar.reset();
+	myCached = false;
+
+	if( !parseStartState() ) {
+		throw SCANNER_ERROR("Lush requires there to be a start state.");
+	}
+	Lexeme tok = myScanner.lex();
+	if( tok.getType() != Token::END_OF_FILE ) {
+		std::string a( tok.getAttribute() );
+		throw SCANNER_ERROR( "Error: Expected end of file, got: " + a );
+	}
+}
+
+void Parser::parseProductions( const SymbolFrame &globals, const SlotTable &globalSlots ) {
+	myProductionSet.clear();
+	myGlobals = globals;
+	myGlobalSlots = globalSlots;
+	myGrammar.reset();
+	myCached = false;
+
+	while( parseProduction() ) { }
+	Lexeme tok = myScanner.lex();
+	if( tok.getType() != Token::END_OF_FILE ) {
+		std::string a( tok.getAttribute() );
+		throw SCANNER_ERROR( "Error: Expected end of file, got: " + a );
+	}
+	myEliminatedInstructions = myProductionSet.optimize( myGlobals );
 }
 
 //StartState => { (Globals | ModelMaps) } Iterations ';' StartModules ';'
 bool Parser::parseStartState() {
 	LDEBUG( std::cout << "In start state"; )
-	Token *tok;
+	Lexeme tok;
 	while( !parseIterations() ) {
 		tok = myScanner.lex();	
-		if( tok->getType() == Token::IDENTIFIER ) {
-			std::string globalIdent = tok->getAttribute();
-			delete tok;
+		if( tok.getType() == Token::IDENTIFIER ) {
+			std::string globalIdent( tok.getAttribute() );
 			tok = myScanner.lex();
-			if( tok->getType() != Token::PUNCTUATION || tok->getAttribute() != ":" ) {
-				delete tok;
+			if( !tok.isPunctuation( ":" ) ) {
 				throw SCANNER_ERROR("Invalid global assignment. Looks like you forgot the ':'.");
 			}
-			delete tok;
 			Expression *e = Expression::parseExpression( myScanner );
-			myGlobals[ globalIdent ] = e->evaluateExpression( myGlobals );
+			compileExpression( e, IdentVec() );
+			double value = e->evaluate( NULL, myGlobals.data() );
 			delete e;
+			// A global may be assigned again, later uses see the new value.
+			SlotTable::iterator slot = myGlobalSlots.find( globalIdent );
+			if( slot == myGlobalSlots.end() ) {
+				myGlobalSlots[ globalIdent ] = myGlobals.size();
+				myGlobals.push_back( value );
+			} else {
+				myGlobals[ slot->second ] = value;
+			}
 			tok = myScanner.lex();
-			if( tok->getType() != Token::PUNCTUATION || tok->getAttribute() != ";" ) {
-				delete tok;
+			if( !tok.isPunctuation( ";" ) ) {
 				throw SCANNER_ERROR("Invalid global assigment. Looks like you forgot a ';' somewhere.");
 			}
-			delete tok;	
-		} else if( tok->getType() == Token::PRODUCTION ) {
-			char model = tok->getAttribute()[0];
-			delete tok;
+		} else if( tok.getType() == Token::PRODUCTION ) {
+			char model = tok.getAttribute()[0];
 			tok = myScanner.lex();
-			if( tok->getType() != Token::PUNCTUATION || tok->getAttribute() != ":" ) {
-				delete tok;
+			if( !tok.isPunctuation( ":" ) ) {
 				throw SCANNER_ERROR("Invalid model assignment. Looks like you forgot the ':'.");
 			}
-			delete tok;
 			tok = myScanner.lex();
-			if( tok->getType() != Token::INT ) {
-				delete tok;
+			if( tok.getType() != Token::INT ) {
 				throw SCANNER_ERROR("Invalid model assignment. You need an INTEGER after the ':'.");
 			}
-			int value = atoi( tok->getAttribute().c_str() );
-			delete tok;
+			int value = parseInt( tok.getAttribute() );
 			myModels[ model ] = value;
 			tok = myScanner.lex();
-			if( tok->getType() != Token::PUNCTUATION || tok->getAttribute() != ";" ) {
-				delete tok;
+			if( !tok.isPunctuation( ";" ) ) {
 				throw SCANNER_ERROR("Invalid model assignment.  Looks like you forgot a ';' somwhere.");
 			}
-			delete tok;
 		} else {
 			throw SCANNER_ERROR("An lsystem needs to start with: 'iterations: <INT>;'");
 		}
 	}
 	tok = myScanner.lex();
-	if( tok->getType() != Token::PUNCTUATION || tok->getAttribute() != ";" ) {
-		std::string a = tok->getAttribute();
+	if( !tok.isPunctuation( ";" ) ) {
+		std::string a( tok.getAttribute() );
 		myScanner.unlex( tok );
 		throw SCANNER_ERROR( "Error: Expected a ';' but got '" + a + "' instead.");
 	}
-	delete tok;
 	if( !parseStartModules() ) {
 		throw SCANNER_ERROR("An lsystem needs to have a list of start modules following the iterations line.");
 	}
 
 	tok = myScanner.lex();
-	if( tok->getType() != Token::PUNCTUATION || tok->getAttribute() != ";" ) {
-		std::string a = tok->getAttribute();
+	if( !tok.isPunctuation( ";" ) ) {
+		std::string a( tok.getAttribute() );
 		myScanner.unlex( tok );
 		throw SCANNER_ERROR( "Error: Expected a ';' but got '" + a + "' instead.");
 	}
 	LDEBUG( std::cout << "Finished start state"; )
-	delete tok;
 
 	return true;
 }
@@ -238,55 +738,51 @@ bool Parser::parseStartState() {
 //Iterations => 'iterations:' Integer
 bool Parser::parseIterations() {
 	
-	Token *tok = myScanner.lex();
-	if( tok->getType() != Token::IDENTIFIER || tok->getAttribute() != "iterations" ) {
+	Lexeme tok = myScanner.lex();
+	if( tok.getType() != Token::IDENTIFIER || tok.getAttribute() != "iterations" ) {
 		/////////////////////////////////////////////////////////////////////////////
 		// Not an interations line.
 		myScanner.unlex( tok );
 		return false;
 	}
-	delete tok;
 
 	tok = myScanner.lex();
 
-	if( tok->getType() != Token::PUNCTUATION || tok->getAttribute() != ":" ) {
+	if( !tok.isPunctuation( ":" ) ) {
 		////////////////////////////////////////////////////////////////////////////
 		// Invalid Iterations line.
-		std::string a = tok->getAttribute();
+		std::string a( tok.getAttribute() );
 		myScanner.unlex( tok );
 		throw SCANNER_ERROR( "Error: Expected ':' after 'iterations' but got '" + a + "' instead.");
 	}
-	delete tok;
 	tok = myScanner.lex();
 
-	if( tok->getType() != Token::INT ) {
+	if( tok.getType() != Token::INT ) {
 		////////////////////////////////////////////////////////////////////////////
 		// Invalid Iterations line.
-		std::string a = tok->getAttribute();
+		std::string a( tok.getAttribute() );
 		myScanner.unlex( tok );
 		throw SCANNER_ERROR( "Error: Expected an integer after 'iterations:' but got '" + a + "' instead.");
 	}
-	myIterations = atoi( tok->getAttribute().c_str() );
+	myIterations = parseInt( tok.getAttribute() );
 	
-	LDEBUG( std::cout << "Iterations read as: " << tok->getAttribute(); )
+	LDEBUG( std::cout << "Iterations read as: " << tok.getAttribute(); )
 	LDEBUG( std::cout << "Iterations set to: " << myIterations; )
 	
-	delete tok;
 	return true;
 }
 
 //StartRule => Module { Module } 
 bool Parser::parseStartModules() {
-	Token *tok = myScanner.lex();
-	std::string resultName = tok->getAttribute();
-	if( tok->getType() != Token::PRODUCTION  && 
+	Lexeme tok = myScanner.lex();
+	char resultName = tok.getAttribute()[0];
+	if( tok.getType() != Token::PRODUCTION  && 
 		///////////////////////////////////////////////////////////////////////////
 		// Not a start rule.
-		tok->getType() != Token::TRANSFORMATION ) {
+		tok.getType() != Token::TRANSFORMATION ) {
 		myScanner.unlex( tok );
 		return false;
 	}
-	delete tok;
 
 	//////////////////////////////////////////////////////////////////////////////
 	// Parse the ExpressionList.
@@ -294,9 +790,10 @@ bool Parser::parseStartModules() {
 	parseExpressionList( myEV );
 	Module mod;
 
-	mod.name = resultName[0];
+	mod.name = resultName;
 	for( ExpressionPtrVec::size_type i = 0; i < myEV.size(); ++i) {
-		double d = myEV[i]->evaluateExpression( myGlobals );
+		compileExpression( myEV[i], IdentVec() );
+		double d = myEV[i]->evaluate( NULL, myGlobals.data() );
 		delete myEV[i];
 		mod.parameters.push_back(d);
 	}
@@ -314,34 +811,30 @@ bool Parser::parseStartModules() {
 
 //NumberList => '(' Number { ',' Number } ')'
 bool Parser::parseNumberList( NumberVec &numberList ) {
-	Token *tok = myScanner.lex();
-	if( tok->getType() != Token::START_PARENS ) {
+	Lexeme tok = myScanner.lex();
+	if( tok.getType() != Token::START_PARENS ) {
 		////////////////////////////////////////////////////////////////////////
 		// Not a Number List
 		myScanner.unlex( tok );
 		return false;
 	}
-	delete tok;
 	tok = myScanner.lex();
 
 	/////////////////////////////////////////////////////////////////////////////
 	// We got a start parens, let's look for all the number seperated by commas
 	// that we can find.  booya.  End it on an end parenthesis.
-	while( tok->getType() == Token::FLOAT || tok->getType() == Token::INT  ) { 
-		numberList.push_back( tok->getAttribute() );
-		delete tok;
+	while( tok.getType() == Token::FLOAT || tok.getType() == Token::INT  ) { 
+		numberList.push_back( std::string( tok.getAttribute() ) );
 		tok = myScanner.lex();
-		if( tok->getType() == Token::PUNCTUATION && tok->getAttribute() == "," ) {
-			delete tok;
+		if( tok.isPunctuation( "," ) ) {
 			tok = myScanner.lex();
 			continue;
-		} else if( tok->getType() == Token::END_PARENS ) {
-			delete tok;
+		} else if( tok.getType() == Token::END_PARENS ) {
 			break;
 		} else {
 			//////////////////////////////////////////////////////////////////////
 			// Error within a number list.
-			std::string a = tok->getAttribute();
+			std::string a( tok.getAttribute() );
 			myScanner.unlex( tok );
 			throw SCANNER_ERROR("Error: expected either a number or an end parens, got: '"+a+"' instead.");
 		}
@@ -351,14 +844,13 @@ bool Parser::parseNumberList( NumberVec &numberList ) {
 
 //ExpressionList => '(' Expression { ',' Expression } ')'
 bool Parser::parseExpressionList( ExpressionPtrVec &exprList ) {
-	Token *tok = myScanner.lex();
-	if( tok->getType() != Token::START_PARENS ) {
+	Lexeme tok = myScanner.lex();
+	if( tok.getType() != Token::START_PARENS ) {
 		/////////////////////////////////////////////////////////////////////////
 		// Not an Expression List
 		myScanner.unlex( tok );
 		return false;
 	}
-	delete tok;
 	
 	/////////////////////////////////////////////////////////////////////////////
 	// Must have at least one Expression.
@@ -369,8 +861,7 @@ bool Parser::parseExpressionList( ExpressionPtrVec &exprList ) {
 	
 	/////////////////////////////////////////////////////////////////////////////
 	// Let's find all the expressions that we can find followed by commas.  booya
-	while( tok->getType() == Token::PUNCTUATION && tok->getAttribute() == "," ) {
-		delete tok;
+	while( tok.isPunctuation( "," ) ) {
 		expression = Expression::parseExpression( myScanner );
 		exprList.push_back( expression );	
 		tok = myScanner.lex();
@@ -378,12 +869,11 @@ bool Parser::parseExpressionList( ExpressionPtrVec &exprList ) {
 	
 	/////////////////////////////////////////////////////////////////////////////
 	// End it with an end parens.
-	if( tok->getType() != Token::END_PARENS ) {
-		std::string a = tok->getAttribute();
+	if( tok.getType() != Token::END_PARENS ) {
+		std::string a( tok.getAttribute() );
 		myScanner.unlex( tok );
 		throw SCANNER_ERROR( "Error: Expected a ')' but got: '"+a+"' instead.");
 	}
-	delete tok;
 
 	return true;
 }
@@ -399,30 +889,27 @@ bool Parser::parseProduction() {
 		return false;
 	}
 	
-	Token *tok = myScanner.lex();
-	std::string fl = "1.0";
+	Lexeme tok = myScanner.lex();
+	double probability = 1.0;
 	////////////////////////////////////////////////////////////////////////////
 	// Grab the probability if it's there.
-	if( tok->getType() == Token::PUNCTUATION && tok->getAttribute() == ":" ) {
-		delete tok;
+	if( tok.isPunctuation( ":" ) ) {
 		tok = myScanner.lex();
-		if( tok->getType() != Token::FLOAT ) {
-			std::string a = tok->getAttribute();
+		if( tok.getType() != Token::FLOAT ) {
+			std::string a( tok.getAttribute() );
 			myScanner.unlex( tok );
 			throw SCANNER_ERROR( "Error: did not include a probability with rule: "+rulename+".");
 		}
-		fl = tok->getAttribute();
-		delete tok;
+		probability = parseDouble( tok.getAttribute() );
 		tok = myScanner.lex();
 	}  
 	///////////////////////////////////////////////////////////////////////////
 	// Match the '=>' token.
-	if( tok->getType() != Token::PUNCTUATION || tok->getAttribute() != "=>" ) {
-		std::string a = tok->getAttribute();
+	if( !tok.isPunctuation( "=>" ) ) {
+		std::string a( tok.getAttribute() );
 		myScanner.unlex( tok );
 		throw SCANNER_ERROR( "Error: rule: "+rulename+" missing '=>' got '"+a+"'.");
 	} 
-	delete tok;
 	
 	SuccessorVec successorList;
 	if( !parseSuccessorList( successorList ) ) {
@@ -431,35 +918,42 @@ bool Parser::parseProduction() {
 
 	LDEBUG( std::cout << successorList.size(); )
 
-	Production prod( rulename, atof(fl.c_str()) );
+	////////////////////////////////////////////////////////////////////////////
+	// Resolve every identifier in the successors to a parameter or a global.
+	for( SuccessorVec::size_type s = 0; s < successorList.size(); ++s ) {
+		const ExpressionPtrVec &ev = successorList[s].getExpressionPtrVec();
+		for( ExpressionPtrVec::size_type e = 0; e < ev.size(); ++e ) {
+			compileExpression( ev[e], identList );
+		}
+	}
+
+	Production prod( rulename, probability );
 	prod.setSuccessorVec( successorList );
 	prod.setIdentVec( identList );
 
 	tok = myScanner.lex();
-	if( tok->getType() != Token::PUNCTUATION || tok->getAttribute() != ";" ) {
-		std::string a = tok->getAttribute();
+	if( !tok.isPunctuation( ";" ) ) {
+		std::string a( tok.getAttribute() );
 		myScanner.unlex( tok );
 		throw SCANNER_ERROR("Error: expecting a ';' got '"+a+"' instead.");
 	}
 	std::ostringstream out;
 	out << rulename << identList.size();
 	myProductionSet.push_back( prod );
-	LDEBUG( std::cout << "Adding rule[" << rulename << "] with probability[" << fl << "]"; )
-	delete tok;	
+	LDEBUG( std::cout << "Adding rule[" << rulename << "] with probability[" << probability << "]"; )
 	return true;
 }
 
 //Predecessor => Module IdentifierList
 bool Parser::parsePredecessor( std::string &name, IdentVec &identList ) {
-	Token *tok = myScanner.lex();
-	if( tok->getType() != Token::PRODUCTION ) {
+	Lexeme tok = myScanner.lex();
+	if( tok.getType() != Token::PRODUCTION ) {
 		//////////////////////////////////////////////////////////////////////////////
 		// Not a Predecessor.
 		myScanner.unlex( tok );
 		return false;
 	}
-	name = tok->getAttribute();
-	delete tok;
+	name = tok.getAttribute();
 	
 	parseIdentifierList( identList );
 	return true;
@@ -483,16 +977,15 @@ bool Parser::parseSuccessorList( SuccessorVec &successorList ) {
 
 //Successor => ModuleName ExpressionList
 bool Parser::parseSuccessor( std::string &name, ExpressionPtrVec &expressionList ) {
-	Token *tok = myScanner.lex();
-	if( tok->getType() != Token::PRODUCTION ) {
+	Lexeme tok = myScanner.lex();
+	if( tok.getType() != Token::PRODUCTION ) {
 		/////////////////////////////////////////////////////////////////////////////////////
 		// Not a Successor.
 		myScanner.unlex( tok );
 		return false;
 	}
 
-	name = tok->getAttribute();
-	delete tok;
+	name = tok.getAttribute();
 
 	parseExpressionList( expressionList );
 	
@@ -501,41 +994,46 @@ bool Parser::parseSuccessor( std::string &name, ExpressionPtrVec &expressionList
 
 //IdentifierList => '(' Identifier { ',' Identifier } ')'
 bool Parser::parseIdentifierList( IdentVec &identList ) {
-	Token *tok = myScanner.lex();
-	if( tok->getType() != Token::START_PARENS ) {
+	Lexeme tok = myScanner.lex();
+	if( tok.getType() != Token::START_PARENS ) {
 		/////////////////////////////////////////////////////////////////////
 		// Not an IdentifierList.
 		myScanner.unlex(tok);
 		return false;
 	}
-	delete tok;
 	tok = myScanner.lex();
-	if( tok->getType() != Token::IDENTIFIER ) {
-		std::string err = "Error: Expected an identifier for the identifier list got '"+tok->getAttribute()+"'.";
+	if( tok.getType() != Token::IDENTIFIER ) {
+		std::string err = "Error: Expected an identifier for the identifier list got '"+std::string( tok.getAttribute() )+"'.";
 		myScanner.unlex(tok);
 		throw SCANNER_ERROR( err );
 	}
-	identList.push_back( tok->getAttribute() );
-	delete tok;
+	identList.push_back( std::string( tok.getAttribute() ) );
 	tok = myScanner.lex();
-	while( tok->getType() == Token::PUNCTUATION && tok->getAttribute() == "," ) {
-		delete tok;
+	while( tok.isPunctuation( "," ) ) {
 		tok = myScanner.lex();
-		if( tok->getType() != Token::IDENTIFIER ) {
-			std::string err = "Error: Expected an identifier for the identifier list got '"+tok->getAttribute()+"'.";
+		if( tok.getType() != Token::IDENTIFIER ) {
+			std::string err = "Error: Expected an identifier for the identifier list got '"+std::string( tok.getAttribute() )+"'.";
 			myScanner.unlex(tok);
 			throw SCANNER_ERROR( err );
 		}
 
-		identList.push_back( tok->getAttribute() );	
-		delete tok;
+		identList.push_back( std::string( tok.getAttribute() ) );	
 		tok = myScanner.lex();
 	}
-	if( tok->getType() != Token::END_PARENS ) {
-		std::string a = tok->getAttribute();
+	if( tok.getType() != Token::END_PARENS ) {
+		std::string a( tok.getAttribute() );
 		myScanner.unlex( tok );
 		throw SCANNER_ERROR( "Error: Expected a ')' but got: '"+a+"' instead.");
 	}
-	delete tok;
 	return true;
 }
+
+void Parser::compileExpression( Expression *e, const IdentVec &params ) {
+	try {
+		e->compile( params, myGlobalSlots );
+	} catch( Error *err ) {
+		std::string msg = err->getMsg();
+		delete err;
+		throw SCANNER_ERROR( msg );
+	}
+}
@@ -24,8 +24,22 @@
 #include "successor.h"
 #include "production.h"
 #include "productionset.h"
+#include "modulestream.h"
+#include "expansiondag.h"
+#include "growthmatrix.h"
+#include "moduleindex.h"
+#include "modulerope.h"
+#include "spillfile.h"
+#include "compressedstring.h"
+#include "compiledgrammar.h"
 #include "module.h"
 
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 
@@ -38,10 +52,29 @@ namespace LSystem {
 //==============================================================================
 typedef std::vector<Production> ProductionVec;
 typedef std::vector<std::string> NumberVec;
-typedef std::map<char, int> ModelMap;
 
 ///-----------------------------------------------------------------------------
-/// A class to parse an LSystem from an iostream using a recursive descent algo.
+/// Told by evaluateSystem() each time it finishes a generation: which one
+/// out of how many, and how many modules it has.
+///-----------------------------------------------------------------------------
+typedef std::function<void( int generation, int iterations,
+	ModuleString::size_type modules )> ProgressCallback;
+
+///-----------------------------------------------------------------------------
+/// Limits on how far evaluateSystem() may go.  0 means no limit.
+///-----------------------------------------------------------------------------
+struct DerivationBudget {
+	// The most modules any generation may have.
+	ModuleString::size_type maxModules;
+	// The most bytes the generations being rewritten may hold at once.
+	ModuleString::size_type maxBytes;
+	// The longest evaluateSystem() may take, in seconds.
+	double maxSeconds;
+};
+
+///-----------------------------------------------------------------------------
+/// A class to parse an LSystem from an iostream or a buffer using a recursive
+/// descent algo.
 ///
 /// @author Lakin Wecker aka nikal@nucleus.com
 ///
@@ -63,9 +96,27 @@ private:
 	LSystem::Scanner myScanner;
 	int myIterations;
 	ProductionSet myProductionSet;
-	ModuleVec myStartList;
-	SymbolTable myGlobals;
+	ModuleString myStartList;
+	// The value of each global, in the slot myGlobalSlots gives it.
+	SymbolFrame myGlobals;
+	SlotTable myGlobalSlots;
 	ModelMap myModels;
+	unsigned int myThreadCount;
+	unsigned int myEliminatedInstructions;
+	DerivationBudget myBudget;
+	// Where evaluateSystem() got to when it last ran out of budget, and why.
+	ModuleString myPartialResult;
+	int myCompletedIterations;
+	std::string myBudgetMessage;
+	std::chrono::steady_clock::time_point myStartTime;
+	ProgressCallback myProgress;
+	const std::atomic<bool> *myCancel;
+	CompiledGrammarPtr myGrammar;
+	// Where parsed grammars are saved, none if empty.
+	std::string myCacheDirectory;
+	bool myCached;
+	// The modules kept in the last generation, all of them by default.
+	std::bitset<256> myKept;
 	
 
 //==============================================================================
@@ -86,7 +137,52 @@ public:
 		myProductionSet(),
 		myStartList(),
 		myGlobals(),
-		myModels()
+		myGlobalSlots(),
+		myModels(),
+		myThreadCount( 1 ),
+		myEliminatedInstructions( 0 ),
+		myBudget(),
+		myPartialResult(),
+		myCompletedIterations( 0 ),
+		myBudgetMessage(),
+		myStartTime(),
+		myProgress(),
+		myCancel( NULL ),
+		myGrammar(),
+		myCacheDirectory(),
+		myCached( false ),
+		myKept( std::bitset<256>().set() )
+	{
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Creates a Parser reading text in place, which saves copying it when
+	/// it is already in memory, as a MappedFile or a string.  text only
+	/// needs to outlive parseLSystem().
+	///---------------------------------------------------------------------
+	Parser( std::string_view text )
+		:
+		myScanner( text ),
+		myIterations( 0 ),
+		myProductionSet(),
+		myStartList(),
+		myGlobals(),
+		myGlobalSlots(),
+		myModels(),
+		myThreadCount( 1 ),
+		myEliminatedInstructions( 0 ),
+		myBudget(),
+		myPartialResult(),
+		myCompletedIterations( 0 ),
+		myBudgetMessage(),
+		myStartTime(),
+		myProgress(),
+		myCancel( NULL ),
+		myGrammar(),
+		myCacheDirectory(),
+		myCached( false ),
+		myKept( std::bitset<256>().set() )
 	{
 	}
 
@@ -112,10 +208,324 @@ public:
 	void parseLSystem();
 
 
+	///---------------------------------------------------------------------
+	/// Parses text holding only the start state: the globals, models,
+	/// iterations and start modules.  Throws pointers to Error's on errors.
+	///
+	/// @see LSystem::LiveSystem
+	///---------------------------------------------------------------------
+	void parseStart();
+
+
+	///---------------------------------------------------------------------
+	/// Parses text holding only productions, compiling and optimizing each
+	/// against globals, which were parsed elsewhere, as parseLSystem()
+	/// would.  They are neither normalized nor compiled into a table, as
+	/// they are only part of an LSystem.  Throws pointers to Error's on
+	/// errors.
+	///
+	/// @see LSystem::LiveSystem
+	///---------------------------------------------------------------------
+	void parseProductions( const SymbolFrame &globals, const SlotTable &globalSlots );
+
+
+	///---------------------------------------------------------------------
+	/// Takes grammar, parsed elsewhere or earlier, as if parseLSystem()
+	/// had just parsed it.  The Parser keeps its own seed.
+	///---------------------------------------------------------------------
+	void setGrammar( CompiledGrammarPtr grammar );
+
+
 	///---------------------------------------------------------------------
 	/// Evaluate the system
+	///
+	/// If the budget runs out, or the derivation is cancelled, it stops
+	/// and a pointer to an Error saying why is thrown.  The last generation
+	/// completed is then left in getPartialResult().
+	///---------------------------------------------------------------------
+	ModuleString evaluateSystem();
+
+
+	///---------------------------------------------------------------------
+	/// Evaluate the system keeping every generation.  generations holds
+	/// generations 0 up to some k, as an earlier derivation of this system
+	/// left them, and generations k + 1 up to the last are derived from
+	/// generation k and appended.  Empty, it starts from the start modules.
+	///
+	/// Stops as evaluateSystem() does, in which case generations holds
+	/// every generation completed.
+	///---------------------------------------------------------------------
+	void evaluateSystem( std::vector<ModuleString> &generations );
+
+
+	///---------------------------------------------------------------------
+	/// Evaluate the system with seed, instead of the Parser's own, into
+	/// result, using scratch for the other generation.  Changes nothing
+	/// in the Parser, so several threads may derive different seeds of
+	/// one parsed system at once.  Derives serially, without a budget.
+	///
+	/// @see LSystem::CompiledGrammar::derive
+	///---------------------------------------------------------------------
+	void evaluateSystem( unsigned long long seed, ModuleString &result,
+		ModuleString &scratch ) const;
+
+
+	///---------------------------------------------------------------------
+	/// Evaluate the system out of core, for systems whose generations
+	/// don't fit in memory.  Each generation is read sequentially from a
+	/// spill file and the next written sequentially to another, a block
+	/// of modules at a time, so memory use stays bounded however large
+	/// the generations are.  The files are prefix.0 and prefix.1, the one
+	/// not holding the final generation is removed once done.  Gives the
+	/// same modules as evaluateSystem(), the budget isn't applied.
+	///
+	/// @return the path of the spill file holding the final generation,
+	///  to be read with a SpillReader.
+	///
+	/// @see LSystem::SpillReader
+	///---------------------------------------------------------------------
+	std::string spillSystem( const std::string &prefix );
+
+
+	///---------------------------------------------------------------------
+	/// Evaluate the system with every generation held compressed, for
+	/// systems whose generations fit in memory compressed but not as a
+	/// ModuleString.  Each generation is decoded a block of modules at a
+	/// time, rewritten, and the result compressed into the next, so only
+	/// the two compressed generations and a block are ever held.  Gives
+	/// the same modules as evaluateSystem(), the budget isn't applied.
+	///
+	/// @return the final generation, to be read with a CompressedReader.
+	///
+	/// @see LSystem::CompressedString
+	///---------------------------------------------------------------------
+	CompressedString compressSystem();
+
+
+	///---------------------------------------------------------------------
+	/// Predicts the size of every generation evaluateSystem() would derive,
+	/// from the start modules up to the last, without deriving any.
+	///
+	/// @see LSystem::GrowthMatrix
+	///---------------------------------------------------------------------
+	std::vector<GenerationSize> predictSystem() const {
+		return GrowthMatrix( myProductionSet, myStartList ).predict( myIterations,
+			myKept );
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Evaluate the system lazily, depth first, without ever holding a
+	/// whole generation.  The returned stream refers to this Parser, so
+	/// the Parser must outlive it.
+	///
+	/// @see LSystem::ModuleStream
+	///---------------------------------------------------------------------
+	ModuleStream streamSystem();
+
+
+	///---------------------------------------------------------------------
+	/// Evaluate the system into a DAG in which every distinct expansion
+	/// is derived and stored once.  Much smaller and faster than
+	/// evaluateSystem() for deep deterministic systems.
+	///
+	/// @see LSystem::ExpansionDag
+	///---------------------------------------------------------------------
+	ExpansionDag expandSystem();
+
+
+	///---------------------------------------------------------------------
+	/// Evaluate the system as tasks on a work-stealing pool of
+	/// getThreadCount() threads, each deriving its subtrees depth first
+	/// into buffers of its own, which are kept as the segments of a rope
+	/// rather than copied together.
+	///
+	/// @see LSystem::ModuleRope
+	///---------------------------------------------------------------------
+	ModuleRope ropeSystem() const {
+		return ModuleRope( myProductionSet, myGlobals, myStartList, myIterations,
+			myThreadCount );
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Index the system so any module of any generation can be found
+	/// without deriving the generation.  Only for systems which pick no
+	/// production at random.  The returned index refers to this Parser,
+	/// so the Parser must outlive it.
+	///
+	/// @see LSystem::ModuleIndex
+	///---------------------------------------------------------------------
+	ModuleIndex indexSystem() const {
+		return ModuleIndex( myProductionSet, myGlobals, myStartList, myIterations );
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Sets how many threads evaluateSystem() rewrites each generation
+	/// with.  1 (the default) rewrites serially, 0 uses one thread per
+	/// hardware core.  Deterministic systems give the same result for
+	/// any thread count.
+	///---------------------------------------------------------------------
+	void setThreadCount( unsigned int threads ) {
+		myThreadCount = threads;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Gets the number of threads used by evaluateSystem().
+	///---------------------------------------------------------------------
+	unsigned int getThreadCount() const {
+		return myThreadCount;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Gets the LSystem parseLSystem() last parsed, frozen, to be shared
+	/// by threads deriving it.  Empty until an LSystem has been parsed.
+	///---------------------------------------------------------------------
+	CompiledGrammarPtr getGrammar() const {
+		return myGrammar;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Gets the directory parsed grammars are cached in, empty if none.
+	///---------------------------------------------------------------------
+	const std::string &getGrammarCache() const {
+		return myCacheDirectory;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Whether parseLSystem() last loaded its LSystem from the cache
+	/// instead of parsing it.
+	///---------------------------------------------------------------------
+	bool getCached() const {
+		return myCached;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Gets the number of iterations the LSystem asks for.
+	///---------------------------------------------------------------------
+	int getIterations() const {
+		return myIterations;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Sets what evaluateSystem() reports its progress to.  It is called
+	/// on the thread deriving.
+	///---------------------------------------------------------------------
+	void setProgress( ProgressCallback progress ) {
+		myProgress = progress;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Sets a flag which another thread can raise to stop evaluateSystem().
+	/// It stops as it would if out of budget, a few thousand modules
+	/// later, or at the next pass when deriving in parallel, throwing an
+	/// Error and keeping the last whole generation.  NULL, the default,
+	/// means it can't be cancelled.
+	///---------------------------------------------------------------------
+	void setCancel( const std::atomic<bool> *cancel ) {
+		myCancel = cancel;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Sets the directory of a GrammarCache parseLSystem() loads from, and
+	/// saves what it parses to.  The directory must exist.  Empty, the
+	/// default, turns caching off.
 	///---------------------------------------------------------------------
-	ModuleVec evaluateSystem();
+	void setGrammarCache( const std::string &directory ) {
+		myCacheDirectory = directory;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Sets the seed stochastic productions are picked with.  The same
+	/// seed always derives the same system, whichever of evaluateSystem(),
+	/// streamSystem(), expandSystem() or ropeSystem() is used and with any
+	/// number of threads.  The default is 0.
+	///---------------------------------------------------------------------
+	void setSeed( unsigned long long seed ) {
+		myProductionSet.setSeed( seed );
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Gets the seed stochastic productions are picked with.
+	///---------------------------------------------------------------------
+	unsigned long long getSeed() const {
+		return myProductionSet.getSeed();
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Sets the limits evaluateSystem() derives within.  None by default.
+	///---------------------------------------------------------------------
+	void setBudget( const DerivationBudget &budget ) {
+		myBudget = budget;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Gets the limits evaluateSystem() derives within.
+	///---------------------------------------------------------------------
+	const DerivationBudget &getBudget() const {
+		return myBudget;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Keeps only the modules named in names in the last generation
+	/// evaluateSystem() derives, dropping the others as it is written,
+	/// for a caller that only interprets the result.  Nothing is derived
+	/// from the last generation, so the modules kept are the same as
+	/// without pruning.  An empty string keeps every module, the default.
+	/// With no iterations the start modules are returned as they are.
+	///
+	/// parser.setKeptModules( TURTLE_MODULES );
+	///---------------------------------------------------------------------
+	void setKeptModules( const std::string &names ) {
+		myKept = names.empty() ? std::bitset<256>().set()
+			: ModuleString::nameSet( names );
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The last generation evaluateSystem() completed before it ran out
+	/// of budget, empty if it didn't.
+	///---------------------------------------------------------------------
+	const ModuleString &getPartialResult() const {
+		return myPartialResult;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The number of generations in getPartialResult().
+	///---------------------------------------------------------------------
+	int getCompletedIterations() const {
+		return myCompletedIterations;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Gets the number of bytecode instructions the optimizer removed
+	/// from the productions when the LSystem was parsed, those of their
+	/// expressions compiled alone against those of the combined code.
+	/// Constants used in place by an instruction were never instructions
+	/// of their own, so folding them doesn't count.  0 if the grammar was
+	/// loaded rather than parsed.
+	///
+	/// @see LSystem::ExpressionCode::combine
+	///---------------------------------------------------------------------
+	unsigned int getEliminatedInstructions() const {
+		return myEliminatedInstructions;
+	}
 
 
 	///---------------------------------------------------------------------
@@ -126,6 +536,46 @@ public:
 	}
 
 
+	///---------------------------------------------------------------------
+	/// The model ids set, by module.
+	///---------------------------------------------------------------------
+	const ModelMap &getModels() const {
+		return myModels;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The values of the globals, indexed by getGlobalSlots().
+	///---------------------------------------------------------------------
+	const SymbolFrame &getGlobals() const {
+		return myGlobals;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The slot of each global in getGlobals(), by name.
+	///---------------------------------------------------------------------
+	const SlotTable &getGlobalSlots() const {
+		return myGlobalSlots;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The modules derivation starts from.
+	///---------------------------------------------------------------------
+	const ModuleString &getStartList() const {
+		return myStartList;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The productions parsed.
+	///---------------------------------------------------------------------
+	const ProductionSet &getProductionSet() const {
+		return myProductionSet;
+	}
+
+
 	///---------------------------------------------------------------------
 	/// Model Lookup
 	///---------------------------------------------------------------------
@@ -138,6 +588,73 @@ public:
 // Private Methods
 //=================================================================;
 private:
+	//----------------------------------------------------------------------
+	// Internally used evaluation functions.
+	//----------------------------------------------------------------------
+
+
+	///---------------------------------------------------------------------
+	/// Starts the clock and clears the partial result for a derivation,
+	/// predicting the size of every generation if it can.
+	///
+	/// @return the number of threads to derive with.
+	///---------------------------------------------------------------------
+	unsigned int startDerivation( std::vector<GenerationSize> &predicted );
+
+
+	///---------------------------------------------------------------------
+	/// Rewrites current, which is generation generation, into next within
+	/// the budget, in parallel if it is big enough.
+	///
+	/// @return false if the budget ran out.
+	///---------------------------------------------------------------------
+	bool deriveGeneration( const ModuleString &current, ModuleString &next,
+		int generation, const std::vector<GenerationSize> &predicted,
+		unsigned int threads );
+
+
+	///---------------------------------------------------------------------
+	/// Throws the Error saying the derivation ran out of budget after
+	/// generation generations.
+	///---------------------------------------------------------------------
+	void stopDerivation( int generation );
+
+
+	///---------------------------------------------------------------------
+	/// Rewrites every module of current, which is generation generation,
+	/// into next, one module at a time.
+	///
+	/// @return false if the budget ran out part way.
+	///---------------------------------------------------------------------
+	bool evaluateGeneration( const ModuleString &current, ModuleString &next,
+		unsigned int generation );
+
+
+	///---------------------------------------------------------------------
+	/// Rewrites current into next using threads threads.  The generation
+	/// is split into one chunk per thread, each chunk counts how many
+	/// modules and parameters it produces, a prefix sum of the counts
+	/// gives each chunk its offsets, and then every chunk writes its
+	/// successors straight into next.
+	///
+	/// @return false if the counts are over budget, in which case next
+	///  is left alone.
+	///---------------------------------------------------------------------
+	bool evaluateGenerationParallel( const ModuleString &current,
+		ModuleString &next, unsigned int generation, unsigned int threads );
+
+
+	///---------------------------------------------------------------------
+	/// Checks a generation of modules modules, with bytes bytes held in
+	/// all, and the time taken so far against the budget, and whether
+	/// the derivation has been cancelled.
+	///
+	/// @return true if within budget, otherwise false with
+	///  myBudgetMessage saying why.
+	///---------------------------------------------------------------------
+	bool withinBudget( double modules, double bytes, unsigned int generation );
+
+
 	//----------------------------------------------------------------------
 	// Internally used Parsing functions.
 	//----------------------------------------------------------------------
@@ -203,6 +720,13 @@ private:
 	bool parseIdentifierList( IdentVec &identifierList );
 
 
+	///---------------------------------------------------------------------
+	/// Compiles e against the globals parsed so far and params, turning
+	/// an undefined identifier into a parse error at the current line.
+	///---------------------------------------------------------------------
+	void compileExpression( Expression *e, const IdentVec &params );
+
+
 
 //==============================================================================
 // Disabled constructors and operators
@@ -56,6 +56,11 @@ class Production
         double myProbability;
         IdentVec myIdentifierVec;
         SuccessorVec mySuccessorVec;
+		// Every parameter of every successor, made by compile().
+		ExpressionCode myCode;
+
+		// Saves and loads the production, code and all.
+		friend class GrammarCache;
 
     //======================================================================
     // Public Methods
@@ -73,7 +78,8 @@ class Production
 		myName( name ),
 		myProbability( prob ),
 		myIdentifierVec(),
-		mySuccessorVec()
+		mySuccessorVec(),
+		myCode()
     {
     }
 
@@ -97,6 +103,7 @@ class Production
 		myProbability = source.myProbability;
 		myIdentifierVec = source.myIdentifierVec;
 		mySuccessorVec = source.mySuccessorVec;
+		myCode = source.myCode;
 
         // Return this object with new value
         return *this;
@@ -147,6 +154,33 @@ class Production
 	IdentVec &getIdentVec() {
 		return myIdentifierVec;
 	}
+
+	/**
+	 * Combines the expressions of all the successors into one optimized
+	 * program, with the globals folded in.  The successors have to have
+	 * been compiled against the ident list and globals first.
+	 *
+	 * @return the number of instructions the optimizer eliminated.
+	 */
+	unsigned int compile( const SymbolFrame &globals ) {
+		std::vector<const ExpressionCode *> codes;
+		for( SuccessorVec::size_type n = 0; n < mySuccessorVec.size(); ++n ) {
+			const ExpressionPtrVec &ev = mySuccessorVec[n].getExpressionPtrVec();
+			for( ExpressionPtrVec::size_type e = 0; e < ev.size(); ++e ) {
+				codes.push_back( &ev[e]->getCode() );
+			}
+		}
+		return myCode.combine( codes, globals );
+	}
+
+	/**
+	 * Evaluates the parameters of all the successors, in order, into
+	 * out given the parameters of the module being rewritten.
+	 */
+	void evaluate( const double *params, const double *globals,
+			double *out ) const {
+		myCode.evaluate( params, globals, out );
+	}
     //----------------------------------------------------------------------
     // Setters
 
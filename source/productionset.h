@@ -23,14 +23,15 @@
 #include <map>
 #include <list>
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <bitset>
+#include <utility>
 
 #include "production.h"
 #include "module.h"
-
-/**
- * forward decl
- */
-double randdouble(double, double);
+#include "modulestring.h"
+#include "random.h"
 
 namespace LSystem {
 
@@ -46,8 +47,8 @@ namespace LSystem {
  * mySet.addProduction( Production( production3 ) );
  * mySet.addProduction( Production( production2 ) );
  * ...
- * Production *p = mySet.match( module ); //Randomly picks one.
- * p.evaluate( symTable );
+ * Production *p = mySet.match( name, arity, generation, index ); //Randomly picks one.
+ * p.evaluate( globals );
  *
  * @author Lakin Wecker aka nikal@nucleus.com
  *
@@ -61,7 +62,16 @@ namespace LSystem {
 //======================================================================
 typedef std::vector<Module> ModuleVec;
 typedef std::map<std::string, std::list<Production> > ProductionMap;
-typedef std::map<std::string, double> SymbolTable;
+
+/**
+ * One slot of the dispatch table, the candidate productions for one
+ * (module name, arity) pair are [first, first + count) in the flat
+ * candidate arrays.
+ */
+struct DispatchEntry {
+	unsigned int first;
+	unsigned int count;
+};
 
 class ProductionSet
 {
@@ -73,11 +83,29 @@ class ProductionSet
 
         ProductionMap myProductions;
 
+		// The productions compiled by compile() into a dense table indexed
+		// by ( name * myArityLimit + arity ).  myCandidates holds each
+		// entry's productions, and myKeep and myAlias their alias table.
+		std::vector<DispatchEntry> myDispatch;
+		std::vector<Production *> myCandidates;
+		std::vector<double> myKeep;
+		std::vector<unsigned int> myAlias;
+		ModuleString::size_type myArityLimit;
+		unsigned long long mySeed;
+
+		// Saves and loads the productions.
+		friend class GrammarCache;
+
     //======================================================================
     // Public Methods
     //======================================================================
     public:
 
+	/**
+	 * What matchSlot() gives for a module no production rewrites.
+	 */
+	static const unsigned int NO_CANDIDATE = ~0u;
+
     //----------------------------------------------------------------------
     // Constructors
 
@@ -86,7 +114,13 @@ class ProductionSet
      */
 	ProductionSet()
 		:
-		myProductions()
+		myProductions(),
+		myDispatch(),
+		myCandidates(),
+		myKeep(),
+		myAlias(),
+		myArityLimit( 0 ),
+		mySeed( 0 )
 	{
     }
 
@@ -100,14 +134,45 @@ class ProductionSet
 		*this = source;
 	}
 
+	/**
+	* Move constructor.  Moving the map keeps every production where it
+	* is, so the table can come along instead of being compiled again.
+	*/
+	ProductionSet( ProductionSet &&source )
+		:
+		myProductions( std::move( source.myProductions ) ),
+		myDispatch( std::move( source.myDispatch ) ),
+		myCandidates( std::move( source.myCandidates ) ),
+		myKeep( std::move( source.myKeep ) ),
+		myAlias( std::move( source.myAlias ) ),
+		myArityLimit( source.myArityLimit ),
+		mySeed( source.mySeed )
+	{
+		source.clear();
+	}
+
 
 	/**
 	* Assignment operator.
 	*/
 	ProductionSet &operator= ( const ProductionSet &source )
 	{
+		// Clearing the table below would lose our own.
+		if( this == &source ) {
+			return *this;
+		}
 		//out with the old, in with the new.
 		myProductions = source.myProductions;
+		mySeed = source.mySeed;
+		// The table points at our own productions, so it can't be copied.
+		myDispatch.clear();
+		myCandidates.clear();
+		myKeep.clear();
+		myAlias.clear();
+		myArityLimit = 0;
+		if( !source.myDispatch.empty() ) {
+			compile();
+		}
 		// Return this object with new value
 		return *this;
 	}
@@ -130,62 +195,294 @@ class ProductionSet
 	 * Matches and then subsequently evaluates the Module against
 	 * the productions, just returns a copy of the module itself 
 	 * if no match is found.
-	 * 
+	 *
+	 * Kept for code that still works with a ModuleVec, it allocates a
+	 * new vector every call.  The evaluate()s appending to a ModuleString
+	 * are what derivation uses.
 	 */
-	const ModuleVec evaluate( const Module &mod, SymbolTable table ) {
-		std::ostringstream outName;
-		outName << mod.name << mod.parameters.size();
-		ProductionMap::iterator iter = myProductions.find( outName.str() );
-		ModuleVec ret;
+	const ModuleVec evaluate( const Module &mod, const SymbolFrame &globals,
+			unsigned int generation = 0, ModuleString::size_type index = 0 ) {
+		ModuleString out;
+		evaluate( mod, globals, out, generation, index );
+		return out.toModuleVec();
+	}
+
+	/**
+	 * Matches mod, module index of generation generation, against the
+	 * productions and appends its successors to out, or a copy of the
+	 * module if no match is found.
+	 *
+	 * Nothing is allocated once out has grown to hold what is appended,
+	 * so a buffer that is clear()ed and reused rewrites without touching
+	 * the heap.
+	 */
+	void evaluate( const Module &mod, const SymbolFrame &globals,
+			ModuleString &out, unsigned int generation,
+			ModuleString::size_type index ) {
+		ModuleString::size_type arity = mod.parameters.size();
+		apply( mod.name, mod.parameters.data(), arity,
+			match( mod.name, arity, generation, index ), globals, out );
+	}
+
+	/**
+	 * Matches module i of in, which is the whole of generation generation,
+	 * against the productions and appends its successors to out, or a
+	 * copy of the module if no match is found.  Like the Module version
+	 * this doesn't allocate once out has room.
+	 */
+	void evaluate( const ModuleString &in, ModuleString::size_type i,
+			const SymbolFrame &globals, ModuleString &out,
+			unsigned int generation ) {
+		apply( in, i, match( in.name( i ), in.parameterCount( i ), generation, i ),
+			globals, out );
+	}
+
+	/**
+	 * Finds the production which will rewrite a module named name with
+	 * arity parameters, randomly picking one if there are several with
+	 * the same predecessor.  The random draw depends only on the seed
+	 * and on where the module is, module index of generation generation
+	 * counting the start modules as generation 0, so a derivation comes
+	 * out the same however its modules are visited.
+	 *
+	 * @return the chosen Production, or NULL if no production matches
+	 *  and the module is simply copied through.
+	 */
+	Production *match( char name, ModuleString::size_type arity,
+			unsigned int generation, ModuleString::size_type index ) {
+		return match( name, arity, mySeed, generation, index );
+	}
+
+	/**
+	 * Like match() above, drawing with seed instead of the set's own.
+	 * Changes nothing, so one ProductionSet can derive several seeds
+	 * on several threads at once.
+	 */
+	Production *match( char name, ModuleString::size_type arity,
+			unsigned long long seed, unsigned int generation,
+			ModuleString::size_type index ) const {
+		unsigned int slot = matchSlot( name, arity, seed, generation, index );
+		return slot == NO_CANDIDATE ? NULL : myCandidates[ slot ];
+	}
+
+	/**
+	 * Like match(), but gives where the production is in the table, for
+	 * candidate( slot ), or NO_CANDIDATE.  Slots are the same in every
+	 * set compiled from the same productions in the same order, so they
+	 * can be kept when the set is parsed again, as pointers can't.
+	 */
+	unsigned int matchSlot( char name, ModuleString::size_type arity,
+			unsigned long long seed, unsigned int generation,
+			ModuleString::size_type index ) const {
+		if( arity >= myArityLimit ) {
+			return NO_CANDIDATE;
+		}
+		const DispatchEntry &entry =
+			myDispatch[ (unsigned char)name * myArityLimit + arity ];
 
-		if( iter == myProductions.end() ) {
-			Module tmp;
-			tmp.name = mod.name;
-			tmp.parameters = mod.parameters;
-			ret.push_back(tmp);
-			return ret;
+		if( entry.count == 0 ) {
+			return NO_CANDIDATE;
+		}
+		if( entry.count == 1 ) {
+			return entry.first;
 		}
 
 		//////////////////////////////////////////////////////////////////////
-		// Find the appropriate production
-		double pos = 0.0;
-		double rand = randdouble( 0.0, 1.0 );
-		std::list<Production>::iterator i;
-		for( i = iter->second.begin(); i != iter->second.end(); ++i ) {
-			//randomly pick one
-			if( rand <= pos + i->getProbability() ) {
-				break; // we found it break out and use this one.
-			} else {
-				pos = pos + i->getProbability(); //increment probability
+		// One draw picks both a column of the alias table, by its whole
+		// part, and whether to keep the column's production or take its
+		// alias, by its fraction.
+		double rand = randdouble( seed, generation, index, 0.0, entry.count );
+		unsigned int column = (unsigned int)rand;
+		if( column >= entry.count ) {
+			column = entry.count - 1;
+		}
+		unsigned int slot = entry.first + column;
+		if( rand - column >= myKeep[ slot ] ) {
+			slot = entry.first + myAlias[ slot ];
+		}
+		return slot;
+	}
+
+	/**
+	 * The number of productions a module named name with arity
+	 * parameters could be rewritten by.  0 means it is never rewritten
+	 * and 1 that match() always picks the same production.
+	 */
+	unsigned int matchCount( char name, ModuleString::size_type arity ) const {
+		if( arity >= myArityLimit ) {
+			return 0;
+		}
+		return myDispatch[ (unsigned char)name * myArityLimit + arity ].count;
+	}
+
+	/**
+	 * Candidate n, counting from 0 up to matchCount(), of the productions
+	 * a module named name with arity parameters could be rewritten by.
+	 */
+	Production *candidate( char name, ModuleString::size_type arity,
+			unsigned int n ) const {
+		return myCandidates[
+			myDispatch[ (unsigned char)name * myArityLimit + arity ].first + n ];
+	}
+
+	/**
+	 * The production in slot of the table, as given by matchSlot().
+	 */
+	Production *candidate( unsigned int slot ) const {
+		return myCandidates[ slot ];
+	}
+
+	/**
+	 * True if any module has more than one production to pick from.
+	 */
+	bool stochastic() const {
+		for( std::vector<DispatchEntry>::size_type e = 0; e < myDispatch.size(); ++e ) {
+			if( myDispatch[e].count > 1 ) {
+				return true;
 			}
 		}
+		return false;
+	}
 
-		////////////////////////////////////////////////////////////////////////////
-		// Create the symbol lookup table.
-		// Local variable silently override global values.
-		IdentVec identList = i->getIdentVec();
-		for( IdentVec::size_type identI = 0; identI < identList.size(); ++identI ) {
-			LDEBUG( std::cout << "Symbol Table: [" << identList[identI] << "]= " 
-					<< mod.parameters[identI]; )
-			table[ identList[identI] ] = mod.parameters[identI];
-		}
-		
-		///////////////////////////////////////////////////////////////////////////
-		// Loop through the successors, evaluating them against the lookup
-		// table to create a new list of Modules for us to return.
-		SuccessorVec v = i->getSuccessorVec();
+	/**
+	 * The end of the run of modules of in from begin on which no
+	 * production rewrites, so are copied through as they are.  begin
+	 * itself if module begin is rewritten.
+	 */
+	ModuleString::size_type passThrough( const ModuleString &in,
+			ModuleString::size_type begin ) const {
+		ModuleString::size_type end = begin;
+		while( end < in.size()
+				&& matchCount( in.name( end ), in.parameterCount( end ) ) == 0 ) {
+			++end;
+		}
+		return end;
+	}
+
+	/**
+	 * The number of modules that apply() will write for the production
+	 * returned by match().
+	 */
+	static ModuleString::size_type successorCount( Production *prod ) {
+		if( !prod ) {
+			return 1;
+		}
+		return prod->getSuccessorVec().size();
+	}
+
+	/**
+	 * The number of parameters that apply() will write for the production
+	 * returned by match() for a module with arity parameters.
+	 */
+	static ModuleString::size_type parameterCount( Production *prod,
+			ModuleString::size_type arity ) {
+		if( !prod ) {
+			return arity;
+		}
+		const SuccessorVec &v = prod->getSuccessorVec();
+		ModuleString::size_type count = 0;
 		for( SuccessorVec::size_type n = 0; n < v.size(); ++n ) {
-			ExpressionPtrVec ev = v[n].getExpressionPtrVec();
-			Module module;
-			module.name = v[n].getName()[0];
-			
-			//Evaluate the expressions against the symbol table.
-			for( ExpressionPtrVec::size_type e = 0; e < ev.size(); ++e ) {
-				module.parameters.push_back( ev[e]->evaluateExpression( table ) );
-			}	
-			ret.push_back( module );
+			count += v[n].getExpressionPtrVec().size();
+		}
+		return count;
+	}
+
+	/**
+	 * Evaluates the successors of a production previously chosen by
+	 * match() for module i of in and appends them to out.  The module's
+	 * own parameters are the production's parameter frame, globals the
+	 * global frame.  Does not touch the ProductionSet so it is safe to
+	 * call from several threads at once.
+	 */
+	static void apply( const ModuleString &in, ModuleString::size_type i,
+			Production *prod, const SymbolFrame &globals, ModuleString &out ) {
+		apply( in.name( i ), in.parameters( i ), in.parameterCount( i ),
+			prod, globals, out );
+	}
+
+	/**
+	 * Like apply() above, for the module named name with the arity
+	 * parameters params.
+	 */
+	static void apply( char name, const double *params,
+			ModuleString::size_type arity, Production *prod,
+			const SymbolFrame &globals, ModuleString &out ) {
+		if( !prod ) {
+			out.push_back( name, params, arity );
+			return;
+		}
+
+		// The successors' parameters are contiguous, so they are all
+		// evaluated at once after the modules are appended.
+		ModuleString::size_type first = out.size();
+		const SuccessorVec &v = prod->getSuccessorVec();
+		for( SuccessorVec::size_type n = 0; n < v.size(); ++n ) {
+			out.push_back( v[n].getName()[0],
+				v[n].getExpressionPtrVec().size() );
+		}
+		prod->evaluate( params, globals.data(), out.parameters( first ) );
+	}
+
+	/**
+	 * Like the appending apply(), but only appends the successors whose
+	 * names are in kept.  Their parameters are evaluated into scratch
+	 * first, so the modules dropped are never written to out.
+	 */
+	static void apply( const ModuleString &in, ModuleString::size_type i,
+			Production *prod, const SymbolFrame &globals, ModuleString &out,
+			const std::bitset<256> &kept, std::vector<double> &scratch ) {
+		if( !prod ) {
+			if( kept[ (unsigned char)in.name( i ) ] ) {
+				out.push_back( in.name( i ), in.parameters( i ),
+					in.parameterCount( i ) );
+			}
+			return;
+		}
+
+		scratch.resize( parameterCount( prod, 0 ) );
+		prod->evaluate( in.parameters( i ), globals.data(), scratch.data() );
+		const double *params = scratch.data();
+		const SuccessorVec &v = prod->getSuccessorVec();
+		for( SuccessorVec::size_type n = 0; n < v.size(); ++n ) {
+			char name = v[n].getName()[0];
+			ModuleString::size_type count = v[n].getExpressionPtrVec().size();
+			if( kept[ (unsigned char)name ] ) {
+				out.push_back( name, params, count );
+			}
+			params += count;
+		}
+	}
+
+	/**
+	 * Like the appending apply(), but writes the successors into out
+	 * starting at module index, whose parameters start at offset.  out
+	 * must already be sized to hold them, which is how several threads
+	 * write one generation at once.
+	 */
+	static void apply( const ModuleString &in, ModuleString::size_type i,
+			Production *prod, const SymbolFrame &globals, ModuleString &out,
+			ModuleString::size_type index, ModuleString::size_type offset ) {
+		if( !prod ) {
+			ModuleString::size_type count = in.parameterCount( i );
+			const double *params = in.parameters( i );
+			std::copy( params, params + count,
+				out.assign( index, offset, in.name( i ), count ) );
+			return;
+		}
+
+		double *first = NULL;
+		const SuccessorVec &v = prod->getSuccessorVec();
+		for( SuccessorVec::size_type n = 0; n < v.size(); ++n ) {
+			ModuleString::size_type count = v[n].getExpressionPtrVec().size();
+			double *params = out.assign( index++, offset, v[n].getName()[0], count );
+			if( n == 0 ) {
+				first = params;
+			}
+			offset += count;
+		}
+		if( first ) {
+			prod->evaluate( in.parameters( i ), globals.data(), first );
 		}
-		return ret;
 	}
 
 	/**
@@ -197,6 +494,9 @@ class ProductionSet
 		std::ostringstream outName;
 		outName << prod.getName() << prod.getIdentVec().size();
 		myProductions[ outName.str() ].push_back( prod );
+		// The table is out of date until the next compile().
+		myDispatch.clear();
+		myArityLimit = 0;
 	}
 	
 	/**
@@ -204,8 +504,78 @@ class ProductionSet
 	 */
 	void clear() {
 		myProductions.clear();
+		myDispatch.clear();
+		myCandidates.clear();
+		myKeep.clear();
+		myAlias.clear();
+		myArityLimit = 0;
+	}
+
+	/**
+	 * Compiles the productions into the dense dispatch table used by
+	 * match().  Has to be called once all of the productions are added
+	 * and normalized, and again if they change.
+	 */
+	void compile() {
+		myDispatch.clear();
+		myCandidates.clear();
+		myKeep.clear();
+		myAlias.clear();
+
+		////////////////////////////////////////////////////////////////////
+		// The table needs a column for every arity up to the largest.
+		myArityLimit = 0;
+		ProductionMap::iterator index, end;
+		end = myProductions.end();
+		for( index = myProductions.begin(); index != end; ++index ) {
+			ModuleString::size_type arity =
+				index->second.front().getIdentVec().size();
+			if( arity + 1 > myArityLimit ) {
+				myArityLimit = arity + 1;
+			}
+		}
+		DispatchEntry none = { 0, 0 };
+		myDispatch.assign( 256 * myArityLimit, none );
+
+		////////////////////////////////////////////////////////////////////
+		// Lay each predecessor's productions out next to each other.
+		for( index = myProductions.begin(); index != end; ++index ) {
+			std::list<Production> &prods = index->second;
+			Production &front = prods.front();
+			DispatchEntry &entry = myDispatch[
+				(unsigned char)front.getName()[0] * myArityLimit
+				+ front.getIdentVec().size() ];
+			entry.first = myCandidates.size();
+			entry.count = prods.size();
+
+			std::list<Production>::iterator i;
+			for( i = prods.begin(); i != prods.end(); ++i ) {
+				myCandidates.push_back( &(*i) );
+			}
+			buildAlias( entry.first, entry.count );
+		}
 	}
 	
+	/**
+	 * Runs the optimizer over every production, folding in the globals,
+	 * sharing common subexpressions between successors and replacing
+	 * division by constants.  apply() needs this to have been done.
+	 *
+	 * @return the number of instructions eliminated in all.
+	 */
+	unsigned int optimize( const SymbolFrame &globals ) {
+		unsigned int eliminated = 0;
+		ProductionMap::iterator index, end;
+		end = myProductions.end();
+		for( index = myProductions.begin(); index != end; ++index ) {
+			std::list<Production>::iterator i;
+			for( i = index->second.begin(); i != index->second.end(); ++i ) {
+				eliminated += i->compile( globals );
+			}
+		}
+		return eliminated;
+	}
+
 	/**
 	 * Normalizes the probabilities.
 	 */
@@ -231,15 +601,102 @@ class ProductionSet
 			++index;
 		}
 	}
+	//----------------------------------------------------------------------
+	// Getters
+
+	/**
+	 * Gets the seed the random productions are picked with.
+	 */
+	unsigned long long getSeed() const {
+		return mySeed;
+	}
+
+	/**
+	 * Gets the productions, keyed by name and arity.
+	 */
+	const ProductionMap &getProductions() const {
+		return myProductions;
+	}
+
 	//----------------------------------------------------------------------
 	// Setters
 
+	/**
+	 * Sets the seed the random productions are picked with.
+	 */
+	void setSeed( unsigned long long seed ) {
+		mySeed = seed;
+	}
+
 	/**
 	 * Sets the value of Productions of this ProductionSet
 	 */
 	void setProductions( std::map<std::string, std::list<Production> > productions )
 	{
 		myProductions = productions ;
+		// The table is out of date until the next compile().
+		myDispatch.clear();
+		myArityLimit = 0;
+	}
+
+    //======================================================================
+    // Private Methods
+    //======================================================================
+    private:
+
+	/**
+	 * Builds the alias table for the count candidates starting at first,
+	 * using Vose's method.  Column c keeps candidate c with probability
+	 * myKeep[c] and otherwise gives way to candidate myAlias[c], which
+	 * together give every candidate its own probability.
+	 */
+	void buildAlias( unsigned int first, unsigned int count ) {
+		myKeep.resize( first + count, 1.0 );
+		myAlias.resize( first + count, 0 );
+
+		double total = 0.0;
+		for( unsigned int c = 0; c < count; ++c ) {
+			total += myCandidates[ first + c ]->getProbability();
+		}
+
+		////////////////////////////////////////////////////////////////////
+		// Scale so the average is 1, then fill each column that is short
+		// from one that has too much.
+		std::vector<double> scaled( count, 1.0 );
+		std::vector<unsigned int> small, large;
+		for( unsigned int c = 0; c < count; ++c ) {
+			if( total > 0.0 ) {
+				scaled[c] = myCandidates[ first + c ]->getProbability() * count / total;
+			}
+			if( scaled[c] < 1.0 ) {
+				small.push_back( c );
+			} else {
+				large.push_back( c );
+			}
+		}
+		while( !small.empty() && !large.empty() ) {
+			unsigned int s = small.back();
+			unsigned int l = large.back();
+			small.pop_back();
+			myKeep[ first + s ] = scaled[s];
+			myAlias[ first + s ] = l;
+			scaled[l] = ( scaled[l] + scaled[s] ) - 1.0;
+			if( scaled[l] < 1.0 ) {
+				large.pop_back();
+				small.push_back( l );
+			}
+		}
+
+		////////////////////////////////////////////////////////////////////
+		// Whatever is left is full, give or take rounding.
+		for( unsigned int n = 0; n < small.size(); ++n ) {
+			myKeep[ first + small[n] ] = 1.0;
+			myAlias[ first + small[n] ] = small[n];
+		}
+		for( unsigned int n = 0; n < large.size(); ++n ) {
+			myKeep[ first + large[n] ] = 1.0;
+			myAlias[ first + large[n] ] = large[n];
+		}
 	}
 
 }; // End of ProductionSet
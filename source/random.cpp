@@ -15,14 +15,30 @@
  along with this program; if not, write to the Free Software
  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
-#include <cstdlib>
-#include <ctime>
+#include "random.h"
 
-void seedrand() {
-	srand(time(NULL));
+/**
+ * The SplitMix64 finalizer, which scrambles every bit of z into every bit
+ * of the result.
+ */
+static unsigned long long mix( unsigned long long z ) {
+	z += 0x9e3779b97f4a7c15ULL;
+	z = ( z ^ ( z >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+	z = ( z ^ ( z >> 27 ) ) * 0x94d049bb133111ebULL;
+	return z ^ ( z >> 31 );
 }
 
-double randdouble( double bottom, double top ) {
-	return bottom + (top * rand() / (RAND_MAX+bottom));
+unsigned long long randbits( unsigned long long seed,
+	unsigned long long generation, unsigned long long index )
+{
+	return mix( mix( mix( seed ) ^ generation ) ^ index );
 }
 
+double randdouble( unsigned long long seed, unsigned long long generation,
+	unsigned long long index, double bottom, double top )
+{
+	// The top 53 bits give every double in [0, 1) with equal spacing.
+	double unit = ( randbits( seed, generation, index ) >> 11 )
+		* ( 1.0 / 9007199254740992.0 );
+	return bottom + ( top - bottom ) * unit;
+}
@@ -0,0 +1,43 @@
+/*
+ Copyright (C) 2004  Lakin Wecker
+	
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details. 
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#ifndef RANDOM_H
+#define RANDOM_H
+
+/**
+ * Counter based random numbers.
+ *
+ * There is no generator state, each number is a hash of a seed and the
+ * position it is drawn for, so the same (seed, generation, index) always
+ * gives the same number no matter what order, or how many threads, the
+ * numbers are drawn in.
+ */
+
+/**
+ * 64 random bits for module index of generation generation.
+ */
+unsigned long long randbits( unsigned long long seed,
+	unsigned long long generation, unsigned long long index );
+
+/**
+ * A random number in [bottom, top) for module index of generation
+ * generation.
+ */
+double randdouble( unsigned long long seed, unsigned long long generation,
+	unsigned long long index, double bottom, double top );
+
+#endif
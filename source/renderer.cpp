@@ -34,6 +34,8 @@
 LRenderer::LRenderer()
 {
 	m_derv      = 0;
+	m_cancel    = 0;
+	m_havepending = false;
 	m_branchobj = 0;
 	m_nbranch   = 0;
 	m_leaveobj  = 0;
@@ -56,10 +58,43 @@ int LRenderer::setinput( std::vector<LSystem::Module> * s )
 
 	m_derv = s;
 	
-	compile();
+	LSystem::ModuleVecSource source( *s );
+	compile( source );
 	return 1;
 }
 
+/*
+ * Function: LRenderer::setinput
+ * Purpose: This function compiles a packed dervation
+ * Inputs: const LSystem::ModuleString & s - A generated module string
+ * Outputs: int - 1 = success
+ *                0 = cancelled part way, see setcancel()
+ */
+int LRenderer::setinput( const LSystem::ModuleString & s )
+{
+	m_derv = 0;
+
+	compile( s );
+	return !( m_cancel && *m_cancel );
+}
+
+/*
+ * Function: LRenderer::setinput
+ * Purpose: This function compiles a dervation that is read in order from
+ *          a source, such as a ModuleStream, without it ever having to be
+ *          held in memory.
+ * Inputs: LSystem::ModuleSource & s - The source to read the modules from
+ * Outputs: int - 1 = success
+ *                0 = cancelled part way, see setcancel()
+ */
+int LRenderer::setinput( LSystem::ModuleSource & s )
+{
+	m_derv = 0;
+
+	compile( s );
+	return !( m_cancel && *m_cancel );
+}
+
 /*
  * Function: LRenderer::loadmodels
  * Purpose: This function loads the static branch and leaf models used to
@@ -474,125 +509,148 @@ void LRenderer::updatebranch( TurtleState * branch,
  * Function: LRenderer::compile
  * Purpose: This function takes a dervation and creates an internal 
  *          structure that can be rendered very quickly
- * Inputs: void
+ * Inputs: const LSystem::ModuleString & s - The derivation
  * Outputs: void
  */
-void LRenderer::compile( void )
+void LRenderer::compile( const LSystem::ModuleString & s )
 {
-	unsigned int x;
-	bool doprev = false;
-	bool branchtype = false;
-
-	// This loop works by performing modules one step behind.
-	// checking to see if the next modules is valid before performing the previous one.
-	m_prevmodule = 0;
-	if( m_derv ) {
-		m_prevmodule = &((*m_derv)[0]);
-
-		x = 1;
-		while( x < m_derv->size()) {
-		    doprev = false;
-		    branchtype = true;
-		  
-			// look at the next module to determine what to do next
-		    switch( (*m_derv)[x].name ) {
-				case 'F':                // identifiers
-					doprev = true;
-					break;
-		      
-				case ']':				// pop operation
-					branchtype = false;
-		      
-				case '[':				// Push
-				case '+':				// all valid operators
-				case '-':
-				case '/':
-				case '\\':
-				case '^':
-				case '&':
-				case '!':
-				case '#':
-					doprev = true;
-					break;
-				
-				default:
-					break;
-		    }
-			
-			// if the current module is valid, perform
-			// the previous module
-		    if( doprev ) {
-				switch( m_prevmodule->name ) {
-					case 'F':		// identifiers
-						do_identifier( m_prevmodule, branchtype );
-						break;
-			
-					case ']':		// pop operation
-						do_pop();
-						break;
-			
-					case '[':		// push operation
-						do_push();
-						break;
-			
-					case '+':		// operators
-					case '-':
-					case '/':
-					case '\\':
-					case '^':
-					case '&':
-					case '!':
-					case '#':
-						do_operator( m_prevmodule );
-						break;
-			
+	LSystem::ModuleString::size_type x;
 
-					default:
-						break;
-				}
-				m_prevmodule = &((*m_derv)[x]);
-		    }
-		    x++;
+	m_havepending = false;
+	for( x = 0; x < s.size(); x++ ) {
+		// every so often, see if whoever wanted this still does.
+		if( ( x & 4095 ) == 0 && m_cancel && *m_cancel ) {
+			return;
 		}
+		interpret( s.name( x ), s.parameters( x ), s.parameterCount( x ) );
+	}
+	finish();
+}
 
-		// since we are executing modules one behind, we 
-		// need to manually execute the very last module
-		// to complete the renderer.
-		if( m_prevmodule) {
-			switch( m_prevmodule->name ) {
-				case 'F':
-					do_identifier( m_prevmodule, true );
-					break;
-				
-				case ']':
-					do_pop();
-					break;
-				
-				case '[':
-					do_push();
-					break;
-				
-				case '+':
-				case '-':
-				case '/':
-				case '\\':
-				case '^':
-				case '&':
-				case '!':
-				case '#':
-					do_operator( m_prevmodule );
-					break;
-			
-				default:
-					break;
-			}
+/*
+ * Function: LRenderer::compile
+ * Purpose: This function takes a dervation and creates an internal 
+ *          structure that can be rendered very quickly
+ * Inputs: LSystem::ModuleSource & s - The derivation, read in order
+ * Outputs: void
+ */
+void LRenderer::compile( LSystem::ModuleSource & s )
+{
+	LSystem::Module m;
+	size_t x = 0;
+
+	m_havepending = false;
+	while( s.next( m ) ) {
+		if( ( x++ & 4095 ) == 0 && m_cancel && *m_cancel ) {
+			return;
 		}
+		interpret( m.name, m.parameters.data(), m.parameters.size() );
+	}
+	finish();
+}
+
+/*
+ * Function: LRenderer::interpret
+ * Purpose: Feeds the next module of the derivation to the turtle.  This works
+ *          by performing modules one step behind, checking to see if the next
+ *          module is valid before performing the previous one.
+ * Inputs: char name - The module name
+ *         const double * params - The module's parameters
+ *         size_t count - The number of parameters
+ * Outputs: void
+ */
+void LRenderer::interpret( char name, const double * params, size_t count )
+{
+	bool branchtype = true;
+
+	// look at the next module to determine what to do next
+	switch( name ) {
+		case ']':				// pop operation
+			branchtype = false;
+
+		case 'F':				// identifiers
+		case '[':				// Push
+		case '+':				// all valid operators
+		case '-':
+		case '/':
+		case '\\':
+		case '^':
+		case '&':
+		case '!':
+		case '#':
+			break;
+
+		default:				// the turtle ignores anything else
+			return;
 	}
 
+	// the current module is valid, perform the previous module
+	if( m_havepending ) {
+		perform( &m_pending, branchtype );
+	}
+	m_pending.name = name;
+	m_pending.parameters.assign( params, params + count );
+	m_havepending = true;
+}
+
+/*
+ * Function: LRenderer::finish
+ * Purpose: since we are executing modules one behind, we 
+ *          need to manually execute the very last module
+ *          to complete the renderer.
+ * Inputs: void
+ * Outputs: void
+ */
+void LRenderer::finish( void )
+{
+	if( m_havepending ) {
+		perform( &m_pending, true );
+	}
+	m_havepending = false;
+
 	// To use dynamic renderering this function must be called here
 	//m_turtle.Root()->ConvertLocal();
 }
 
+/*
+ * Function: LRenderer::perform
+ * Purpose: Performs a single module
+ * Inputs: LSystem::Module * m - The module to perform
+ *         bool branch - false if the module ends a branch, which makes an
+ *                       'F' a leaf
+ * Outputs: void
+ */
+void LRenderer::perform( LSystem::Module * m, bool branch )
+{
+	switch( m->name ) {
+		case 'F':		// identifiers
+			do_identifier( m, branch );
+			break;
+
+		case ']':		// pop operation
+			do_pop();
+			break;
+
+		case '[':		// push operation
+			do_push();
+			break;
+
+		case '+':		// operators
+		case '-':
+		case '/':
+		case '\\':
+		case '^':
+		case '&':
+		case '!':
+		case '#':
+			do_operator( m );
+			break;
+
+		default:
+			break;
+	}
+}
+
 /*
  * Function: LRenderer::do_operator
  * Purpose: This function is called when an operator is found
@@ -717,3 +775,21 @@ void LRenderer::reset( void ) {
 	m_leaves.clear();
 
 }
+
+/*
+ * Function: LRenderer::takegeometry
+ * Purpose: Takes the branches and leaves another renderer compiled, leaving
+ *          it with ours, while keeping our own models.  This lets a
+ *          derivation be compiled by a renderer on another thread and then
+ *          handed to the one that draws in constant time.  Only the static
+ *          geometry is taken, the turtle is reset.
+ * Inputs: LRenderer & from - The renderer to take the geometry from
+ * Outputs: void
+ */
+void LRenderer::takegeometry( LRenderer & from ) {
+	m_turtle.release();
+	m_derv = 0;
+
+	m_branches.swap( from.m_branches );
+	m_leaves.swap( from.m_leaves );
+}
@@ -29,8 +29,11 @@
 #ifndef RENDERER__H
 #define RENDERER__H
 
+#include <atomic>
 #include <vector>
 #include "module.h"
+#include "modulesource.h"
+#include "modulestring.h"
 #include "turtle.h"
 #include "objparser.h"
 
@@ -39,6 +42,9 @@
 
 #define ANGLE 22.5
 
+// The modules interpret() acts on, it ignores every other one.
+#define TURTLE_MODULES "F[]+-/\\^&!#"
+
 #define RENDERSTATIC  0x0A
 #define RENDERDYNAMIC 0x0B
 
@@ -52,14 +58,28 @@ class LRenderer
 
 		int  loadmodels( void );
 		int  setinput( std::vector<LSystem::Module> * s );
+		int  setinput( LSystem::ModuleSource & s );
+		int  setinput( const LSystem::ModuleString & s );
 		void release( void );
 		void reset( void );
+		void takegeometry( LRenderer & from );
+
+		// a flag another thread can raise to stop setinput() compiling.
+		void setcancel( const std::atomic<bool> * cancel ) { m_cancel = cancel; }
 
 		void render( const int & btype, const int & ltype, const int & rtype );
 
+		// the size of the compiled derivation.
+		size_t branchcount( void ) const { return m_branches.size(); }
+		size_t leafcount( void ) const { return m_leaves.size(); }
+
 	protected:
 				
-		void compile( void );
+		void compile( LSystem::ModuleSource & s );
+		void compile( const LSystem::ModuleString & s );
+		void interpret( char name, const double * params, size_t count );
+		void finish( void );
+		void perform( LSystem::Module * m, bool branch );
 		void do_operator( LSystem::Module * m );
 		void do_identifier( LSystem::Module * m, bool branch );
 		void do_push( void );
@@ -72,7 +92,11 @@ class LRenderer
 
 		// stores the dervation to render.
 		std::vector<LSystem::Module> * m_derv;
-		LSystem::Module    * m_prevmodule;
+		// stops compile() part way when raised, if set.
+		const std::atomic<bool> * m_cancel;
+		// the module waiting for the next one before it is performed.
+		LSystem::Module      m_pending;
+		bool                 m_havepending;
 		
 		Turtle      m_turtle;
 		std::vector<TurtleState> m_branches;
@@ -20,65 +20,89 @@
 #include "scanner.h"
 
 #include <cctype>
-#include <cassert>
+#include <iterator>
 
 
 using namespace LSystem;
 
-Token *Scanner::lex () {
-
-	//----------------------------------------------------------------------
-	// Return the last token unlexed.
-	if( myCurrentToken ) {
-		Token *tok = myCurrentToken;
-		myCurrentToken = NULL;
-		return tok;
+//------------------------------------------------------------------------------
+// Returns the first character from position on which isn't a digit.
+static const char *skipDigits( const char *position, const char *end ) {
+	while( position != end && isdigit( (unsigned char)*position ) ) {
+		++position;
 	}
+	return position;
+}
+
+Scanner::Scanner( std::istream &in )
+	:
+	myBuffer( std::istreambuf_iterator<char>( in ),
+		std::istreambuf_iterator<char>() ),
+	myBegin( myBuffer.data() ),
+	myPosition( myBegin ),
+	myEnd( myBuffer.data() + myBuffer.size() ),
+	myLineStart( myPosition ),
+	myCurrentToken(),
+	myHasCurrentToken( false ),
+	myCurrentLine( 1 )
+{
+}
+
+Scanner::Scanner( std::string_view text )
+	:
+	myBuffer(),
+	myBegin( text.data() ),
+	myPosition( myBegin ),
+	myEnd( text.data() + text.size() ),
+	myLineStart( myPosition ),
+	myCurrentToken(),
+	myHasCurrentToken( false ),
+	myCurrentLine( 1 )
+{
+}
 
+Lexeme Scanner::lex () {
 
 	//----------------------------------------------------------------------
-	//Grab the next character.
-	int curChar = myInputStream.get();
+	// Return the last token unlexed.
+	if( myHasCurrentToken ) {
+		myHasCurrentToken = false;
+		return myCurrentToken;
+	}
 
 
 	//----------------------------------------------------------------------
 	//Skip whitespace
-	while( isspace( curChar ) ) {
-		if( curChar == (int)'\n' ) {
+	while( myPosition != myEnd && isspace( (unsigned char)*myPosition ) ) {
+		if( *myPosition == '\n' ) {
 			++myCurrentLine;
-			myCurrentCol = 1;
+			myLineStart = myPosition + 1;
 		}
-		curChar = myInputStream.get();
+		++myPosition;
 	}
 
 
 	//----------------------------------------------------------------------
 	// Recognize tokens
-	if( curChar == EOF ) {
-		return new Token( Token::END_OF_FILE, "EOF" );
-	} else if( isdigit( curChar ) ) {
-		std::string theFloat( 1, (char)curChar ) ;
-		curChar = myInputStream.get();
-		while( isdigit( curChar ) ) {
-			theFloat += curChar;
-			curChar = myInputStream.get();
-		}
-		if( curChar != (int)'.' ) {
-			myInputStream.putback((char)curChar);
-			return new Token( Token::INT, theFloat );
-		}
-		theFloat += curChar;
-		curChar = myInputStream.get();
-		while( isdigit( curChar ) ) {
-			theFloat += curChar;
-			curChar = myInputStream.get();
+	if( myPosition == myEnd ) {
+		return Lexeme( Token::END_OF_FILE, "EOF" );
+	}
+	const char *start = myPosition;
+	int curChar = (unsigned char)*myPosition++;
+
+	if( isdigit( curChar ) ) {
+		myPosition = skipDigits( myPosition, myEnd );
+		if( myPosition == myEnd || *myPosition != '.' ) {
+			return Lexeme( Token::INT,
+				std::string_view( start, myPosition - start ) );
 		}
-		myInputStream.putback((char)curChar);
-		return new Token( Token::FLOAT, theFloat );
+		myPosition = skipDigits( myPosition + 1, myEnd );
+		return Lexeme( Token::FLOAT,
+			std::string_view( start, myPosition - start ) );
 	} else if( curChar == (int)'(' ) {
-		return new Token( Token::START_PARENS, "(" );
+		return Lexeme( Token::START_PARENS, std::string_view( start, 1 ) );
 	} else if( curChar == (int)')' ) {
-		return new Token( Token::END_PARENS, ")" );
+		return Lexeme( Token::END_PARENS, std::string_view( start, 1 ) );
 	} else if( curChar == (int)'+' || 
 			   curChar == (int)'-' ||
 			   curChar == (int)'&' ||
@@ -93,50 +117,40 @@ Token *Scanner::lex () {
 			   curChar == (int)'[' ||
 			   curChar == (int)']' ||
 			   isupper( curChar ) ) {
-		std::string production ( 1, (char)curChar );
-		return new Token( Token::PRODUCTION, production );
+		return Lexeme( Token::PRODUCTION, std::string_view( start, 1 ) );
 	} else if( curChar == (int)';' ||
 			   curChar == (int)':' ||
 			   curChar == (int)'\''||
 			   curChar == (int)',' ) {
-		return new Token( Token::PUNCTUATION, std::string( 1, (char)curChar ) );
+		return Lexeme( Token::PUNCTUATION, std::string_view( start, 1 ) );
 	} else if( curChar == (int)'=' ) {
-		char next = myInputStream.get();
-		if( next != (int)'>') {
+		if( myPosition == myEnd || *myPosition != '>' ) {
 			throw createError("Error: '=' expects a '>' directly afterwards!\n",__FILE__,__LINE__);
 		}
-		return new Token( Token::PUNCTUATION, "=>" );
+		++myPosition;
+		return Lexeme( Token::PUNCTUATION, std::string_view( start, 2 ) );
 	} else if( islower( curChar ) ) {
-		std::string ident( 1, (char)curChar );
-		curChar = myInputStream.get();
-		while( islower( curChar ) ) {
-			ident += curChar;
-			curChar = myInputStream.get();
+		while( myPosition != myEnd && islower( (unsigned char)*myPosition ) ) {
+			++myPosition;
 		}
-		myInputStream.putback((char)curChar);
-		return new Token( Token::IDENTIFIER, ident );
-	} else if( curChar == (int)'\n' ) {
-		++myCurrentLine;
-		myCurrentCol = 1;
+		return Lexeme( Token::IDENTIFIER,
+			std::string_view( start, myPosition - start ) );
 	}
-	throw createError("Invalid token: " + (char)curChar, __FILE__,__LINE__);
-	return NULL;
+	throw createError( "Invalid token: " + std::string( 1, (char)curChar ),
+		__FILE__, __LINE__ );
 }
 
 
-void Scanner::unlex (Token *tok) {
-	//Can't unlex a null token.
-	assert( tok ); 
-
+void Scanner::unlex (const Lexeme &tok) {
 	//Can't unlex two tokens until the first
 	//token is consumed.
-	if( myCurrentToken ) {
+	if( myHasCurrentToken ) {
 		throw createError("Can only unlex one token at a time.", __FILE__, __LINE__);
 	}
 	myCurrentToken = tok;
+	myHasCurrentToken = true;
 }
 
 Error *Scanner::createError( std::string msg, std::string file, int line ) {
-	return new Error(msg, myCurrentLine, myCurrentCol, file, line);
+	return new Error(msg, myCurrentLine, getCurrentCol(), file, line);
 }
-
@@ -25,14 +25,21 @@
 #include "error.h"
 
 #include <string>
+#include <string_view>
 #include <iostream>
 
 namespace LSystem {
 	
 ///-----------------------------------------------------------------------------
-/// A basic scanner implementation that allows you to lex and unlex a character
+/// A basic scanner implementation that allows you to lex and unlex a token
 /// at a time, it also keeps track of the current line number and column number.
 ///
+/// The scanner works over one contiguous buffer.  Given a string_view, of a
+/// MappedFile or a string, it scans it in place.  Given a stream, it reads
+/// the whole stream into a buffer of its own first.  The lexemes it returns
+/// are views of that buffer, so lexing never allocates.
+///
+/// @see LSystem::Lexeme
 /// @see LSystem::Token
 /// @see LSystem::Error
 ///-----------------------------------------------------------------------------
@@ -49,42 +56,39 @@ public:
 	///---------------------------------------------------------------------
 	/// Standard constructor.
 	///	
-	/// @param in The input stream to read characters from.
-	///---------------------------------------------------------------------
-	Scanner(std::istream &in)
-		: 
-		myInputStream(in),
-		myCurrentToken(NULL),
-		myCurrentLine(1),
-		myCurrentCol(1)
-	{
-	}
+	/// @param in The input stream to read characters from.  It is read
+	///  to the end straight away.
+	///---------------------------------------------------------------------
+	Scanner(std::istream &in);
+
+
+	///---------------------------------------------------------------------
+	/// Scans text in place, without copying it.
+	///
+	/// @param text The text to scan, which must outlive the scanner and
+	///  every lexeme it returns.
+	///---------------------------------------------------------------------
+	Scanner(std::string_view text);
+
 
 	///---------------------------------------------------------------------
 	/// Standard destructor
 	///---------------------------------------------------------------------
 	~Scanner() 
 	{
-		if( myCurrentToken ) {
-			delete myCurrentToken;
-		}
 	}
 
 
 	///---------------------------------------------------------------------
-	/// Grabs the next recognizable Token from the string.
-	/// The calling code is responsible for deleting the
-	/// token when it's done with it.
+	/// Grabs the next recognizable Lexeme from the buffer.
 	/// Throws an error if it find an unrecognized symbol.
 	///---------------------------------------------------------------------
-	Token *lex ();
+	Lexeme lex ();
 
 
 	///---------------------------------------------------------------------
 	/// Puts the token back onto the front of the list, the next
-	/// call to lex will return a pointer to this token.
-	/// the Scanner class will assume responsibility for any token
-	/// unlexed this way and will delete it with it's dtor.
+	/// call to lex will return this token.
 	/// The only error for this function is if we already 
 	/// have a token that's been unlexed.  The function will throw
 	/// on this occasion.
@@ -92,7 +96,7 @@ public:
 	///
 	/// @param tok The token to restore to the front of the list.
 	///---------------------------------------------------------------------
-	void unlex (Token *tok);
+	void unlex (const Lexeme &tok);
 
 	///---------------------------------------------------------------------
 	/// Returns a pointer to an error object which can be used
@@ -118,15 +122,36 @@ public:
 	}
 
 
+	///---------------------------------------------------------------------
+	/// Returns the current column, counting from 1.
+	///---------------------------------------------------------------------
+	int getCurrentCol() const {
+		return myPosition - myLineStart + 1;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// Returns the whole text being scanned, read or not.
+	///---------------------------------------------------------------------
+	std::string_view getText() const {
+		return std::string_view( myBegin, myEnd - myBegin );
+	}
+
+
 //==============================================================================
 // Private Variables
 //==============================================================================
 private:
 
-	std::istream &myInputStream;
-	Token *myCurrentToken;
+	// Holds what was read from a stream, empty when scanning in place.
+	std::string myBuffer;
+	const char *myBegin;
+	const char *myPosition;
+	const char *myEnd;
+	const char *myLineStart;
+	Lexeme myCurrentToken;
+	bool myHasCurrentToken;
 	int myCurrentLine;
-	int myCurrentCol;
 
 //==============================================================================
 // Disabled constructors and operators
@@ -0,0 +1,301 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#include "spillfile.h"
+#include "error.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SPILL_ERROR(x) throw new Error( x, -1, -1, __FILE__, __LINE__ )
+
+namespace LSystem {
+
+//------------------------------------------------------------------------------
+// The header, the magic followed by the module count.
+static const char SPILL_MAGIC[8] = { 'L', 'S', 'Y', 'S', 'P', 'I', 'L', '1' };
+static const unsigned long long HEADER_SIZE = 16;
+
+// The largest record, a module with 255 parameters.
+static const unsigned long long MAX_RECORD = 2 + 255 * sizeof( double );
+
+
+//------------------------------------------------------------------------------
+// The message for a failed system call on path.
+static std::string spillMessage( const std::string &what, const std::string &path ) {
+	return "Error: Couldn't " + what + " spill file '" + path + "': "
+		+ std::strerror( errno );
+}
+
+
+//------------------------------------------------------------------------------
+// Writes all of the length bytes at data to file at offset.
+static bool writeAll( int file, const char *data, unsigned long long length,
+	unsigned long long offset )
+{
+	while( length > 0 ) {
+		ssize_t written = pwrite( file, data, length, offset );
+		if( written < 0 ) {
+			if( errno == EINTR ) {
+				continue;
+			}
+			return false;
+		}
+		data += written;
+		length -= written;
+		offset += written;
+	}
+	return true;
+}
+
+
+//------------------------------------------------------------------------------
+SpillWriter::SpillWriter( const std::string &path )
+	:
+	myPath( path ),
+	myFile( -1 ),
+	myChunk( CHUNK_SIZE ),
+	myUsed( 0 ),
+	myCount( 0 )
+{
+	myFile = open( path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+	if( myFile < 0 ) {
+		SPILL_ERROR( spillMessage( "create", path ) );
+	}
+	// The count is left 0 until close().
+	std::memcpy( &myChunk[0], SPILL_MAGIC, sizeof( SPILL_MAGIC ) );
+	std::memset( &myChunk[ sizeof( SPILL_MAGIC ) ], 0, HEADER_SIZE - sizeof( SPILL_MAGIC ) );
+	myUsed = HEADER_SIZE;
+}
+
+
+//------------------------------------------------------------------------------
+SpillWriter::~SpillWriter() {
+	if( myFile >= 0 ) {
+		try {
+			close();
+		} catch( Error *e ) {
+			delete e;
+		}
+	}
+}
+
+
+//------------------------------------------------------------------------------
+void SpillWriter::push_back( char name, const double *params,
+	ModuleString::size_type count )
+{
+	if( count > 255 ) {
+		SPILL_ERROR( "Error: Modules with more than 255 parameters can't be spilled." );
+	}
+	std::vector<char>::size_type bytes = 2 + count * sizeof( double );
+	if( myUsed + bytes > myChunk.size() ) {
+		flush();
+	}
+	char *out = &myChunk[ myUsed ];
+	out[0] = name;
+	out[1] = (char)(unsigned char)count;
+	// params may be NULL for a module with none, which memcpy mustn't see.
+	if( count ) {
+		std::memcpy( out + 2, params, count * sizeof( double ) );
+	}
+	myUsed += bytes;
+	++myCount;
+}
+
+
+//------------------------------------------------------------------------------
+void SpillWriter::append( const ModuleString &s ) {
+	for( ModuleString::size_type i = 0; i < s.size(); ++i ) {
+		push_back( s.name( i ), s.parameters( i ), s.parameterCount( i ) );
+	}
+}
+
+
+//------------------------------------------------------------------------------
+void SpillWriter::close() {
+	if( myFile < 0 ) {
+		return;
+	}
+	flush();
+	bool ok = writeAll( myFile, (const char *)&myCount, sizeof( myCount ),
+		sizeof( SPILL_MAGIC ) );
+	ok = ::close( myFile ) == 0 && ok;
+	myFile = -1;
+	if( !ok ) {
+		SPILL_ERROR( spillMessage( "write", myPath ) );
+	}
+}
+
+
+//------------------------------------------------------------------------------
+void SpillWriter::flush() {
+	// The file is only ever appended to, so its end is where to write.
+	off_t end = lseek( myFile, 0, SEEK_END );
+	if( end < 0 || !writeAll( myFile, &myChunk[0], myUsed, end ) ) {
+		SPILL_ERROR( spillMessage( "write", myPath ) );
+	}
+	myUsed = 0;
+}
+
+
+//------------------------------------------------------------------------------
+SpillReader::SpillReader( const std::string &path, unsigned long long window )
+	:
+	myPath( path ),
+	myFile( -1 ),
+	myLength( 0 ),
+	myCount( 0 ),
+	myWindowSize( 0 ),
+	myWindow( NULL ),
+	myWindowStart( 0 ),
+	myWindowLength( 0 ),
+	myPosition( HEADER_SIZE )
+{
+	myFile = open( path.c_str(), O_RDONLY );
+	if( myFile < 0 ) {
+		SPILL_ERROR( spillMessage( "open", path ) );
+	}
+	struct stat info;
+	char header[ HEADER_SIZE ];
+	if( fstat( myFile, &info ) != 0 || info.st_size < (off_t)HEADER_SIZE
+		|| pread( myFile, header, HEADER_SIZE, 0 ) != (ssize_t)HEADER_SIZE
+		|| std::memcmp( header, SPILL_MAGIC, sizeof( SPILL_MAGIC ) ) != 0 ) {
+		::close( myFile );
+		SPILL_ERROR( "Error: '" + path + "' is not a spill file." );
+	}
+	myLength = info.st_size;
+	std::memcpy( &myCount, header + sizeof( SPILL_MAGIC ), sizeof( myCount ) );
+
+	//----------------------------------------------------------------------
+	// A window has to be whole pages, and hold a whole record wherever in
+	// its first page the record starts.
+	unsigned long long page = sysconf( _SC_PAGESIZE );
+	if( window < page + MAX_RECORD ) {
+		window = page + MAX_RECORD;
+	}
+	myWindowSize = ( window + page - 1 ) / page * page;
+}
+
+
+//------------------------------------------------------------------------------
+SpillReader::~SpillReader() {
+	unmap();
+	::close( myFile );
+}
+
+
+//------------------------------------------------------------------------------
+bool SpillReader::next( Module &mod ) {
+	const char *r = record();
+	if( !r ) {
+		return false;
+	}
+	ModuleString::size_type count = (unsigned char)r[1];
+	mod.name = r[0];
+	mod.parameters.resize( count );
+	if( count ) {
+		std::memcpy( mod.parameters.data(), r + 2, count * sizeof( double ) );
+	}
+	myPosition += 2 + count * sizeof( double );
+	return true;
+}
+
+
+//------------------------------------------------------------------------------
+ModuleString::size_type SpillReader::next( ModuleString &block,
+	ModuleString::size_type max )
+{
+	block.clear();
+	const char *r;
+	while( block.size() < max && ( r = record() ) ) {
+		ModuleString::size_type count = (unsigned char)r[1];
+		double *params = block.push_back( r[0], count );
+		if( count ) {
+			std::memcpy( params, r + 2, count * sizeof( double ) );
+		}
+		myPosition += 2 + count * sizeof( double );
+	}
+	return block.size();
+}
+
+
+//------------------------------------------------------------------------------
+void SpillReader::rewind() {
+	myPosition = HEADER_SIZE;
+}
+
+
+//------------------------------------------------------------------------------
+const char *SpillReader::record() {
+	if( myPosition >= myLength ) {
+		return NULL;
+	}
+	unsigned long long end = myWindowStart + myWindowLength;
+	if( !myWindow || myPosition < myWindowStart || myPosition + 2 > end ) {
+		map( myPosition );
+		end = myWindowStart + myWindowLength;
+	}
+	const char *r = myWindow + ( myPosition - myWindowStart );
+	unsigned long long bytes = 2 + (unsigned char)r[1] * sizeof( double );
+	if( myPosition + bytes > end ) {
+		map( myPosition );
+		end = myWindowStart + myWindowLength;
+		r = myWindow + ( myPosition - myWindowStart );
+	}
+	if( myPosition + bytes > end ) {
+		SPILL_ERROR( "Error: Spill file '" + myPath + "' is truncated." );
+	}
+	return r;
+}
+
+
+//------------------------------------------------------------------------------
+void SpillReader::map( unsigned long long position ) {
+	unmap();
+	unsigned long long page = sysconf( _SC_PAGESIZE );
+	myWindowStart = position / page * page;
+	myWindowLength = myLength - myWindowStart;
+	if( myWindowLength > myWindowSize ) {
+		myWindowLength = myWindowSize;
+	}
+	void *window = mmap( NULL, myWindowLength, PROT_READ, MAP_PRIVATE,
+		myFile, myWindowStart );
+	if( window == MAP_FAILED ) {
+		myWindowLength = 0;
+		SPILL_ERROR( spillMessage( "map", myPath ) );
+	}
+	madvise( window, myWindowLength, MADV_SEQUENTIAL );
+	myWindow = (char *)window;
+}
+
+
+//------------------------------------------------------------------------------
+void SpillReader::unmap() {
+	if( myWindow ) {
+		munmap( myWindow, myWindowLength );
+		myWindow = NULL;
+	}
+}
+
+} // End of LSystem namespace
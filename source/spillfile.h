@@ -0,0 +1,283 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#ifndef SPILLFILE_H
+#define SPILLFILE_H
+
+#include "modulesource.h"
+#include "modulestring.h"
+
+#include <string>
+#include <vector>
+
+namespace LSystem {
+
+///-----------------------------------------------------------------------------
+/// Writes a generation of modules to a spill file, in order.
+///
+/// A spill file is a 16 byte header, the magic "LSYSPIL1" and the number
+/// of modules, followed by one record per module: its name, its number of
+/// parameters as one byte, and the parameters as raw doubles.  Records are
+/// packed with no padding, so a module with no parameters takes 2 bytes.
+///
+/// Records are gathered into a fixed size chunk which is written out when
+/// full, so however long the generation only one chunk is held in memory.
+/// The module count in the header is filled in by close().
+///
+/// Throws pointers to Error's if the file can't be written.
+///
+/// @author Lakin Wecker aka nikal@nucleus.com
+///
+/// @see LSystem::SpillReader
+/// @see LSystem::Parser::spillSystem
+///-----------------------------------------------------------------------------
+class SpillWriter {
+
+//==============================================================================
+// Private Variables
+//==============================================================================
+private:
+
+	std::string myPath;
+	int myFile;
+	std::vector<char> myChunk;
+	std::vector<char>::size_type myUsed;
+	unsigned long long myCount;
+
+//==============================================================================
+// Public Methods
+//==============================================================================
+public:
+
+	///---------------------------------------------------------------------
+	/// The bytes gathered before they are written out.
+	///---------------------------------------------------------------------
+	static const std::vector<char>::size_type CHUNK_SIZE = 1 << 20;
+
+
+	//----------------------------------------------------------------------
+	// Constructors
+
+	///---------------------------------------------------------------------
+	/// Creates, or truncates, the spill file at path.
+	///---------------------------------------------------------------------
+	SpillWriter( const std::string &path );
+
+
+	//----------------------------------------------------------------------
+	// Destructor
+
+	///---------------------------------------------------------------------
+	/// Closes the file if close() hasn't been called.  Errors are lost,
+	/// call close() to see them.
+	///---------------------------------------------------------------------
+	virtual ~SpillWriter();
+
+
+	//----------------------------------------------------------------------
+	// Getters
+
+	///---------------------------------------------------------------------
+	/// The number of modules written so far.
+	///---------------------------------------------------------------------
+	unsigned long long size() const {
+		return myCount;
+	}
+
+
+	//----------------------------------------------------------------------
+	// Public API
+
+	///---------------------------------------------------------------------
+	/// Appends a module named name with count parameters.  At most 255
+	/// parameters can be spilled.
+	///---------------------------------------------------------------------
+	void push_back( char name, const double *params, ModuleString::size_type count );
+
+
+	///---------------------------------------------------------------------
+	/// Appends all the modules of s.
+	///---------------------------------------------------------------------
+	void append( const ModuleString &s );
+
+
+	///---------------------------------------------------------------------
+	/// Writes out what is left, fills in the header and closes the file.
+	///---------------------------------------------------------------------
+	void close();
+
+//==============================================================================
+// Private Methods
+//==============================================================================
+private:
+
+	///---------------------------------------------------------------------
+	/// Writes the chunk out and empties it.
+	///---------------------------------------------------------------------
+	void flush();
+
+	// Not copyable, the file belongs to one writer.
+	SpillWriter( const SpillWriter & );
+	SpillWriter &operator=( const SpillWriter & );
+
+}; // End of SpillWriter
+
+
+///-----------------------------------------------------------------------------
+/// Reads a spill file written by SpillWriter back, in order.
+///
+/// The file is memory mapped a window at a time and the window slides
+/// along as the records are read, so only about a window of it is ever
+/// resident no matter how big the file is.
+///
+/// LSystem::SpillReader reader( parser.spillSystem( "/var/tmp/forest" ) );
+/// renderer.setinput( reader );
+///
+/// Throws pointers to Error's if the file can't be read or isn't a spill
+/// file.
+///
+/// @author Lakin Wecker aka nikal@nucleus.com
+///
+/// @see LSystem::SpillWriter
+///-----------------------------------------------------------------------------
+class SpillReader : public ModuleSource {
+
+//==============================================================================
+// Private Variables
+//==============================================================================
+private:
+
+	std::string myPath;
+	int myFile;
+	unsigned long long myLength;
+	unsigned long long myCount;
+	unsigned long long myWindowSize;
+	// The mapped window, file bytes [myWindowStart, myWindowStart +
+	// myWindowLength), and where the next record starts in the file.
+	char *myWindow;
+	unsigned long long myWindowStart;
+	unsigned long long myWindowLength;
+	unsigned long long myPosition;
+
+//==============================================================================
+// Public Methods
+//==============================================================================
+public:
+
+	///---------------------------------------------------------------------
+	/// How much of the file is mapped at once by default.
+	///---------------------------------------------------------------------
+	static const unsigned long long WINDOW_SIZE = 16 << 20;
+
+
+	//----------------------------------------------------------------------
+	// Constructors
+
+	///---------------------------------------------------------------------
+	/// Opens the spill file at path, mapping window bytes of it at once.
+	///---------------------------------------------------------------------
+	SpillReader( const std::string &path,
+		unsigned long long window = WINDOW_SIZE );
+
+
+	//----------------------------------------------------------------------
+	// Destructor
+
+	///---------------------------------------------------------------------
+	/// Unmaps and closes the file.
+	///---------------------------------------------------------------------
+	virtual ~SpillReader();
+
+
+	//----------------------------------------------------------------------
+	// Getters
+
+	///---------------------------------------------------------------------
+	/// The number of modules in the file.
+	///---------------------------------------------------------------------
+	unsigned long long size() const {
+		return myCount;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The size of the file in bytes.
+	///---------------------------------------------------------------------
+	unsigned long long length() const {
+		return myLength;
+	}
+
+
+	//----------------------------------------------------------------------
+	// Public API
+
+	///---------------------------------------------------------------------
+	/// @see LSystem::ModuleSource::next
+	///---------------------------------------------------------------------
+	virtual bool next( Module &mod );
+
+
+	///---------------------------------------------------------------------
+	/// Reads up to max modules into the packed block, replacing whatever
+	/// it held.
+	///
+	/// @return the number of modules read, 0 at the end.
+	///---------------------------------------------------------------------
+	ModuleString::size_type next( ModuleString &block,
+		ModuleString::size_type max );
+
+
+	///---------------------------------------------------------------------
+	/// Starts reading over from the first module.
+	///---------------------------------------------------------------------
+	void rewind();
+
+//==============================================================================
+// Private Methods
+//==============================================================================
+private:
+
+	///---------------------------------------------------------------------
+	/// Finds the next record, sliding the window along if it isn't all
+	/// mapped.
+	///
+	/// @return the record, or NULL at the end of the file.
+	///---------------------------------------------------------------------
+	const char *record();
+
+
+	///---------------------------------------------------------------------
+	/// Maps the window starting at the page holding file byte position.
+	///---------------------------------------------------------------------
+	void map( unsigned long long position );
+
+
+	///---------------------------------------------------------------------
+	/// Unmaps the window, if one is mapped.
+	///---------------------------------------------------------------------
+	void unmap();
+
+	// Not copyable, the mapping belongs to one reader.
+	SpillReader( const SpillReader & );
+	SpillReader &operator=( const SpillReader & );
+
+}; // End of SpillReader
+
+} // End of LSystem namespace
+
+#endif
@@ -0,0 +1,114 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#include "symbolgraph.h"
+
+namespace LSystem {
+
+//------------------------------------------------------------------------------
+SymbolGraph::SymbolGraph( const ProductionSet &productions,
+	const ModuleString &start )
+	:
+	mySymbols(),
+	myIndex(),
+	myStart(),
+	myProductions(),
+	myChildren()
+{
+	for( ModuleString::size_type i = 0; i < start.size(); ++i ) {
+		myStart.push_back( intern( start.name( i ), start.parameterCount( i ) ) );
+	}
+
+	//----------------------------------------------------------------------
+	// Find the successors of every production of every symbol, which
+	// finds the symbols reachable from it, until there are no new ones.
+	for( std::vector<Symbol>::size_type s = 0; s < mySymbols.size(); ++s ) {
+		char name = mySymbols[s].first;
+		ModuleString::size_type arity = mySymbols[s].second;
+		unsigned int count = productions.matchCount( name, arity );
+
+		std::vector<Production *> candidates;
+		std::vector< std::vector<unsigned int> > children( count );
+		for( unsigned int n = 0; n < count; ++n ) {
+			Production *prod = productions.candidate( name, arity, n );
+			const SuccessorVec &v = prod->getSuccessorVec();
+			for( SuccessorVec::size_type m = 0; m < v.size(); ++m ) {
+				children[n].push_back( intern( v[m].getName()[0],
+					v[m].getExpressionPtrVec().size() ) );
+			}
+			candidates.push_back( prod );
+		}
+		myProductions.push_back( candidates );
+		myChildren.push_back( children );
+	}
+}
+
+
+//------------------------------------------------------------------------------
+std::vector< std::vector<SymbolGraph::length_type> > SymbolGraph::lengths(
+	int depth ) const
+{
+	//----------------------------------------------------------------------
+	// A symbol is one module after no generations, and after d as many
+	// as its successors are after d - 1, unless it or any of them is
+	// rewritten at random.
+	std::vector< std::vector<length_type> > table( depth < 0 ? 1 : depth + 1 );
+	table[0].assign( mySymbols.size(), 1 );
+	for( int d = 1; d <= depth; ++d ) {
+		const std::vector<length_type> &previous = table[d - 1];
+		std::vector<length_type> &lengths = table[d];
+		lengths.assign( mySymbols.size(), 1 );
+		for( std::vector<Symbol>::size_type s = 0; s < mySymbols.size(); ++s ) {
+			if( myProductions[s].size() > 1 ) {
+				lengths[s] = RANDOM;
+				continue;
+			}
+			if( myProductions[s].empty() ) {
+				continue;
+			}
+			const std::vector<unsigned int> &children = myChildren[s][0];
+			length_type length = 0;
+			for( std::vector<unsigned int>::size_type c = 0;
+				c < children.size() && length != RANDOM; ++c ) {
+				length_type add = previous[ children[c] ];
+				if( add == RANDOM ) {
+					length = RANDOM;
+				} else {
+					length = add >= MOST - length ? MOST : length + add;
+				}
+			}
+			lengths[s] = length;
+		}
+	}
+	return table;
+}
+
+
+//------------------------------------------------------------------------------
+unsigned int SymbolGraph::intern( char name, ModuleString::size_type arity ) {
+	Symbol key( name, arity );
+	std::map<Symbol, unsigned int>::iterator found = myIndex.find( key );
+	if( found != myIndex.end() ) {
+		return found->second;
+	}
+	mySymbols.push_back( key );
+	myIndex[ key ] = mySymbols.size() - 1;
+	return mySymbols.size() - 1;
+}
+
+} // End of LSystem namespace
@@ -0,0 +1,176 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#ifndef SYMBOLGRAPH_H
+#define SYMBOLGRAPH_H
+
+#include "productionset.h"
+
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace LSystem {
+
+///-----------------------------------------------------------------------------
+/// The symbols an LSystem can reach and what each is rewritten into.
+///
+/// Every (module name, arity) pair reachable from the start modules is a
+/// symbol, numbered in the order found, the start modules' first.  For
+/// each the graph holds the productions it could be rewritten by, in the
+/// order ProductionSet::candidate() gives them, and the symbols of every
+/// one's successors.  From these it works out how many modules one of
+/// each symbol becomes after any number of generations.
+///
+/// GrowthMatrix, ModuleIndex and ModuleRope all build on it.  It refers
+/// to the productions it was built from, which must outlive it.
+///
+/// @author Lakin Wecker aka nikal@nucleus.com
+///-----------------------------------------------------------------------------
+class SymbolGraph {
+
+//==============================================================================
+// Typedefs
+//==============================================================================
+public:
+	typedef std::pair<char, ModuleString::size_type> Symbol;
+	typedef unsigned long long length_type;
+
+	///---------------------------------------------------------------------
+	/// The length of a symbol picked at random somewhere on the way,
+	/// which isn't known until it is derived.
+	///---------------------------------------------------------------------
+	static const length_type RANDOM = ~0ULL;
+
+	///---------------------------------------------------------------------
+	/// The length of a symbol expanding into more modules than can be
+	/// counted.
+	///---------------------------------------------------------------------
+	static const length_type MOST = ~0ULL - 1;
+
+//==============================================================================
+// Private Variables
+//==============================================================================
+private:
+
+	std::vector<Symbol> mySymbols;
+	std::map<Symbol, unsigned int> myIndex;
+	std::vector<unsigned int> myStart;
+	// myProductions[s] lists the productions s could be rewritten by,
+	// and myChildren[s][n] the symbols of candidate n's successors.
+	std::vector< std::vector<Production *> > myProductions;
+	std::vector< std::vector< std::vector<unsigned int> > > myChildren;
+
+//==============================================================================
+// Public Methods
+//==============================================================================
+public:
+
+	//----------------------------------------------------------------------
+	// Constructors
+
+	///---------------------------------------------------------------------
+	/// Finds the symbols reachable from start rewritten by productions,
+	/// which has to have been compiled.
+	///---------------------------------------------------------------------
+	SymbolGraph( const ProductionSet &productions, const ModuleString &start );
+
+
+	//----------------------------------------------------------------------
+	// Destructor
+
+	///---------------------------------------------------------------------
+	/// Deletes a SymbolGraph instance.
+	///---------------------------------------------------------------------
+	virtual ~SymbolGraph()
+	{
+	}
+
+
+	//----------------------------------------------------------------------
+	// Getters
+
+	///---------------------------------------------------------------------
+	/// The number of distinct (name, arity) symbols reachable.
+	///---------------------------------------------------------------------
+	std::vector<Symbol>::size_type symbolCount() const {
+		return mySymbols.size();
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The name and arity of symbol s.
+	///---------------------------------------------------------------------
+	const Symbol &symbol( unsigned int s ) const {
+		return mySymbols[s];
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The symbols of the start modules, in order.
+	///---------------------------------------------------------------------
+	const std::vector<unsigned int> &start() const {
+		return myStart;
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The productions symbol s could be rewritten by, none if it is
+	/// copied through and more than one if it is picked at random.
+	///---------------------------------------------------------------------
+	const std::vector<Production *> &productions( unsigned int s ) const {
+		return myProductions[s];
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The symbols of the successors of production n of symbol s.
+	///---------------------------------------------------------------------
+	const std::vector<unsigned int> &children( unsigned int s, unsigned int n ) const {
+		return myChildren[s][n];
+	}
+
+
+	//----------------------------------------------------------------------
+	// Public API
+
+	///---------------------------------------------------------------------
+	/// Works out how many modules one of each symbol is after 0 up to and
+	/// including depth generations.  lengths[d][s] is 1 for d = 0, and
+	/// after that the sum of what the successors of s are after d - 1,
+	/// or RANDOM if s or anything on the way is picked at random, or
+	/// MOST if it doesn't fit.
+	///---------------------------------------------------------------------
+	std::vector< std::vector<length_type> > lengths( int depth ) const;
+
+//==============================================================================
+// Private Methods
+//==============================================================================
+private:
+
+	///---------------------------------------------------------------------
+	/// The index of the symbol name with arity parameters, adding it if
+	/// it is new.
+	///---------------------------------------------------------------------
+	unsigned int intern( char name, ModuleString::size_type arity );
+
+}; // End of SymbolGraph
+
+} // End of LSystem namespace
+
+#endif
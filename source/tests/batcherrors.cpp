@@ -0,0 +1,79 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#include "check.h"
+#include "forestbatch.h"
+#include "parser.h"
+
+#include <atomic>
+#include <sstream>
+
+using namespace LSystem;
+
+//------------------------------------------------------------------------------
+// Every instance divides by zero in the last generation.
+static const char *DIVIDE_BY_ZERO =
+	"iterations: 15;\n"
+	"B(14.0);\n"
+	"B(l) => F(1.0/l)B(l-1.0)B(l-1.0);\n";
+
+// About half the instances divide by zero, the others draw one F.
+static const char *SOME_DIVIDE_BY_ZERO =
+	"iterations: 1;\n"
+	"B(0.0);\n"
+	"B(l) : 0.5 => F(1.0/l);\n"
+	"B(l) : 0.5 => F(l + 1.0);\n";
+
+static const unsigned int INSTANCES = 32;
+
+
+//------------------------------------------------------------------------------
+// An instance that throws is reported as failed, and the batch carries on
+// with the rest, however many threads it runs on.
+int main() {
+	unsigned int threads[] = { 1, 4 };
+	for( unsigned int t = 0; t < sizeof( threads ) / sizeof( threads[0] ); ++t ) {
+		Parser all( DIVIDE_BY_ZERO );
+		all.parseLSystem();
+		ForestBatch failing( all.getGrammar(), threads[t] );
+		failing.run( 0, INSTANCES );
+		CHECK( failing.failures() == INSTANCES );
+		CHECK( failing.instances()[0].error.find( "Division by zero" ) != std::string::npos );
+
+		Parser some( SOME_DIVIDE_BY_ZERO );
+		some.parseLSystem();
+		ForestBatch mixed( some.getGrammar(), threads[t] );
+		std::atomic<unsigned int> consumed( 0 );
+		mixed.run( 0, INSTANCES, [&]( const ForestInstance &, LRenderer & ) {
+			++consumed;
+		} );
+		CHECK( mixed.failures() > 0 );
+		CHECK( mixed.failures() < INSTANCES );
+		CHECK( consumed == INSTANCES - mixed.failures() );
+		for( unsigned int n = 0; n < INSTANCES; ++n ) {
+			const ForestInstance &i = mixed.instances()[n];
+			CHECK( i.seed == n );
+			CHECK( i.error.empty() == ( i.branches == 1 ) );
+		}
+
+		std::ostringstream report;
+		mixed.report( report );
+		CHECK( report.str().find( "failed: " ) != std::string::npos );
+	}
+	return checkResult();
+}
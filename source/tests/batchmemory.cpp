@@ -0,0 +1,93 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+
+#include "check.h"
+#include "forestbatch.h"
+#include "parser.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using namespace LSystem;
+
+//------------------------------------------------------------------------------
+// Every allocation is counted, with its size kept in front of it, so the
+// bytes live are known whichever thread allocates.
+static const std::size_t HEADER = 16;
+static std::atomic<std::size_t> live( 0 );
+
+void *operator new( std::size_t size ) {
+	char *p = (char *)std::malloc( size + HEADER );
+	if( !p ) {
+		throw std::bad_alloc();
+	}
+	*(std::size_t *)p = size;
+	live += size;
+	return p + HEADER;
+}
+
+void operator delete( void *p ) noexcept {
+	if( p ) {
+		char *block = (char *)p - HEADER;
+		live -= *(std::size_t *)block;
+		std::free( block );
+	}
+}
+
+void operator delete( void *p, std::size_t ) noexcept {
+	operator delete( p );
+}
+
+
+//------------------------------------------------------------------------------
+// A binary tree of 4095 branches, its last generation and geometry a few
+// megabytes an instance.
+static const char *TREE =
+	"iterations: 12;\n"
+	"B(1.0);\n"
+	"B(l) => F(l)[+(20.0)B(l * 0.7)][-(20.0)B(l * 0.7)];\n";
+
+static const unsigned int INSTANCES = 16;
+
+// What run() keeps besides, the instances themselves.
+static const std::size_t SLACK = 64 << 10;
+
+
+//------------------------------------------------------------------------------
+// Once run() returns, neither the threads' buffers nor the instances'
+// geometry are still held, however many threads made them.
+int main() {
+	Parser parser( TREE );
+	parser.parseLSystem();
+	unsigned int threads[] = { 1, 4 };
+	for( unsigned int t = 0; t < sizeof( threads ) / sizeof( threads[0] ); ++t ) {
+		ForestBatch batch( parser.getGrammar(), threads[t] );
+		std::size_t before = live;
+		std::size_t during = 0;
+		batch.run( 1, INSTANCES, [&]( const ForestInstance &, LRenderer & ) {
+			during = live;
+		} );
+		CHECK( batch.failures() == 0 );
+		CHECK( batch.instances()[0].branches == 4095 );
+		CHECK( during > before + 4 * SLACK );
+		CHECK( live < before + SLACK );
+	}
+	return checkResult();
+}
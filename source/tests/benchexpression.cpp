@@ -0,0 +1,126 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#include "expression.h"
+#include "expressioncode.h"
+#include "scanner.h"
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+
+using namespace LSystem;
+
+//------------------------------------------------------------------------------
+// Expressions like those in the example systems.
+static const char *EXPRESSIONS[] = {
+	"l * 0.2",
+	"w / 1.414",
+	"l * r - 0.5",
+	"(x * 46.9 + b) * 2.0",
+	"(y - a) / 7.0",
+	"-(l + w) * 0.5 + a / b"
+};
+
+static const unsigned int EVALUATIONS = 2000000;
+static const int RUNS = 5;
+
+
+//------------------------------------------------------------------------------
+// The best of RUNS timings of work, in nanoseconds per evaluation.
+template <typename Work>
+static double best( Work work ) {
+	double fastest = 0.0;
+	for( int run = 0; run < RUNS; ++run ) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		work();
+		double ns = std::chrono::duration<double, std::nano>(
+			std::chrono::steady_clock::now() - start ).count() / EVALUATIONS;
+		if( run == 0 || ns < fastest ) {
+			fastest = ns;
+		}
+	}
+	return fastest;
+}
+
+
+//------------------------------------------------------------------------------
+// Times walking the tree, evaluateExpression(), against running the code
+// compiled from it, alone and combined, for each expression.
+int main() {
+	std::vector<std::string> params;
+	params.push_back( "l" );
+	params.push_back( "w" );
+	params.push_back( "x" );
+	params.push_back( "y" );
+	SlotTable globals;
+	globals[ "a" ] = 0;
+	globals[ "b" ] = 1;
+	globals[ "r" ] = 2;
+	const double paramValues[] = { 10.0, 1.5, 3.0, 4.0 };
+	const SymbolFrame frame = { 1.5, 2.25, 0.8 };
+
+	std::cout << "ns per evaluation        tree     code  combined  speedup" << std::endl;
+	volatile double sink = 0.0;
+	for( const char *text : EXPRESSIONS ) {
+		Scanner scanner( text );
+		std::unique_ptr<Expression> expression( Expression::parseExpression( scanner ) );
+		expression->compile( params, globals );
+		ExpressionCode combined;
+		combined.combine( std::vector<const ExpressionCode *>( 1, &expression->getCode() ), frame );
+
+		std::map<std::string, double> table;
+		for( std::vector<std::string>::size_type p = 0; p < params.size(); ++p ) {
+			table[ params[p] ] = paramValues[p];
+		}
+		for( SlotTable::const_iterator g = globals.begin(); g != globals.end(); ++g ) {
+			table[ g->first ] = frame[ g->second ];
+		}
+
+		double tree = best( [&]() {
+			for( unsigned int n = 0; n < EVALUATIONS; ++n ) {
+				sink = sink + expression->evaluateExpression( table );
+			}
+		} );
+		double code = best( [&]() {
+			for( unsigned int n = 0; n < EVALUATIONS; ++n ) {
+				sink = sink + expression->evaluate( paramValues, frame.data() );
+			}
+		} );
+		double folded = best( [&]() {
+			double out;
+			for( unsigned int n = 0; n < EVALUATIONS; ++n ) {
+				combined.evaluate( paramValues, frame.data(), &out );
+				sink = sink + out;
+			}
+		} );
+
+		std::cout.width( 22 );
+		std::cout << std::left << text << std::right << std::fixed;
+		std::cout.precision( 1 );
+		std::cout.width( 8 );
+		std::cout << tree;
+		std::cout.width( 9 );
+		std::cout << code;
+		std::cout.width( 10 );
+		std::cout << folded;
+		std::cout.width( 8 );
+		std::cout << tree / code << "x" << std::endl;
+	}
+	return 0;
+}
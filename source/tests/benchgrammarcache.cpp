@@ -0,0 +1,121 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+
+#include "grammarcache.h"
+#include "parser.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <unistd.h>
+
+using namespace LSystem;
+
+//------------------------------------------------------------------------------
+// How many productions the generated grammar has, about 1.4 MB of them.
+static const unsigned int PRODUCTIONS = 10000;
+static const int RUNS = 3;
+
+
+//------------------------------------------------------------------------------
+// The best of RUNS timings of work, in seconds.
+template <typename Work>
+static double best( Work work, int runs = RUNS ) {
+	double fastest = 0.0;
+	for( int run = 0; run < runs; ++run ) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		work();
+		double seconds = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - start ).count();
+		if( run == 0 || seconds < fastest ) {
+			fastest = seconds;
+		}
+	}
+	return fastest;
+}
+
+
+//------------------------------------------------------------------------------
+// A grammar of many stochastic productions with parameters, branches and
+// arithmetic, like the larger example systems but far longer.
+static std::string generatedGrammar() {
+	std::mt19937 random( 2004 );
+	std::ostringstream grammar;
+	grammar << "a: 1.5;\nb: 2.25;\niterations: 3;\nA(1,2)B(3.5,4);\n";
+	for( unsigned int n = 0; n < PRODUCTIONS; ++n ) {
+		grammar << (char)( 'A' + random() % 10 ) << "(x,y) : 0." << 1 + random() % 9 << " => ";
+		for( int s = 0; s < 3; ++s ) {
+			grammar << (char)( 'A' + random() % 10 ) << "(x * " << random() % 100 << "."
+				<< random() % 10 << " + b, (y - a) / " << 1 + random() % 9 << ".0)";
+			grammar << ( random() % 2 ? "/(137.5)" : "[+(22.5)F(x)]" );
+		}
+		grammar << ";\n";
+	}
+	return grammar.str();
+}
+
+
+//------------------------------------------------------------------------------
+// Times parsing a generated grammar with no cache, against parsing it
+// into an empty cache, which also stores it, and against loading it back
+// from the warm cache as a second run of the same file does.
+int main() {
+	const std::string text = generatedGrammar();
+	char directory[] = "/tmp/benchgrammarcacheXXXXXX";
+	if( !mkdtemp( directory ) ) {
+		std::cerr << "cannot make a cache directory" << std::endl;
+		return 1;
+	}
+	bool hits = true;
+
+	double plain = best( [&]() {
+		Parser parser( text );
+		parser.parseLSystem();
+	} );
+	double cold = best( [&]() {
+		Parser parser( text );
+		parser.setGrammarCache( directory );
+		parser.parseLSystem();
+	}, 1 );
+	double warm = best( [&]() {
+		Parser parser( text );
+		parser.setGrammarCache( directory );
+		parser.parseLSystem();
+		hits = hits && parser.getCached();
+	} );
+
+	std::remove( GrammarCache( directory ).path( text ).c_str() );
+	rmdir( directory );
+	if( !hits ) {
+		std::cerr << "the warm runs missed the cache" << std::endl;
+		return 1;
+	}
+
+	std::cout.precision( 3 );
+	std::cout << std::fixed << text.size() / 1e6 << " MB, " << PRODUCTIONS << " productions, seconds" << std::endl;
+	std::cout << "  parse, no cache       " << plain << std::endl;
+	std::cout << "  parse and store       " << cold << std::endl;
+	std::cout << "  load from the cache   " << warm << std::endl;
+	std::cout.precision( 1 );
+	std::cout << "  " << plain / warm << "x faster from the cache" << std::endl;
+	return 0;
+}
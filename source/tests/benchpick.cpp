@@ -0,0 +1,112 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#include "parser.h"
+#include "random.h"
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+
+using namespace LSystem;
+
+//------------------------------------------------------------------------------
+static const unsigned int MATCHES = 20000000;
+static const int RUNS = 3;
+
+
+//------------------------------------------------------------------------------
+// The best of RUNS timings of work, in nanoseconds per match.
+template <typename Work>
+static double best( Work work ) {
+	double fastest = 0.0;
+	for( int run = 0; run < RUNS; ++run ) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		work();
+		double ns = std::chrono::duration<double, std::nano>(
+			std::chrono::steady_clock::now() - start ).count() / MATCHES;
+		if( run == 0 || ns < fastest ) {
+			fastest = ns;
+		}
+	}
+	return fastest;
+}
+
+
+//------------------------------------------------------------------------------
+// A grammar rewriting A(x) by any of alternatives productions, of unequal
+// probabilities.
+static std::string alternativesGrammar( unsigned int alternatives ) {
+	std::ostringstream grammar;
+	grammar << "iterations: 1;\nA(1.0);\n";
+	for( unsigned int n = 0; n < alternatives; ++n ) {
+		grammar << "A(x) : " << 1 + n % 7 << ".0 => F(x * " << n << ".0);\n";
+	}
+	return grammar.str();
+}
+
+
+//------------------------------------------------------------------------------
+// Times picking one of several stochastic productions from the alias
+// tables, ProductionSet::match(), against walking the predecessor's list
+// of productions summing their probabilities, as picking used to.
+int main() {
+	std::cout << "ns per match" << std::endl;
+	std::cout << "  alternatives  list scan  alias table" << std::endl;
+	unsigned int counts[] = { 2, 16, 64, 256 };
+	volatile unsigned long sink = 0;
+	for( unsigned int alternatives : counts ) {
+		// The text has to outlive parseLSystem().
+		std::string grammar = alternativesGrammar( alternatives );
+		Parser parser( grammar );
+		parser.parseLSystem();
+		const ProductionSet &set = parser.getProductionSet();
+		const std::list<Production> &productions = set.getProductions().begin()->second;
+		unsigned long long seed = set.getSeed();
+
+		double scan = best( [&]() {
+			for( unsigned int i = 0; i < MATCHES; ++i ) {
+				double rand = randdouble( seed, 1, i, 0.0, 1.0 );
+				double sum = 0.0;
+				std::list<Production>::const_iterator p = productions.begin();
+				for( ; p != productions.end(); ++p ) {
+					sum += p->getProbability();
+					if( rand <= sum ) {
+						break;
+					}
+				}
+				sink = sink + ( p != productions.end() );
+			}
+		} );
+		double alias = best( [&]() {
+			for( unsigned int i = 0; i < MATCHES; ++i ) {
+				sink = sink + ( set.match( 'A', 1, seed, 1, i ) != NULL );
+			}
+		} );
+
+		std::cout.precision( 1 );
+		std::cout << std::fixed;
+		std::cout.width( 14 );
+		std::cout << alternatives;
+		std::cout.width( 11 );
+		std::cout << scan;
+		std::cout.width( 13 );
+		std::cout << alias << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,129 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#include "parser.h"
+#include "scanner.h"
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+using namespace LSystem;
+
+//------------------------------------------------------------------------------
+// How many productions the generated grammar has, about 5 MB of them.
+static const unsigned int PRODUCTIONS = 40000;
+static const int RUNS = 3;
+
+
+//------------------------------------------------------------------------------
+// The best of RUNS timings of work, in seconds.
+template <typename Work>
+static double best( Work work, int runs = RUNS ) {
+	double fastest = 0.0;
+	for( int run = 0; run < runs; ++run ) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		work();
+		double seconds = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - start ).count();
+		if( run == 0 || seconds < fastest ) {
+			fastest = seconds;
+		}
+	}
+	return fastest;
+}
+
+
+//------------------------------------------------------------------------------
+// A grammar of many stochastic productions with parameters, branches and
+// arithmetic, like the larger example systems but far longer.
+static std::string generatedGrammar() {
+	std::mt19937 random( 2004 );
+	std::ostringstream grammar;
+	grammar << "a: 1.5;\nb: 2.25;\niterations: 3;\nA(1,2)B(3.5,4);\n";
+	for( unsigned int n = 0; n < PRODUCTIONS; ++n ) {
+		grammar << (char)( 'A' + random() % 10 ) << "(x,y) : 0." << 1 + random() % 9 << " => ";
+		for( int s = 0; s < 3; ++s ) {
+			grammar << (char)( 'A' + random() % 10 ) << "(x * " << random() % 100 << "."
+				<< random() % 10 << " + b, (y - a) / " << 1 + random() % 9 << ".0)";
+			grammar << ( random() % 2 ? "/(137.5)" : "[+(22.5)F(x)]" );
+		}
+		grammar << ";\n";
+	}
+	return grammar.str();
+}
+
+
+//------------------------------------------------------------------------------
+// Lexes all of scanner, returning the number of lexemes.
+static unsigned long lexAll( Scanner &scanner ) {
+	unsigned long lexemes = 0;
+	while( scanner.lex().getType() != Token::END_OF_FILE ) {
+		++lexemes;
+	}
+	return lexemes;
+}
+
+
+//------------------------------------------------------------------------------
+// Times scanning a generated multi megabyte grammar in place, from a
+// std::string_view as a mapped file is, against scanning it from a
+// stream, and against reading the stream a char at a time with
+// std::istream::get() as the scanner once did, before any lexing.  Then
+// times parsing it whole both ways.
+int main() {
+	const std::string text = generatedGrammar();
+	double megabytes = text.size() / 1e6;
+	volatile unsigned long sink = 0;
+
+	double get = best( [&]() {
+		std::istringstream in( text );
+		char c;
+		while( in.get( c ) ) {
+			sink = sink + c;
+		}
+	} );
+	double stream = best( [&]() {
+		std::istringstream in( text );
+		Scanner scanner( in );
+		sink = sink + lexAll( scanner );
+	} );
+	double inPlace = best( [&]() {
+		Scanner scanner( text );
+		sink = sink + lexAll( scanner );
+	} );
+	double parseStream = best( [&]() {
+		std::istringstream in( text );
+		Parser parser( in );
+		parser.parseLSystem();
+	}, 1 );
+	double parseInPlace = best( [&]() {
+		Parser parser( text );
+		parser.parseLSystem();
+	}, 1 );
+
+	std::cout.precision( 1 );
+	std::cout << std::fixed << megabytes << " MB, " << PRODUCTIONS << " productions, MB/s" << std::endl;
+	std::cout << "  istream::get() alone  " << megabytes / get << std::endl;
+	std::cout << "  lex from a stream     " << megabytes / stream << std::endl;
+	std::cout << "  lex in place          " << megabytes / inPlace << std::endl;
+	std::cout << "  parse from a stream   " << megabytes / parseStream << std::endl;
+	std::cout << "  parse in place        " << megabytes / parseInPlace << std::endl;
+	return 0;
+}
@@ -0,0 +1,76 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#ifndef CHECK_H
+#define CHECK_H
+
+#include "error.h"
+
+#include <iostream>
+
+///-----------------------------------------------------------------------------
+/// What the check programs share.  Each is a main() that runs its checks
+/// with CHECK and returns checkResult(), so make check fails if any did.
+///-----------------------------------------------------------------------------
+
+namespace LSystem {
+
+static int checkFailures = 0;
+
+///-----------------------------------------------------------------------------
+/// Reports what failed, and where, if ok is false.
+///-----------------------------------------------------------------------------
+inline void check( bool ok, const char *what, const char *file, int line ) {
+	if( !ok ) {
+		std::cerr << file << ":" << line << ": check failed: " << what << std::endl;
+		++checkFailures;
+	}
+}
+
+#define CHECK(x) LSystem::check( (x), #x, __FILE__, __LINE__ )
+
+
+///-----------------------------------------------------------------------------
+/// Whether work throws an Error, which is deleted.
+///-----------------------------------------------------------------------------
+template <typename Work>
+bool throwsError( Work work ) {
+	try {
+		work();
+	} catch( Error *e ) {
+		delete e;
+		return true;
+	}
+	return false;
+}
+
+
+///-----------------------------------------------------------------------------
+/// The exit status of the check program.
+///-----------------------------------------------------------------------------
+inline int checkResult() {
+	if( checkFailures ) {
+		std::cerr << checkFailures << " check(s) failed" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+} // End of LSystem namespace
+
+#endif
@@ -0,0 +1,175 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+
+#include "check.h"
+#include "parser.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <sstream>
+
+using namespace LSystem;
+
+//------------------------------------------------------------------------------
+// A binary tree whose lengths all differ, over a megabyte coded so it
+// spans many blocks, with the parameterless [ and ] between.
+static const char *TREE =
+	"iterations: 16;\n"
+	"B(1.0, 0.5);\n"
+	"B(l, w) => F(l)[+(22.5)B(l * 0.71, w * 0.9)][-(31.0)B(l * 0.63, w * 0.8)]/(137.5);\n";
+
+// Stochastic, so the same column sees values come and go.
+static const char *BUSH =
+	"iterations: 7;\n"
+	"A(1);\n"
+	"A(x) : 0.4 => F(x)[+(x)A(x + 1)]A(x);\n"
+	"A(x) : 0.6 => F(x * 0.5)[-(25)A(x)][&(x)A(x * 2)];\n";
+
+
+//------------------------------------------------------------------------------
+// Every letter with 0 to 11 parameters, more symbols than the 255 the
+// table holds, so the last ones are spelt out in full.
+static std::string manySymbols() {
+	std::ostringstream grammar;
+	grammar << "iterations: 2;\n";
+	for( char c = 'A'; c <= 'Z'; ++c ) {
+		for( int k = 0; k < 12; ++k ) {
+			grammar << c;
+			if( k ) {
+				grammar << "(";
+				for( int i = 0; i < k; ++i ) {
+					grammar << ( i ? "," : "" ) << i + k * 0.25;
+				}
+				grammar << ")";
+			}
+		}
+	}
+	grammar << ";\nA(x) => A(x * 1.5)B(x, x)[+(x)]A;\n";
+	return grammar.str();
+}
+
+
+//------------------------------------------------------------------------------
+// Whether module i of s is name with the count parameters params, bit for
+// bit.
+static bool same( const ModuleString &s, ModuleString::size_type i, char name,
+	const double *params, ModuleString::size_type count )
+{
+	return s.name( i ) == name && s.parameterCount( i ) == count
+		&& ( count == 0 || std::memcmp( s.parameters( i ), params,
+			count * sizeof( double ) ) == 0 );
+}
+
+
+//------------------------------------------------------------------------------
+// Whether reading compressed back a module at a time, and a block of
+// max at a time, both give expected.
+static bool readsBack( const CompressedString &compressed, const ModuleString &expected,
+	ModuleString::size_type max )
+{
+	if( compressed.size() != expected.size() ) {
+		return false;
+	}
+	CompressedReader reader( compressed );
+	Module m;
+	ModuleString::size_type i = 0;
+	for( ; reader.next( m ); ++i ) {
+		if( i >= expected.size() || !same( expected, i, m.name,
+				m.parameters.data(), m.parameters.size() ) ) {
+			return false;
+		}
+	}
+	if( i != expected.size() ) {
+		return false;
+	}
+
+	reader.rewind();
+	ModuleString block;
+	i = 0;
+	while( ModuleString::size_type n = reader.next( block, max ) ) {
+		if( n != block.size() || n > max ) {
+			return false;
+		}
+		for( ModuleString::size_type j = 0; j < n; ++j, ++i ) {
+			if( i >= expected.size() || !same( expected, i, block.name( j ),
+					block.parameters( j ), block.parameterCount( j ) ) ) {
+				return false;
+			}
+		}
+	}
+	return i == expected.size();
+}
+
+
+//------------------------------------------------------------------------------
+// compressSystem() read back gives what evaluateSystem() does, bit for
+// bit, across blocks, past a full symbol table and for modules without
+// parameters, as does a string of awkward values written directly.
+int main() {
+	std::string many = manySymbols();
+	const char *texts[] = { TREE, BUSH, many.c_str() };
+	for( unsigned int t = 0; t < sizeof( texts ) / sizeof( texts[0] ); ++t ) {
+		Parser parser( texts[t] );
+		parser.parseLSystem();
+		ModuleString expected = parser.evaluateSystem();
+		CompressedString compressed = parser.compressSystem();
+		CHECK( readsBack( compressed, expected, 7 ) );
+		CHECK( readsBack( compressed, expected, 100000 ) );
+
+		// A copy reads back the same.
+		CompressedString copy( compressed );
+		CHECK( readsBack( copy, expected, 4096 ) );
+	}
+
+	// The tree really does span blocks.
+	Parser tree( TREE );
+	tree.parseLSystem();
+	CHECK( tree.compressSystem().bytes() > 4 * CompressedString::BLOCK_SIZE );
+
+	//----------------------------------------------------------------------
+	// Values the parser won't make, each in a column of its own and
+	// repeated so the dictionary sees them, with no parameters between.
+	const double awkward[] = { 0.0, -0.0, 1.0, -1.0,
+		std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity(),
+		std::numeric_limits<double>::quiet_NaN(), std::numeric_limits<double>::denorm_min(),
+		std::numeric_limits<double>::max(), std::numeric_limits<double>::min() };
+	const unsigned int AWKWARD = sizeof( awkward ) / sizeof( awkward[0] );
+	CompressedString direct;
+	ModuleString expected;
+	for( unsigned int n = 0; n < 20000; ++n ) {
+		double params[3] = { awkward[ n % AWKWARD ], awkward[ ( n * 7 ) % AWKWARD ],
+			n * 0.001 };
+		char name = "XY["[ n % 3 ];
+		ModuleString::size_type count = name == '[' ? 0 : 1 + n % 3;
+		direct.push_back( name, params, count );
+		std::copy( params, params + count, expected.push_back( name, count ) );
+	}
+	direct.close();
+	CHECK( readsBack( direct, expected, 333 ) );
+
+	// Cleared, it is written afresh.
+	direct.clear();
+	expected.clear();
+	direct.push_back( '[', NULL, 0 );
+	expected.push_back( '[', 0 );
+	direct.close();
+	CHECK( readsBack( direct, expected, 1 ) );
+	return checkResult();
+}
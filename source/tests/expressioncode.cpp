@@ -0,0 +1,217 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#include "check.h"
+#include "expression.h"
+#include "expressioncode.h"
+#include "scanner.h"
+
+#include <cmath>
+#include <memory>
+#include <random>
+
+using namespace LSystem;
+
+//------------------------------------------------------------------------------
+// The parameters and globals the random expressions refer to.
+static const char *PARAMS[] = { "x", "y", "l" };
+static const char *GLOBALS[] = { "a", "b" };
+static const double PARAM_VALUES[] = { 3.5, -0.25, 7.0 };
+static const double GLOBAL_VALUES[] = { 1.5, 0.0 };
+
+static const unsigned int EXPRESSIONS = 20000;
+
+
+//------------------------------------------------------------------------------
+// A random expression up to depth deep, of numbers, identifiers, the four
+// operators, unary minus and parentheses.
+static std::string randomExpression( std::mt19937 &random, int depth ) {
+	unsigned int pick = random() % ( depth > 0 ? 10 : 4 );
+	switch( pick ) {
+		case 0:
+			return std::to_string( random() % 10 );
+		case 1:
+			return std::to_string( random() % 100 ) + "." + std::to_string( random() % 100 );
+		case 2:
+			return PARAMS[ random() % 3 ];
+		case 3:
+			return GLOBALS[ random() % 2 ];
+		case 4:
+			return "-" + randomExpression( random, depth - 1 );
+		case 5:
+			return "(" + randomExpression( random, depth - 1 ) + ")";
+		default: {
+			static const char *OPERATORS[] = { " + ", " - ", " * ", " / " };
+			return randomExpression( random, depth - 1 ) + OPERATORS[ pick - 6 ]
+				+ randomExpression( random, depth - 1 );
+		}
+	}
+}
+
+
+//------------------------------------------------------------------------------
+// The value of the expression walking the tree, or NAN if it divides by
+// zero.
+static double treeValue( Expression &expression ) {
+	std::map<std::string, double> table;
+	for( int p = 0; p < 3; ++p ) {
+		table[ PARAMS[p] ] = PARAM_VALUES[p];
+	}
+	for( int g = 0; g < 2; ++g ) {
+		table[ GLOBALS[g] ] = GLOBAL_VALUES[g];
+	}
+	double value = NAN;
+	if( throwsError( [&]() { value = expression.evaluateExpression( table ); } ) ) {
+		return NAN;
+	}
+	return value;
+}
+
+
+//------------------------------------------------------------------------------
+// The same, running code.
+static double codeValue( const ExpressionCode &code ) {
+	double value = NAN;
+	if( throwsError( [&]() { value = code.evaluate( PARAM_VALUES, GLOBAL_VALUES ); } ) ) {
+		return NAN;
+	}
+	return value;
+}
+
+static double combinedValue( const ExpressionCode &code ) {
+	double value = NAN;
+	if( throwsError( [&]() { code.evaluate( PARAM_VALUES, GLOBAL_VALUES, &value ); } ) ) {
+		return NAN;
+	}
+	return value;
+}
+
+
+//------------------------------------------------------------------------------
+// Whether a and b are the same value, or both errors.
+static bool same( double a, double b ) {
+	return a == b || ( std::isnan( a ) && std::isnan( b ) );
+}
+
+// Combined code may multiply by a reciprocal instead of dividing.
+static bool close( double a, double b ) {
+	return same( a, b ) || std::fabs( a - b ) <= 1e-9 * std::fabs( a );
+}
+
+
+//------------------------------------------------------------------------------
+// A balanced sum of 2 to the depth ones, each its own constant.
+static std::string ones( int depth ) {
+	if( depth == 0 ) {
+		return "1";
+	}
+	return "(" + ones( depth - 1 ) + " + " + ones( depth - 1 ) + ")";
+}
+
+
+//------------------------------------------------------------------------------
+// An identifier made of prefix and n spelt out in letters.
+static std::string identifier( const char *prefix, unsigned int n ) {
+	std::string name( prefix );
+	do {
+		name += (char)( 'a' + n % 26 );
+		n /= 26;
+	} while( n );
+	return name;
+}
+
+
+//------------------------------------------------------------------------------
+// Whether text compiles against params and globals, and if so evaluates
+// to value with the parameters and globals all 1.
+static bool compiles( const std::string &text, const std::vector<std::string> &params,
+	const SlotTable &globals, double value )
+{
+	Scanner scanner( text );
+	std::unique_ptr<Expression> expression( Expression::parseExpression( scanner ) );
+	if( throwsError( [&]() { expression->compile( params, globals ); } ) ) {
+		return false;
+	}
+	std::vector<double> p( params.size(), 1.0 );
+	std::vector<double> g( globals.size(), 1.0 );
+	CHECK( expression->evaluate( p.data(), g.data() ) == value );
+	return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Compiled code, alone and combined, gives what walking the tree does, the
+// tree being kept as the reference implementation.
+int main() {
+	std::vector<std::string> params( PARAMS, PARAMS + 3 );
+	SlotTable globals;
+	globals[ "a" ] = 0;
+	globals[ "b" ] = 1;
+	SymbolFrame frame( GLOBAL_VALUES, GLOBAL_VALUES + 2 );
+
+	std::mt19937 random( 2004 );
+	unsigned int divisions = 0;
+	for( unsigned int e = 0; e < EXPRESSIONS; ++e ) {
+		std::string text = randomExpression( random, 1 + e % 6 );
+		Scanner scanner( text );
+		std::unique_ptr<Expression> expression( Expression::parseExpression( scanner ) );
+		CHECK( expression.get() != NULL );
+		if( !expression.get() ) {
+			continue;
+		}
+		expression->compile( params, globals );
+
+		double tree = treeValue( *expression );
+		double code = codeValue( expression->getCode() );
+		if( !same( tree, code ) ) {
+			std::cerr << text << ": tree " << tree << ", code " << code << std::endl;
+		}
+		CHECK( same( tree, code ) );
+
+		ExpressionCode combined;
+		std::vector<const ExpressionCode *> codes( 1, &expression->getCode() );
+		combined.combine( codes, frame );
+		double folded = combinedValue( combined );
+		if( !close( tree, folded ) ) {
+			std::cerr << text << ": tree " << tree << ", combined " << folded << std::endl;
+		}
+		CHECK( close( tree, folded ) );
+
+		divisions += std::isnan( tree );
+	}
+	// Enough of them divide by zero for the errors to be compared too.
+	CHECK( divisions > 0 );
+
+	//----------------------------------------------------------------------
+	// Constants, parameters and globals past what an instruction can
+	// index are errors, not wrapped round to the first ones.
+	CHECK( compiles( ones( 16 ), params, globals, 65536.0 ) );
+	CHECK( !compiles( ones( 17 ), params, globals, 131072.0 ) );
+
+	std::vector<std::string> many;
+	SlotTable slots;
+	for( unsigned int n = 0; n < 0x10001; ++n ) {
+		many.push_back( identifier( "p", n ) );
+		slots[ identifier( "g", n ) ] = n;
+	}
+	CHECK( compiles( identifier( "p", 0xffff ) + " * 2 + " + identifier( "g", 0xffff ),
+		many, slots, 3.0 ) );
+	CHECK( !compiles( identifier( "p", 0x10000 ) + " * 2", many, slots, 2.0 ) );
+	CHECK( !compiles( identifier( "g", 0x10000 ) + " * 2", params, slots, 2.0 ) );
+	return checkResult();
+}
@@ -0,0 +1,187 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#include "check.h"
+#include "grammarcache.h"
+#include "parser.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <unistd.h>
+
+using namespace LSystem;
+
+//------------------------------------------------------------------------------
+// Stochastic, with globals folded into the code and every kind of
+// operation, constants on either side.
+static const char *BUSH =
+	"a: 1.5;\n"
+	"b: 2.25;\n"
+	"iterations: 6;\n"
+	"A(1, 2)B(3.5);\n"
+	"A(x, y) : 0.4 => F(x * a)[+(22.5 - y)A(x + 1, y / b)]B(-x);\n"
+	"A(x, y) : 0.6 => F(x / 2.0)[-(2.0 / y)A(x - y, y * x)][&(a + b)B(y)];\n"
+	"B(x) => F(x)A(x, 1.0 - x);\n";
+
+// One production whose combined code is PARAM, MULK then STORE, so it can
+// be found in the file and damaged.
+static const char *ONE =
+	"iterations: 2;\n"
+	"A(1);\n"
+	"A(x) => A(x * 2.5);\n";
+
+
+//------------------------------------------------------------------------------
+// Whether a and b hold the same modules, bit for bit.
+static bool same( const ModuleString &a, const ModuleString &b ) {
+	if( a.size() != b.size() ) {
+		return false;
+	}
+	for( ModuleString::size_type i = 0; i < a.size(); ++i ) {
+		ModuleString::size_type count = a.parameterCount( i );
+		if( a.name( i ) != b.name( i ) || count != b.parameterCount( i )
+			|| ( count && std::memcmp( a.parameters( i ), b.parameters( i ),
+				count * sizeof( double ) ) != 0 ) ) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+//------------------------------------------------------------------------------
+// The modules text derives, loaded through the cache in directory if it
+// isn't empty, and whether they came from it.
+static ModuleString derive( const char *text, const std::string &directory,
+	bool &cached )
+{
+	Parser parser( text );
+	if( !directory.empty() ) {
+		parser.setGrammarCache( directory );
+	}
+	parser.parseLSystem();
+	cached = parser.getCached();
+	return parser.evaluateSystem();
+}
+
+
+//------------------------------------------------------------------------------
+// The body checksum of a cache file, as GrammarCache works it out.
+static unsigned long long checksum( const std::string &data ) {
+	unsigned long long h = 14695981039346656037ULL;
+	std::string::size_type n = 48;
+	for( ; n + sizeof( h ) <= data.size(); n += sizeof( h ) ) {
+		unsigned long long word;
+		std::memcpy( &word, data.data() + n, sizeof( word ) );
+		h = ( h ^ word ) * 1099511628211ULL;
+	}
+	for( ; n < data.size(); ++n ) {
+		h = ( h ^ (unsigned char)data[n] ) * 1099511628211ULL;
+	}
+	return h;
+}
+
+
+//------------------------------------------------------------------------------
+// Whether ONE's file still loads with byte at of its combined code set to
+// value and the checksum made to match, so only the bytecode is wrong.
+static bool loadsWith( const GrammarCache &cache, const std::string &file,
+	std::string::size_type at, unsigned char value )
+{
+	std::string data;
+	{
+		std::ifstream in( file.c_str(), std::ios::binary );
+		data.assign( std::istreambuf_iterator<char>( in ),
+			std::istreambuf_iterator<char>() );
+	}
+	data[at] = value;
+	unsigned long long sum = checksum( data );
+	std::memcpy( &data[40], &sum, sizeof( sum ) );
+	{
+		std::ofstream out( file.c_str(), std::ios::binary | std::ios::trunc );
+		out.write( data.data(), data.size() );
+	}
+	return bool( cache.load( ONE ) );
+}
+
+
+//------------------------------------------------------------------------------
+// A grammar loaded from a warm cache derives what parsing it cold does,
+// and one whose bytecode indexes past what it may is a miss.
+int main() {
+	char directory[] = "/tmp/grammarcacheXXXXXX";
+	if( !mkdtemp( directory ) ) {
+		std::fprintf( stderr, "cannot make a cache directory\n" );
+		return 1;
+	}
+	GrammarCache cache( directory );
+
+	const char *texts[] = { BUSH, ONE };
+	for( unsigned int t = 0; t < 2; ++t ) {
+		bool cached = false;
+		ModuleString cold = derive( texts[t], "", cached );
+		CHECK( !cold.empty() );
+		ModuleString stored = derive( texts[t], directory, cached );
+		CHECK( !cached );
+		CHECK( same( cold, stored ) );
+		ModuleString warm = derive( texts[t], directory, cached );
+		CHECK( cached );
+		CHECK( same( cold, warm ) );
+	}
+
+	//----------------------------------------------------------------------
+	// Each instruction is op, dst, then the 16 bit a and b.
+	const unsigned char code[] = {
+		ExpressionCode::PARAM, 0, 0, 0, 0, 0,
+		ExpressionCode::MULK, 0, 0, 0, 0, 0,
+		ExpressionCode::STORE, 0, 0, 0, 0, 0 };
+	std::string file = cache.path( ONE );
+	std::string data;
+	{
+		std::ifstream in( file.c_str(), std::ios::binary );
+		data.assign( std::istreambuf_iterator<char>( in ),
+			std::istreambuf_iterator<char>() );
+	}
+	std::string::size_type at = data.find(
+		std::string( reinterpret_cast<const char *>( code ), sizeof( code ) ) );
+	CHECK( at != std::string::npos );
+	if( at != std::string::npos ) {
+		CHECK( loadsWith( cache, file, at + 2, 0 ) );
+		// Past the parameter, the constant, the register stored, the
+		// output and the register written, and an opcode there isn't.
+		CHECK( !loadsWith( cache, file, at + 2, 1 ) );
+		CHECK( loadsWith( cache, file, at + 2, 0 ) );
+		CHECK( !loadsWith( cache, file, at + 10, 1 ) );
+		CHECK( loadsWith( cache, file, at + 10, 0 ) );
+		CHECK( !loadsWith( cache, file, at + 14, 1 ) );
+		CHECK( loadsWith( cache, file, at + 14, 0 ) );
+		CHECK( !loadsWith( cache, file, at + 16, 1 ) );
+		CHECK( loadsWith( cache, file, at + 16, 0 ) );
+		CHECK( !loadsWith( cache, file, at + 1, 1 ) );
+		CHECK( loadsWith( cache, file, at + 1, 0 ) );
+		CHECK( !loadsWith( cache, file, at, 99 ) );
+	}
+
+	std::remove( file.c_str() );
+	std::remove( cache.path( BUSH ).c_str() );
+	rmdir( directory );
+	return checkResult();
+}
@@ -0,0 +1,75 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+
+#include "check.h"
+#include "parser.h"
+
+using namespace LSystem;
+
+//------------------------------------------------------------------------------
+// The same system derived for no iterations, where nothing is rewritten
+// and so nothing is pruned, and for one, where the last generation is.
+static const char *NONE =
+	"iterations: 0;\n"
+	"A(1)F(2)B(3,4)+(5);\n"
+	"A(x) => F(x)A(x);\n"
+	"B(x,y) => F(x)B(y,x);\n";
+
+static const char *ONE =
+	"iterations: 1;\n"
+	"A(1)F(2)B(3,4)+(5);\n"
+	"A(x) => F(x)A(x);\n"
+	"B(x,y) => F(x)B(y,x);\n";
+
+
+//------------------------------------------------------------------------------
+// Whether the size predicted for the last generation is the size derived.
+static bool predicted( const GenerationSize &size, const ModuleString &modules ) {
+	ModuleString::size_type parameters = 0;
+	for( ModuleString::size_type i = 0; i < modules.size(); ++i ) {
+		parameters += modules.parameterCount( i );
+	}
+	return size.modules == modules.size() && size.parameters == parameters;
+}
+
+
+//------------------------------------------------------------------------------
+// Keeping only some modules, the prediction for the last generation
+// matches what evaluateSystem() and CompiledGrammar::derive() give,
+// however many iterations there are.
+int main() {
+	const char *texts[] = { NONE, ONE };
+	unsigned int sizes[] = { 4, 4 };
+	for( unsigned int t = 0; t < 2; ++t ) {
+		Parser parser( texts[t] );
+		parser.parseLSystem();
+		parser.setKeptModules( "F+" );
+		ModuleString modules = parser.evaluateSystem();
+		CHECK( modules.size() == sizes[t] );
+		CHECK( predicted( parser.predictSystem().back(), modules ) );
+
+		std::bitset<256> kept = ModuleString::nameSet( "F+" );
+		ModuleString result;
+		ModuleString scratch;
+		parser.getGrammar()->derive( 0, result, scratch, &kept );
+		CHECK( result.size() == sizes[t] );
+		CHECK( predicted( parser.getGrammar()->predict( kept ).back(), result ) );
+	}
+	return checkResult();
+}
@@ -0,0 +1,105 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+
+#include "check.h"
+#include "livesystem.h"
+
+#include <cstring>
+
+using namespace LSystem;
+
+//------------------------------------------------------------------------------
+// A sequence of edits, each with whether LiveSystem should only evaluate
+// the parameters again after it.  Adding a production between two others
+// moves the slots of the ones after it, which the next edit that only
+// changes numbers must not rewrite by.
+struct Edit {
+	const char *text;
+	bool parametersOnly;
+};
+
+static const Edit EDITS[] = {
+	{ "iterations: 5;\nA(1);\n"
+		"A(x) => A(x+1)C(x);\n"
+		"C(x) => F(x)C(x*0.5);\n", false },
+	{ "iterations: 5;\nA(1);\n"
+		"A(x) => A(x+2)C(x);\n"
+		"C(x) => F(x)C(x*0.5);\n", true },
+	{ "iterations: 5;\nA(1);\n"
+		"A(x) => A(x+2)C(x);\n"
+		"B(x) => F(x);\n"
+		"C(x) => F(x)C(x*0.5);\n", false },
+	{ "iterations: 5;\nA(1);\n"
+		"A(x) => A(x+2)C(x);\n"
+		"B(x) => F(x);\n"
+		"C(x) => F(x)C(x*0.25);\n", true },
+	{ "iterations: 5;\nA(1);\n"
+		"A(x) => A(x+2)B(x)C(x);\n"
+		"B(x) => F(x);\n"
+		"C(x) => F(x)C(x*0.25);\n", false },
+	{ "iterations: 5;\nA(1);\n"
+		"A(x) => A(x+2)B(x)C(x);\n"
+		"B(x) => F(x)F(x);\n"
+		"C(x) => F(x)C(x*0.25);\n", false },
+	{ "iterations: 5;\nA(2);\n"
+		"A(x) => A(x+2)B(x)C(x);\n"
+		"B(x) => F(x)F(x);\n"
+		"C(x) => F(x)C(x*0.75);\n", true },
+	{ "iterations: 5;\nA(2);\n"
+		"A(x) => A(x+2)B(x)C(x);\n"
+		"C(x) => F(x)C(x*0.75);\n"
+		"B(x) => F(x)F(x);\n", false },
+	{ "iterations: 5;\nA(3);\n"
+		"A(x) => A(x+2)B(x)C(x);\n"
+		"C(x) => F(x)C(x*0.5);\n"
+		"B(x) => F(x)F(x);\n", true },
+};
+
+
+//------------------------------------------------------------------------------
+// Whether a and b hold the same modules with the same parameters.
+static bool same( const ModuleString &a, const ModuleString &b ) {
+	if( a.size() != b.size() ) {
+		return false;
+	}
+	for( ModuleString::size_type i = 0; i < a.size(); ++i ) {
+		if( a.name( i ) != b.name( i ) || a.parameterCount( i ) != b.parameterCount( i )
+			|| std::memcmp( a.parameters( i ), b.parameters( i ),
+				a.parameterCount( i ) * sizeof( double ) ) != 0 ) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+//------------------------------------------------------------------------------
+// After each edit LiveSystem gives the same modules as deriving the text
+// from scratch.
+int main() {
+	LiveSystem live;
+	for( unsigned int e = 0; e < sizeof( EDITS ) / sizeof( EDITS[0] ); ++e ) {
+		const ModuleString &modules = live.update( EDITS[e].text );
+		Parser parser( EDITS[e].text );
+		parser.parseLSystem();
+		CHECK( same( modules, parser.evaluateSystem() ) );
+		CHECK( live.isParametersOnly() == EDITS[e].parametersOnly );
+	}
+	return checkResult();
+}
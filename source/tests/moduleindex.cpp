@@ -0,0 +1,137 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#include "check.h"
+#include "parser.h"
+
+#include <cstring>
+#include <vector>
+
+using namespace LSystem;
+
+//------------------------------------------------------------------------------
+// A binary tree whose branches grow apart, with modules copied through
+// and a symbol of the same name but another arity.
+static const char *TREE =
+	"iterations: 7;\n"
+	"B(1.0, 0.5)F(3)B(2.0);\n"
+	"B(l, w) => F(l)[+(22.5)B(l * 0.71, w * 0.9)][-(31.0)B(l * 0.63)]/(137.5);\n"
+	"B(l) => F(l * 2)B(l + 1, l);\n";
+
+// Grows by a few modules a generation, some of them never rewritten.
+static const char *KOCH =
+	"iterations: 4;\n"
+	"F(1)+(90)F(1)+(90)F(1)+(90)F(1);\n"
+	"F(x) => F(x / 3)+(60)F(x / 3)-(120)F(x / 3)+(60)F(x / 3);\n";
+
+// Picks a production at random.
+static const char *BUSH =
+	"iterations: 3;\n"
+	"A(1);\n"
+	"A(x) : 0.4 => F(x)[+(x)A(x + 1)]A(x);\n"
+	"A(x) : 0.6 => F(x * 0.5)[-(25)A(x)][&(x)A(x * 2)];\n";
+
+
+//------------------------------------------------------------------------------
+// Whether module i of s is name with the count parameters params, bit for
+// bit.
+static bool same( const ModuleString &s, ModuleString::size_type i, char name,
+	const double *params, ModuleString::size_type count )
+{
+	return s.name( i ) == name && s.parameterCount( i ) == count
+		&& ( count == 0 || std::memcmp( s.parameters( i ), params,
+			count * sizeof( double ) ) == 0 );
+}
+
+
+//------------------------------------------------------------------------------
+// Whether range() of count modules from k of generation is what
+// evaluateSystem() derived for it, cut short at its end.
+static bool ranged( const ModuleIndex &index, const ModuleString &generation,
+	int g, ModuleIndex::length_type k, ModuleIndex::length_type count )
+{
+	ModuleString found;
+	ModuleIndex::length_type n = index.range( g, k, count, found );
+	ModuleIndex::length_type expected = k >= generation.size() ? 0
+		: std::min( count, (ModuleIndex::length_type)generation.size() - k );
+	if( n != expected || found.size() != n ) {
+		return false;
+	}
+	for( ModuleString::size_type i = 0; i < found.size(); ++i ) {
+		if( !same( generation, k + i, found.name( i ), found.parameters( i ),
+				found.parameterCount( i ) ) ) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Every module of every generation found by module() and range() is the
+// one evaluateSystem() derives, and a system picking productions at
+// random can't be indexed.
+int main() {
+	const char *texts[] = { TREE, KOCH };
+	for( unsigned int t = 0; t < 2; ++t ) {
+		Parser parser( texts[t] );
+		parser.parseLSystem();
+		std::vector<ModuleString> generations;
+		parser.evaluateSystem( generations );
+		ModuleIndex index = parser.indexSystem();
+		CHECK( index.getIterations() + 1 == (int)generations.size() );
+
+		for( int g = 0; g <= index.getIterations(); ++g ) {
+			const ModuleString &generation = generations[g];
+			CHECK( index.length( g ) == generation.size() );
+
+			bool found = true;
+			for( ModuleString::size_type k = 0; k < generation.size(); ++k ) {
+				Module m;
+				index.module( g, k, m );
+				found = found && same( generation, k, m.name,
+					m.parameters.data(), m.parameters.size() );
+			}
+			CHECK( found );
+			CHECK( throwsError( [&]() {
+				Module m;
+				index.module( g, generation.size(), m );
+			} ) );
+
+			ModuleIndex::length_type size = generation.size();
+			CHECK( ranged( index, generation, g, 0, size ) );
+			CHECK( ranged( index, generation, g, 0, 1 ) );
+			CHECK( ranged( index, generation, g, size / 3, size / 2 + 1 ) );
+			CHECK( ranged( index, generation, g, size - 1, 5 ) );
+			CHECK( ranged( index, generation, g, size / 2, ~0ULL ) );
+			CHECK( ranged( index, generation, g, size, 3 ) );
+			CHECK( ranged( index, generation, g, size / 4, 0 ) );
+		}
+		CHECK( throwsError( [&]() { index.length( -1 ); } ) );
+		CHECK( throwsError( [&]() { index.length( index.getIterations() + 1 ); } ) );
+		CHECK( throwsError( [&]() {
+			ModuleString out;
+			index.range( index.getIterations() + 1, 0, 1, out );
+		} ) );
+	}
+
+	Parser bush( BUSH );
+	bush.parseLSystem();
+	CHECK( throwsError( [&]() { bush.indexSystem(); } ) );
+	return checkResult();
+}
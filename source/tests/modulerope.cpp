@@ -0,0 +1,115 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#include "check.h"
+#include "parser.h"
+
+#include <cstring>
+
+using namespace LSystem;
+
+//------------------------------------------------------------------------------
+// Stochastic, and long enough that subtrees picked at random are handed
+// out as tasks.
+static const char *BUSH =
+	"iterations: 12;\n"
+	"A(1);\n"
+	"A(x) : 0.4 => F(x)[+(x)A(x + 1)]A(x);\n"
+	"A(x) : 0.6 => F(x * 0.5)[-(25)A(x)][&(x)A(x * 2)];\n";
+
+// A deterministic tree whose buds are picked at random, so subtrees
+// whose lengths are known and ones whose aren't are mixed.
+static const char *BUDS =
+	"iterations: 11;\n"
+	"B(1.0, 0.5)C(2);\n"
+	"B(l, w) => F(l)[+(22.5)B(l * 0.71, w * 0.9)][-(31.0)B(l * 0.63, w * 0.8)]C(l);\n"
+	"C(x) : 0.5 => C(x + 1);\n"
+	"C(x) : 0.5 => L(x)C(x * 2)C(x);\n";
+
+// Nothing picked at random.
+static const char *TREE =
+	"iterations: 14;\n"
+	"B(1.0, 0.5);\n"
+	"B(l, w) => F(l)[+(22.5)B(l * 0.71, w * 0.9)][-(31.0)B(l * 0.63, w * 0.8)]/(137.5);\n";
+
+
+//------------------------------------------------------------------------------
+// Whether module i of s is name with the count parameters params, bit for
+// bit.
+static bool same( const ModuleString &s, ModuleString::size_type i, char name,
+	const double *params, ModuleString::size_type count )
+{
+	return s.name( i ) == name && s.parameterCount( i ) == count
+		&& ( count == 0 || std::memcmp( s.parameters( i ), params,
+			count * sizeof( double ) ) == 0 );
+}
+
+
+//------------------------------------------------------------------------------
+// Whether flattening rope, and walking it, both give expected.
+static bool derived( const ModuleRope &rope, const ModuleString &expected ) {
+	if( rope.length() != expected.size() ) {
+		return false;
+	}
+	ModuleString flat;
+	rope.flatten( flat );
+	if( flat.size() != expected.size() ) {
+		return false;
+	}
+	for( ModuleString::size_type i = 0; i < flat.size(); ++i ) {
+		if( !same( expected, i, flat.name( i ), flat.parameters( i ),
+				flat.parameterCount( i ) ) ) {
+			return false;
+		}
+	}
+
+	ModuleRopeWalker walker( rope );
+	Module m;
+	ModuleString::size_type i = 0;
+	for( ; walker.next( m ); ++i ) {
+		if( i >= expected.size() || !same( expected, i, m.name,
+				m.parameters.data(), m.parameters.size() ) ) {
+			return false;
+		}
+	}
+	return i == expected.size();
+}
+
+
+//------------------------------------------------------------------------------
+// The rope is what evaluateSystem() derives, on one thread and on four,
+// whether productions are picked at random or not.
+int main() {
+	const char *texts[] = { BUSH, BUDS, TREE };
+	for( unsigned int t = 0; t < 3; ++t ) {
+		Parser parser( texts[t] );
+		parser.parseLSystem();
+		ModuleString expected = parser.evaluateSystem();
+		CHECK( expected.size() > 8192 );
+
+		unsigned int threads[] = { 1, 4 };
+		for( unsigned int n = 0; n < 2; ++n ) {
+			parser.setThreadCount( threads[n] );
+			ModuleRope rope = parser.ropeSystem();
+			CHECK( rope.taskCount() > 0 );
+			CHECK( derived( rope, expected ) );
+		}
+		parser.setThreadCount( 1 );
+	}
+	return checkResult();
+}
@@ -0,0 +1,104 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#include "check.h"
+#include "parser.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+using namespace LSystem;
+
+//------------------------------------------------------------------------------
+// Every allocation is counted, with its size kept in front of it, so the
+// bytes live and the most ever live are known.
+static const std::size_t HEADER = 16;
+static std::size_t live = 0;
+static std::size_t peak = 0;
+
+void *operator new( std::size_t size ) {
+	char *p = (char *)std::malloc( size + HEADER );
+	if( !p ) {
+		throw std::bad_alloc();
+	}
+	*(std::size_t *)p = size;
+	live += size;
+	peak = std::max( peak, live );
+	return p + HEADER;
+}
+
+void operator delete( void *p ) noexcept {
+	if( p ) {
+		char *block = (char *)p - HEADER;
+		live -= *(std::size_t *)block;
+		std::free( block );
+	}
+}
+
+void operator delete( void *p, std::size_t ) noexcept {
+	operator delete( p );
+}
+
+
+//------------------------------------------------------------------------------
+// Deterministic, so the prediction is exact.  One grows by about half
+// again each generation, the other doubles.
+static const char *GRAMMARS[] = {
+	"iterations: 22;\n"
+	"A(1.0, 2.0);\n"
+	"A(x, y) => F(x)[+(y)B(x * 0.5)]A(x * 0.9, y);\n"
+	"B(x) => F(x)A(x, x);\n",
+
+	"iterations: 17;\n"
+	"B(1.0);\n"
+	"B(l) => F(l)B(l * 0.5)B(l * 0.7);\n"
+};
+
+// What evaluateSystem() allocates besides the generations, the growth
+// matrix and its prediction.
+static const std::size_t SLACK = 64 << 10;
+
+
+//------------------------------------------------------------------------------
+// The most memory evaluateSystem() holds is the peak the budget checks
+// against, the largest peakBytes predictSystem() gives.
+int main() {
+	for( const char *grammar : GRAMMARS ) {
+		Parser parser( grammar );
+		parser.parseLSystem();
+		std::vector<GenerationSize> predicted = parser.predictSystem();
+		double predictedPeak = 0.0;
+		for( std::vector<GenerationSize>::size_type g = 0; g < predicted.size(); ++g ) {
+			predictedPeak = std::max( predictedPeak, predicted[g].peakBytes );
+		}
+
+		std::size_t before = live;
+		peak = live;
+		ModuleString result = parser.evaluateSystem();
+		double measured = peak - before;
+
+		std::cout << "predicted " << predictedPeak << " bytes, measured "
+			<< measured << " bytes" << std::endl;
+		CHECK( result.size() == predicted.back().modules );
+		CHECK( measured <= predictedPeak + SLACK );
+		// And the prediction isn't just generous.
+		CHECK( measured >= predictedPeak * 0.95 );
+	}
+	return checkResult();
+}
@@ -0,0 +1,144 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#include "check.h"
+#include "parser.h"
+
+#include <cstdlib>
+#include <new>
+
+using namespace LSystem;
+
+//------------------------------------------------------------------------------
+// Every allocation is counted while counting is on.
+static bool counting = false;
+static unsigned long allocations = 0;
+
+void *operator new( std::size_t size ) {
+	if( counting ) {
+		++allocations;
+	}
+	void *p = std::malloc( size ? size : 1 );
+	if( !p ) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void operator delete( void *p ) noexcept {
+	std::free( p );
+}
+
+void operator delete( void *p, std::size_t ) noexcept {
+	std::free( p );
+}
+
+
+//------------------------------------------------------------------------------
+// A stochastic grammar with parameters, globals and branches, and a
+// module no production rewrites.
+static const char *GRAMMAR =
+	"a: 1.5;\n"
+	"iterations: 10;\n"
+	"!(14)F(2.0)B(1, 10)X;\n"
+	"B(l,w) : 0.5 => !(w)/(90.0)[+(15.0)F(l*0.8)B(l*0.9, w*0.7)][-(15.0)F(l*1.2)B(l*0.9, w*0.7)];\n"
+	"B(l,w) : 0.5 => !(w)/(50.0)[+(15.0*a)F(l/0.8)B(l*0.9, w-0.7)]X;\n";
+
+static const int REPEATS = 5;
+
+
+//------------------------------------------------------------------------------
+// Rewriting a generation into a buffer that has already held it makes no
+// allocations, through any of the apply()s derivation uses.
+int main() {
+	Parser parser( GRAMMAR );
+	parser.parseLSystem();
+	const ProductionSet &set = parser.getProductionSet();
+	const SymbolFrame &globals = parser.getGlobals();
+	ModuleString in = parser.evaluateSystem();
+	CHECK( in.size() > 1000 );
+
+	std::vector<Production *> matches( in.size() );
+	for( ModuleString::size_type i = 0; i < in.size(); ++i ) {
+		matches[i] = set.match( in.name( i ), in.parameterCount( i ),
+			set.getSeed(), 7, i );
+	}
+
+	//----------------------------------------------------------------------
+	// Appending, once to warm the buffer and then again.
+	ModuleString out;
+	counting = true;
+	for( ModuleString::size_type i = 0; i < in.size(); ++i ) {
+		ProductionSet::apply( in, i, matches[i], globals, out );
+	}
+	counting = false;
+	// Growing the buffer the first time allocates, so counting works.
+	CHECK( allocations > 0 );
+
+	allocations = 0;
+	for( int r = 0; r < REPEATS; ++r ) {
+		out.clear();
+		counting = true;
+		for( ModuleString::size_type i = 0; i < in.size(); ++i ) {
+			ProductionSet::apply( in, i, matches[i], globals, out );
+		}
+		counting = false;
+	}
+	CHECK( allocations == 0 );
+	CHECK( out.size() > in.size() );
+
+	//----------------------------------------------------------------------
+	// Appending only the modules kept.
+	std::bitset<256> kept = ModuleString::nameSet( "F[]+-/!" );
+	std::vector<double> scratch;
+	allocations = 0;
+	for( int r = 0; r <= REPEATS; ++r ) {
+		out.clear();
+		counting = r > 0;
+		for( ModuleString::size_type i = 0; i < in.size(); ++i ) {
+			ProductionSet::apply( in, i, matches[i], globals, out, kept, scratch );
+		}
+		counting = false;
+	}
+	CHECK( allocations == 0 );
+
+	//----------------------------------------------------------------------
+	// Writing in place, as the threads of a parallel rewrite do.
+	ModuleString::size_type modules = 0;
+	ModuleString::size_type parameters = 0;
+	for( ModuleString::size_type i = 0; i < in.size(); ++i ) {
+		modules += ProductionSet::successorCount( matches[i] );
+		parameters += ProductionSet::parameterCount( matches[i], in.parameterCount( i ) );
+	}
+	out.resize( modules, parameters );
+	allocations = 0;
+	counting = true;
+	for( int r = 0; r < REPEATS; ++r ) {
+		ModuleString::size_type index = 0;
+		ModuleString::size_type offset = 0;
+		for( ModuleString::size_type i = 0; i < in.size(); ++i ) {
+			ProductionSet::apply( in, i, matches[i], globals, out, index, offset );
+			index += ProductionSet::successorCount( matches[i] );
+			offset += ProductionSet::parameterCount( matches[i], in.parameterCount( i ) );
+		}
+	}
+	counting = false;
+	CHECK( allocations == 0 );
+
+	return checkResult();
+}
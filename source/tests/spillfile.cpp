@@ -0,0 +1,151 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+
+#include "check.h"
+#include "parser.h"
+#include "spillfile.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+using namespace LSystem;
+
+//------------------------------------------------------------------------------
+// A binary tree, a couple of megabytes spilled, with the parameterless
+// [ and ] between the modules with parameters.
+static const char *TREE =
+	"iterations: 15;\n"
+	"B(1.0, 0.5);\n"
+	"B(l, w) => F(l)[+(22.5)B(l * 0.71, w * 0.9)][-(31.0)B(l * 0.63, w * 0.8)]/(137.5);\n";
+
+// The smallest window there is, a page and a record, so the reader
+// slides it along many times.
+static const unsigned long long SMALL_WINDOW = 1;
+
+
+//------------------------------------------------------------------------------
+// Whether reading the spill file at path back, a module at a time and a
+// block of max at a time, both give expected.
+static bool readsBack( const std::string &path, const ModuleString &expected,
+	unsigned long long window, ModuleString::size_type max )
+{
+	SpillReader reader( path, window );
+	if( reader.size() != expected.size() ) {
+		return false;
+	}
+	Module m;
+	ModuleString::size_type i = 0;
+	for( ; reader.next( m ); ++i ) {
+		if( i >= expected.size() || m.name != expected.name( i )
+			|| m.parameters.size() != expected.parameterCount( i )
+			|| ( !m.parameters.empty() && std::memcmp( m.parameters.data(),
+				expected.parameters( i ), m.parameters.size() * sizeof( double ) ) != 0 ) ) {
+			return false;
+		}
+	}
+	if( i != expected.size() ) {
+		return false;
+	}
+
+	reader.rewind();
+	ModuleString block;
+	i = 0;
+	while( ModuleString::size_type n = reader.next( block, max ) ) {
+		for( ModuleString::size_type j = 0; j < n; ++j, ++i ) {
+			if( i >= expected.size() || block.name( j ) != expected.name( i )
+				|| block.parameterCount( j ) != expected.parameterCount( i )
+				|| ( block.parameterCount( j ) && std::memcmp( block.parameters( j ),
+					expected.parameters( i ), block.parameterCount( j ) * sizeof( double ) ) != 0 ) ) {
+				return false;
+			}
+		}
+	}
+	return i == expected.size();
+}
+
+
+//------------------------------------------------------------------------------
+// spillSystem() read back gives what evaluateSystem() does, through the
+// smallest window and the default one.  So do modules without parameters
+// and with the most written directly.  A truncated file is an Error.
+int main() {
+	char directory[] = "/tmp/spillfileXXXXXX";
+	if( !mkdtemp( directory ) ) {
+		std::cerr << "cannot make a directory for the spill files" << std::endl;
+		return 1;
+	}
+	std::string prefix = std::string( directory ) + "/tree";
+
+	Parser parser( TREE );
+	parser.parseLSystem();
+	ModuleString expected = parser.evaluateSystem();
+	std::string path = parser.spillSystem( prefix );
+	// Many windows, and more than a chunk written.
+	CHECK( SpillReader( path ).length() > SpillWriter::CHUNK_SIZE );
+	CHECK( readsBack( path, expected, SMALL_WINDOW, 7 ) );
+	CHECK( readsBack( path, expected, SMALL_WINDOW, 100000 ) );
+	CHECK( readsBack( path, expected, SpillReader::WINDOW_SIZE, 4096 ) );
+	std::remove( path.c_str() );
+
+	//----------------------------------------------------------------------
+	// Runs of modules without parameters, and with 255, across windows.
+	std::string direct = std::string( directory ) + "/direct";
+	ModuleString written;
+	{
+		SpillWriter writer( direct );
+		double params[255];
+		for( unsigned int n = 0; n < 4000; ++n ) {
+			ModuleString::size_type count = n % 100 == 99 ? 255 : 0;
+			for( ModuleString::size_type p = 0; p < count; ++p ) {
+				params[p] = n + p * 0.5;
+			}
+			char name = count ? 'A' : "[]+"[ n % 3 ];
+			writer.push_back( name, count ? params : NULL, count );
+			std::copy( params, params + count, written.push_back( name, count ) );
+		}
+		writer.close();
+	}
+	CHECK( readsBack( direct, written, SMALL_WINDOW, 13 ) );
+
+	//----------------------------------------------------------------------
+	// Cut off part way through a record, reading stops with an Error.
+	// Cut off inside the header, opening does.
+	unsigned long long length = SpillReader( direct ).length();
+	CHECK( truncate( direct.c_str(), length - 3 ) == 0 );
+	CHECK( throwsError( [&]() {
+		SpillReader reader( direct, SMALL_WINDOW );
+		Module m;
+		while( reader.next( m ) ) {
+		}
+	} ) );
+	CHECK( throwsError( [&]() {
+		SpillReader reader( direct, SMALL_WINDOW );
+		ModuleString block;
+		while( reader.next( block, 100 ) ) {
+		}
+	} ) );
+	CHECK( truncate( direct.c_str(), 10 ) == 0 );
+	CHECK( throwsError( [&]() { SpillReader reader( direct ); } ) );
+
+	std::remove( direct.c_str() );
+	rmdir( directory );
+	return checkResult();
+}
@@ -0,0 +1,94 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#include "check.h"
+#include "parser.h"
+#include "workpool.h"
+
+#include <atomic>
+
+using namespace LSystem;
+
+//------------------------------------------------------------------------------
+// Divides by zero in the last generation, which is big enough to be
+// rewritten in parallel.
+static const char *DIVIDE_BY_ZERO =
+	"iterations: 15;\n"
+	"B(14.0);\n"
+	"B(l) => F(1.0/l)B(l-1.0)B(l-1.0);\n";
+
+static const char *BINARY =
+	"iterations: 14;\n"
+	"B(14.0);\n"
+	"B(l) => F(1.0/l)B(l-1.0)B(l-1.0);\n";
+
+
+//------------------------------------------------------------------------------
+// An error thrown while a generation is rewritten, or by any task on a
+// WorkPool, comes back to the caller as an Error however many threads
+// there are.
+int main() {
+	unsigned int threads[] = { 1, 4, 0 };
+	for( unsigned int t = 0; t < sizeof( threads ) / sizeof( threads[0] ); ++t ) {
+		Parser parser( DIVIDE_BY_ZERO );
+		parser.parseLSystem();
+		parser.setThreadCount( threads[t] );
+		CHECK( throwsError( [&]() { parser.evaluateSystem(); } ) );
+
+		std::vector<ModuleString> generations;
+		CHECK( throwsError( [&]() { parser.evaluateSystem( generations ); } ) );
+		CHECK( throwsError( [&]() { parser.ropeSystem(); } ) );
+
+		// The parser derives as before once the error is out of the way.
+		Parser good( BINARY );
+		good.parseLSystem();
+		good.setThreadCount( threads[t] );
+		CHECK( good.evaluateSystem().size() == ( 1u << 14 ) * 2 - 1 );
+		CHECK( good.ropeSystem().length() == ( 1u << 14 ) * 2 - 1 );
+
+		// A task throwing, among tasks that push and wait on their own.
+		WorkPool pool( threads[t] );
+		WorkPool::Group group;
+		std::atomic<unsigned int> ran( 0 );
+		for( int i = 0; i < 64; ++i ) {
+			pool.push( group, [&pool, &ran, i]() {
+				WorkPool::Group inner;
+				for( int j = 0; j < 4; ++j ) {
+					pool.push( inner, [&ran, i, j]() {
+						if( i == 40 && j == 2 ) {
+							throw new Error( "Error: a task failed.", -1, -1, __FILE__, __LINE__ );
+						}
+						++ran;
+					} );
+				}
+				pool.wait( inner );
+			} );
+		}
+		CHECK( throwsError( [&]() { pool.wait( group ); } ) );
+		CHECK( ran < 64 * 4 );
+
+		// The group can be used again once wait() has thrown.
+		ran = 0;
+		for( int i = 0; i < 16; ++i ) {
+			pool.push( group, [&ran]() { ++ran; } );
+		}
+		pool.wait( group );
+		CHECK( ran == 16 );
+	}
+	return checkResult();
+}
@@ -0,0 +1,80 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+
+#include "check.h"
+#include "workpool.h"
+
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <thread>
+
+using namespace LSystem;
+
+//------------------------------------------------------------------------------
+// The processor time the calling thread has used, in seconds.
+static double threadSeconds() {
+	timespec now;
+	clock_gettime( CLOCK_THREAD_CPUTIME_ID, &now );
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+
+//------------------------------------------------------------------------------
+// A thread waiting on a group whose last task runs on another thread
+// sleeps rather than spins, and wakes when it is done or when there is
+// more to help with.
+int main() {
+	WorkPool pool( 2 );
+	WorkPool::Group group;
+	std::atomic<bool> started( false );
+	std::atomic<unsigned int> ran( 0 );
+	pool.push( group, [&]() {
+		started = true;
+		std::this_thread::sleep_for( std::chrono::milliseconds( 300 ) );
+		++ran;
+	} );
+	// Let the pool's thread take the task, so there is nothing to help with.
+	while( !started ) {
+		std::this_thread::yield();
+	}
+	double before = threadSeconds();
+	pool.wait( group );
+	CHECK( ran == 1 );
+	CHECK( threadSeconds() - before < 0.1 );
+
+	// A task that pushes more after a while wakes the thread waiting to
+	// help with them.
+	started = false;
+	ran = 0;
+	pool.push( group, [&]() {
+		started = true;
+		std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+		for( int i = 0; i < 64; ++i ) {
+			pool.push( group, [&]() { ++ran; } );
+		}
+		std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+	} );
+	while( !started ) {
+		std::this_thread::yield();
+	}
+	pool.wait( group );
+	CHECK( ran == 64 );
+	return checkResult();
+}
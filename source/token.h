@@ -21,6 +21,7 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 
 namespace LSystem {
 
@@ -178,6 +179,99 @@ public:
 	}
 }; // End of Token
 
+
+///-----------------------------------------------------------------------------
+/// What the scanner hands the parser: the type of a token and the span of
+/// the scanner's buffer it was read from.
+///
+/// A Lexeme is a small value, lexing one neither allocates nor copies the
+/// text.  Its attribute is only valid as long as the buffer being scanned,
+/// so anything kept past the parse, like the leaves of an expression, is
+/// made into a Token with toToken().
+///
+/// @see LSystem::Scanner
+/// @see LSystem::Token
+///-----------------------------------------------------------------------------
+class Lexeme {
+
+//==============================================================================
+// Private Variables
+//==============================================================================
+private:
+
+	Token::Type myType;
+	std::string_view myAttribute;
+
+//==============================================================================
+// Public Methods
+//==============================================================================
+public:
+
+	//----------------------------------------------------------------------
+	// Constructors
+
+	///---------------------------------------------------------------------
+	/// Creates an END_OF_FILE lexeme.
+	///---------------------------------------------------------------------
+	Lexeme()
+		:
+		myType( Token::END_OF_FILE ),
+		myAttribute( "EOF" )
+	{
+	}
+
+	///---------------------------------------------------------------------
+	/// Creates a lexeme of type type spanning attrib.
+	///---------------------------------------------------------------------
+	Lexeme( Token::Type type, std::string_view attrib )
+		:
+		myType( type ),
+		myAttribute( attrib )
+	{
+	}
+
+
+	//----------------------------------------------------------------------
+	// Getters
+
+	///---------------------------------------------------------------------
+	/// Gets the value of Type of this Lexeme
+	///---------------------------------------------------------------------
+	Token::Type getType() const
+	{
+		return myType;
+	}
+
+	///---------------------------------------------------------------------
+	/// Gets the text of this Lexeme, a view of the scanner's buffer.
+	///---------------------------------------------------------------------
+	std::string_view getAttribute() const
+	{
+		return myAttribute;
+	}
+
+
+	//----------------------------------------------------------------------
+	// Public API
+
+	///---------------------------------------------------------------------
+	/// Checks whether this is a PUNCTUATION lexeme spelt punctuation.
+	///---------------------------------------------------------------------
+	bool isPunctuation( std::string_view punctuation ) const
+	{
+		return myType == Token::PUNCTUATION && myAttribute == punctuation;
+	}
+
+	///---------------------------------------------------------------------
+	/// Makes a heap allocated Token with a copy of the text, which the
+	/// caller owns.
+	///---------------------------------------------------------------------
+	Token *toToken() const
+	{
+		return new Token( myType, std::string( myAttribute ) );
+	}
+}; // End of Lexeme
+
 }; // End of LSystem namespace
 
 #endif
@@ -47,6 +47,21 @@
 
 //------------------------------------------------------------------------------
 Tree::Tree()
+	:
+	myCancel( false ),
+	myStopping( false ),
+	myPending( false ),
+	myPendingJob( 0 ),
+	myPendingShown( false ),
+	myJob( 0 ),
+	myShownJob( 0 ),
+	myGeneration( 0 ),
+	myIterations( 0 ),
+	myModules( 0 ),
+	myDoneJob( 0 ),
+	myUnchanged( false ),
+	myLeafType( 0 ),
+	myBranchType( 0 )
 {
 	//----------------------------------------------------------------------
 	// Set up the basic window properties.
@@ -108,6 +123,12 @@ Tree::Tree()
 	renderButton->signal_clicked().connect(
 		sigc::mem_fun(*this, &Tree::renderSystem) );
 
+	// The derivation thread wakes us through these.
+	myProgressDispatcher.connect(
+		sigc::mem_fun(*this, &Tree::onProgress) );
+	myDoneDispatcher.connect(
+		sigc::mem_fun(*this, &Tree::onDerived) );
+
 	//----------------------------------------------------------------------
 	// This next section defines all of the possible actions,
 	// then lays them out into a hiearchy of menus and toolbars.
@@ -181,6 +202,7 @@ Tree::Tree()
 
 //------------------------------------------------------------------------------
 Tree::~Tree() {
+	stopDerivation();
 }
 
 void Tree::createActionsUI( Glib::RefPtr<Gtk::UIManager> uiManager ) {
@@ -333,31 +355,190 @@ void Tree::onOpen() {
 
 
 void Tree::renderSystem() {
-	// Create a stream to it.
-	std::istringstream in( myTextBuffer->get_text() );
-	LSystem::Parser p(in);
+	//----------------------------------------------------------------------
+	// Only one derivation at a time, so rendering again cancels the last.
+	// The worker may take a while to notice, in which case what it comes
+	// up with is dropped by onDerived(), but the window doesn't wait.
+	bool shown = myJob != 0 && myShownJob == myJob;
+	++myJob;
+	myProgressBar.set_fraction( 0.0 );
+	myProgressBar.set_text( "Parsing" );
+	{
+		std::lock_guard<std::mutex> guard( myLock );
+		myCancel = true;
+		myPending = true;
+		myPendingText = myTextBuffer->get_text().raw();
+		myPendingJob = myJob;
+		myPendingShown = shown;
+	}
+	myWake.notify_one();
+	if( !myWorker.joinable() ) {
+		myWorker = std::thread( &Tree::work, this );
+	}
+}
 
-	try {
-		p.parseLSystem();
 
-		myScene->setleavetype( p['L'] );
-		myScene->setbranchtype( p['B'] );
-		myScene->setmodules( p.evaluateSystem() );
+//------------------------------------------------------------------------------
+void Tree::stopDerivation() {
+	if( myWorker.joinable() ) {
+		{
+			std::lock_guard<std::mutex> guard( myLock );
+			myCancel = true;
+			myStopping = true;
+		}
+		myWake.notify_one();
+		myWorker.join();
+	}
+}
+
+
+//------------------------------------------------------------------------------
+void Tree::work() {
+	for( ;; ) {
+		std::string text;
+		unsigned int job;
+		bool shown;
+		{
+			std::unique_lock<std::mutex> guard( myLock );
+			myWake.wait( guard, [this]() { return myStopping || myPending; } );
+			if( myStopping ) {
+				return;
+			}
+			// Taken and uncancelled together, so a newer job handed over
+			// from now on cancels this one.
+			text.swap( myPendingText );
+			job = myPendingJob;
+			shown = myPendingShown;
+			myPending = false;
+			myCancel = false;
+		}
+		deriveSystem( std::move( text ), job, shown );
+	}
+}
+
+
+//------------------------------------------------------------------------------
+void Tree::deriveSystem( std::string text, unsigned int job, bool shown ) {
+	// Derive on every core we have.
+	myLive.setThreadCount( 0 );
+	myLive.setCancel( &myCancel );
+	myLive.setProgress( [this]( int generation, int iterations,
+		LSystem::ModuleString::size_type modules ) {
+		{
+			std::lock_guard<std::mutex> guard( myLock );
+			myGeneration = generation;
+			myIterations = iterations;
+			myModules = modules;
+		}
+		myProgressDispatcher.emit();
+	} );
+
+	std::unique_ptr<LRenderer> renderer;
+	bool unchanged = false;
+	std::string error;
+	int leaves = 0;
+	int branches = 0;
+	try {
+		// Scans the text where it is.
+		const LSystem::ModuleString &modules = myLive.update( text );
+		leaves = myLive.getModel( 'L' );
+		branches = myLive.getModel( 'B' );
+
+		// Compiling the turtle's geometry is slow too, so it is done here
+		// rather than when the scene is next drawn.
+		unchanged = shown && myLive.isUnchanged();
+		if( !unchanged ) {
+			renderer.reset( new LRenderer() );
+			renderer->setcancel( &myCancel );
+			renderer->setinput( modules );
+		}
 		
 	} catch ( LSystem::Error *e ) {
-		std::cout << e->getFileName() << ":"
-			<< e->getLine() << ": error:"
-			<< e->getMsg() << std::endl;
-		std::cout << "Line: " << e->getLine() << std::endl;
-		std::cout << "--------------------------" << std::endl;
-		std::cout << "| " << e->getMsg() << std::endl;
-		std::cout << "--------------------------" << std::endl;
-		std::cout << "CPP File:      "
-			<< e->getFileName() << std::endl;
-		std::cout << "CPP File Line: "
-			<< e->getFileLine() << std::endl;
+		if( !myCancel ) {
+			std::cout << e->getFileName() << ":"
+				<< e->getLine() << ": error:"
+				<< e->getMsg() << std::endl;
+			std::cout << "Line: " << e->getLine() << std::endl;
+			std::cout << "--------------------------" << std::endl;
+			std::cout << "| " << e->getMsg() << std::endl;
+			std::cout << "--------------------------" << std::endl;
+			std::cout << "CPP File:      "
+				<< e->getFileName() << std::endl;
+			std::cout << "CPP File Line: "
+				<< e->getFileLine() << std::endl;
+		}
+		error = e->getMsg();
+		delete e;
+	}
+
+	//----------------------------------------------------------------------
+	// Whoever cancelled us is starting over, so there is nobody to tell.
+	if( myCancel ) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> guard( myLock );
+		myDoneJob = job;
+		myResult = std::move( renderer );
+		myUnchanged = unchanged;
+		myError = error;
+		myLeafType = leaves;
+		myBranchType = branches;
+	}
+	myDoneDispatcher.emit();
+}
+
+
+//------------------------------------------------------------------------------
+void Tree::onProgress() {
+	std::ostringstream text;
+	double fraction = 0.0;
+	{
+		std::lock_guard<std::mutex> guard( myLock );
+		text << "Generation " << myGeneration << " of " << myIterations
+			<< ": " << myModules << " modules";
+		if( myIterations > 0 ) {
+			fraction = double( myGeneration ) / myIterations;
+		}
 	}
+	myProgressBar.set_fraction( fraction );
+	myProgressBar.set_text( text.str() );
+}
+
 
+//------------------------------------------------------------------------------
+void Tree::onDerived() {
+	std::unique_ptr<LRenderer> renderer;
+	bool unchanged;
+	std::string error;
+	int leaves, branches;
+	{
+		std::lock_guard<std::mutex> guard( myLock );
+		if( myDoneJob != myJob ) {
+			// A job since replaced by a newer one.
+			return;
+		}
+		renderer = std::move( myResult );
+		unchanged = myUnchanged;
+		error = myError;
+		leaves = myLeafType;
+		branches = myBranchType;
+	}
+	if( !renderer && !unchanged ) {
+		myProgressBar.set_fraction( 0.0 );
+		myProgressBar.set_text( "" );
+		myStatusBar.push( "Error: " + error );
+		return;
+	}
+
+	myScene->setleavetype( leaves );
+	myScene->setbranchtype( branches );
+	if( renderer ) {
+		myScene->setgeometry( *renderer );
+	}
+	myShownJob = myJob;
+	myProgressBar.set_fraction( 1.0 );
+	myProgressBar.set_text( "Done" );
 
 	myScene->invalidate();
 }
@@ -26,6 +26,8 @@
 // Project includes.
 #include "treescene.h"
 #include "module.h"
+#include "renderer.h"
+#include "livesystem.h"
 
 
 //------------------------------------------------------------------------------
@@ -39,6 +41,17 @@
 #include <gtkmm/menu.h>
 #include <gtkmm/uimanager.h>
 #include <gtkmm/textview.h>
+#include <glibmm/dispatcher.h>
+
+
+//------------------------------------------------------------------------------
+// std c++ includes.
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 
 
 
@@ -151,10 +164,51 @@ protected:
 
 
 	///---------------------------------------------------------------------
-	/// @TODO: Document this.
+	/// Starts parsing, deriving and compiling the l-system in the editor
+	/// on the worker thread, cancelling the job already running if there
+	/// is one.  Never waits for the worker, so the window stays live
+	/// meanwhile, the progress bar follows the derivation, and the tree
+	/// is shown once it is done.
 	///---------------------------------------------------------------------
 	void renderSystem();
 
+
+	///---------------------------------------------------------------------
+	/// Cancels the running job, if any, and stops the worker thread,
+	/// waiting for it.  Only for when the window goes.
+	///---------------------------------------------------------------------
+	void stopDerivation();
+
+
+	///---------------------------------------------------------------------
+	/// The worker thread: runs the latest job handed to it, one at a time
+	/// as they share what the last one derived, until told to stop.
+	///---------------------------------------------------------------------
+	void work();
+
+
+	///---------------------------------------------------------------------
+	/// Job number job, on the worker thread: parses text, derives it and
+	/// compiles the result into a renderer of its own.  Only what the edits
+	/// since the last job changed is parsed and derived again, and if the
+	/// modules come out the same, and shown says the last job's geometry
+	/// is the one on screen, that geometry is kept.
+	///---------------------------------------------------------------------
+	void deriveSystem( std::string text, unsigned int job, bool shown );
+
+
+	///---------------------------------------------------------------------
+	/// Shows the worker's latest progress, on the GTK thread.
+	///---------------------------------------------------------------------
+	void onProgress();
+
+
+	///---------------------------------------------------------------------
+	/// Hands the worker's finished geometry to the scene, or reports its
+	/// error, on the GTK thread.
+	///---------------------------------------------------------------------
+	void onDerived();
+
 ///-----------------------------------------------------------------------------
 /// Protected member methods.
 ///-----------------------------------------------------------------------------
@@ -197,5 +251,59 @@ protected:
 	///---------------------------------------------------------------------
 	TreeScene *myScene;
 
+	///---------------------------------------------------------------------
+	/// The thread deriving, and the flag that cancels its job.
+	///---------------------------------------------------------------------
+	std::thread myWorker;
+	std::atomic<bool> myCancel;
+
+	///---------------------------------------------------------------------
+	/// The job waiting for the worker, guarded by myLock, which only the
+	/// latest one started does.  A job replaced before the worker gets
+	/// to it is never run.
+	///---------------------------------------------------------------------
+	std::condition_variable myWake;
+	bool myStopping;
+	bool myPending;
+	std::string myPendingText;
+	unsigned int myPendingJob;
+	bool myPendingShown;
+
+	///---------------------------------------------------------------------
+	/// What the last job parsed and derived, only touched by the worker.
+	///---------------------------------------------------------------------
+	LSystem::LiveSystem myLive;
+
+	///---------------------------------------------------------------------
+	/// Wake the GTK thread when the worker has progress or is done.
+	///---------------------------------------------------------------------
+	Glib::Dispatcher myProgressDispatcher;
+	Glib::Dispatcher myDoneDispatcher;
+
+	///---------------------------------------------------------------------
+	/// The number of the latest job started.
+	///---------------------------------------------------------------------
+	unsigned int myJob;
+
+	///---------------------------------------------------------------------
+	/// The number of the job whose tree is shown, 0 for none.
+	///---------------------------------------------------------------------
+	unsigned int myShownJob;
+
+	///---------------------------------------------------------------------
+	/// What the worker passes back, guarded by myLock: its progress,
+	/// then which job finished with what result or error.
+	///---------------------------------------------------------------------
+	std::mutex myLock;
+	int myGeneration;
+	int myIterations;
+	LSystem::ModuleString::size_type myModules;
+	unsigned int myDoneJob;
+	std::unique_ptr<LRenderer> myResult;
+	bool myUnchanged;
+	std::string myError;
+	int myLeafType;
+	int myBranchType;
+
 };
 #endif //TREE_H
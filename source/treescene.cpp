@@ -332,10 +332,16 @@ bool TreeScene::on_scroll_event( GdkEventScroll *event ) {
 }
 
 //Set's the modules to our list.
-void TreeScene::setmodules( std::vector<LSystem::Module> m )
+void TreeScene::setmodules( const LSystem::ModuleString &m )
 {
-	m_v.clear();
 	m_v = m;
 	m_renderer.reset();
-	m_renderer.setinput( &m_v );
+	m_renderer.setinput( m_v );
+}
+
+//Takes over geometry compiled elsewhere.
+void TreeScene::setgeometry( LRenderer &renderer )
+{
+	m_v.clear();
+	m_renderer.takegeometry( renderer );
 }
@@ -98,7 +98,15 @@ public:
 	///---------------------------------------------------------------------
 	/// @TODO: Document this.
 	///---------------------------------------------------------------------
-	void setmodules( std::vector<LSystem::Module> m );
+	void setmodules( const LSystem::ModuleString &m );
+
+
+	///---------------------------------------------------------------------
+	/// Shows the geometry renderer compiled, taking it rather than
+	/// copying, so it can be compiled on another thread and handed over
+	/// without holding up drawing.
+	///---------------------------------------------------------------------
+	void setgeometry( LRenderer &renderer );
 
 
 protected:
@@ -176,7 +184,7 @@ protected:
 	WindowInfo m_wininfo;
 
 	LRenderer m_renderer;
-	std::vector<LSystem::Module> m_v;
+	LSystem::ModuleString m_v;
 	
 ///-----------------------------------------------------------------------------
 /// Member constants.
@@ -0,0 +1,195 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#include "workpool.h"
+#include "error.h"
+
+namespace LSystem {
+
+//------------------------------------------------------------------------------
+// The pool the calling thread belongs to, and its queue in it.
+static thread_local const WorkPool *tlsPool = NULL;
+static thread_local unsigned int tlsQueue = 0;
+
+
+//------------------------------------------------------------------------------
+WorkPool::WorkPool( unsigned int threads )
+	:
+	myQueues(),
+	myThreads(),
+	myQueued( 0 ),
+	myLock(),
+	myWake(),
+	myStopping( false )
+{
+	if( threads == 0 ) {
+		threads = std::thread::hardware_concurrency();
+	}
+	if( threads == 0 ) {
+		threads = 1;
+	}
+	for( unsigned int q = 0; q < threads; ++q ) {
+		myQueues.push_back( new Queue );
+	}
+	// The thread waiting is the first, so only start the rest.
+	for( unsigned int t = 1; t < threads; ++t ) {
+		myThreads.push_back( std::thread( &WorkPool::work, this, t ) );
+	}
+}
+
+
+//------------------------------------------------------------------------------
+WorkPool::~WorkPool() {
+	{
+		std::lock_guard<std::mutex> guard( myLock );
+		myStopping = true;
+	}
+	myWake.notify_all();
+	for( std::vector<std::thread>::size_type t = 0; t < myThreads.size(); ++t ) {
+		myThreads[t].join();
+	}
+	for( std::vector<Queue *>::size_type q = 0; q < myQueues.size(); ++q ) {
+		delete myQueues[q];
+	}
+}
+
+
+//------------------------------------------------------------------------------
+void WorkPool::push( Group &group, Task task ) {
+	++group.myPending;
+	Queue &queue = *myQueues[ self() ];
+	{
+		std::lock_guard<std::mutex> guard( queue.lock );
+		Entry entry = { std::move( task ), &group };
+		queue.entries.push_back( std::move( entry ) );
+	}
+	{
+		// Under the lock so a thread going to sleep can't miss it.
+		std::lock_guard<std::mutex> guard( myLock );
+		++myQueued;
+	}
+	myWake.notify_one();
+}
+
+
+//------------------------------------------------------------------------------
+void WorkPool::wait( Group &group ) {
+	unsigned int me = self();
+	while( group.myPending > 0 ) {
+		if( !runOne( me ) ) {
+			// What is left is running on other threads, so sleep until
+			// it is done or there is another task to help with.
+			std::unique_lock<std::mutex> guard( myLock );
+			myWake.wait( guard, [this, &group]() {
+				return group.myPending == 0 || myQueued > 0;
+			} );
+		}
+	}
+	if( group.myFailed ) {
+		std::exception_ptr error;
+		{
+			std::lock_guard<std::mutex> guard( group.myErrorLock );
+			error.swap( group.myError );
+			group.myFailed = false;
+		}
+		std::rethrow_exception( error );
+	}
+}
+
+
+//------------------------------------------------------------------------------
+void WorkPool::work( unsigned int self ) {
+	tlsPool = this;
+	tlsQueue = self;
+	for( ;; ) {
+		if( runOne( self ) ) {
+			continue;
+		}
+		std::unique_lock<std::mutex> guard( myLock );
+		myWake.wait( guard, [this]() { return myStopping || myQueued > 0; } );
+		if( myStopping ) {
+			return;
+		}
+	}
+}
+
+
+//------------------------------------------------------------------------------
+bool WorkPool::runOne( unsigned int self ) {
+	Entry entry = { Task(), NULL };
+	bool found = false;
+
+	//----------------------------------------------------------------------
+	// Newest first from our own queue, then oldest first from the others.
+	{
+		Queue &own = *myQueues[ self ];
+		std::lock_guard<std::mutex> guard( own.lock );
+		if( !own.entries.empty() ) {
+			entry = std::move( own.entries.back() );
+			own.entries.pop_back();
+			found = true;
+		}
+	}
+	for( unsigned int n = 1; !found && n < myQueues.size(); ++n ) {
+		Queue &victim = *myQueues[ ( self + n ) % myQueues.size() ];
+		std::lock_guard<std::mutex> guard( victim.lock );
+		if( !victim.entries.empty() ) {
+			entry = std::move( victim.entries.front() );
+			victim.entries.pop_front();
+			found = true;
+		}
+	}
+	if( !found ) {
+		return false;
+	}
+
+	--myQueued;
+	Group &group = *entry.group;
+	if( !group.myFailed ) {
+		try {
+			entry.task();
+		} catch( ... ) {
+			std::exception_ptr error = std::current_exception();
+			{
+				std::lock_guard<std::mutex> guard( group.myErrorLock );
+				if( !group.myFailed ) {
+					error.swap( group.myError );
+					group.myFailed = true;
+				}
+			}
+			// Only the first is thrown by wait().
+			discardError( error );
+		}
+	}
+	// The waiting thread may let go of the group as soon as this is 0,
+	// so only the pool is touched after.  The lock is taken so a waiting
+	// thread about to sleep can't miss it.
+	if( --group.myPending == 0 ) {
+		std::lock_guard<std::mutex> guard( myLock );
+		myWake.notify_all();
+	}
+	return true;
+}
+
+
+//------------------------------------------------------------------------------
+unsigned int WorkPool::self() const {
+	return tlsPool == this ? tlsQueue : 0;
+}
+
+} // End of LSystem namespace
@@ -0,0 +1,204 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2004  Lakin Wecker
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//------------------------------------------------------------------------------
+
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace LSystem {
+
+///-----------------------------------------------------------------------------
+/// A pool of threads sharing out tasks by work stealing.
+///
+/// Every thread has its own queue.  A thread pushes the tasks it makes onto
+/// the back of its own queue and takes its next task from the back too, so
+/// it keeps working on what it just made while that is still in cache.  A
+/// thread whose queue is empty steals from the front of another's, which is
+/// where the oldest, and usually biggest, tasks are.
+///
+/// Tasks are pushed into a Group, and wait() on the group returns once all
+/// of its tasks are done.  The waiting thread runs tasks itself meanwhile,
+/// so tasks may push more tasks and wait on them, and sleeps once there
+/// is nothing left for it to run.
+///
+/// A task may throw.  The first exception thrown by a task of a group is
+/// kept, the group's tasks not yet started are dropped, and wait() throws
+/// it once the ones already running are done, on the thread waiting.
+///
+/// LSystem::WorkPool pool( 0 );
+/// LSystem::WorkPool::Group group;
+/// for( int i = 0; i < n; ++i ) {
+///     pool.push( group, [i]() { ... } );
+/// }
+/// pool.wait( group );
+///
+/// @author Lakin Wecker aka nikal@nucleus.com
+///-----------------------------------------------------------------------------
+class WorkPool {
+
+//==============================================================================
+// Typedefs
+//==============================================================================
+public:
+	typedef std::function<void()> Task;
+
+	///---------------------------------------------------------------------
+	/// A set of tasks to wait for.
+	///---------------------------------------------------------------------
+	class Group {
+		friend class WorkPool;
+		std::atomic<unsigned long> myPending;
+		// The first exception a task threw, and whether there is one.
+		std::atomic<bool> myFailed;
+		std::mutex myErrorLock;
+		std::exception_ptr myError;
+	public:
+		Group() : myPending( 0 ), myFailed( false ), myErrorLock(), myError() {}
+	};
+
+//==============================================================================
+// Private Variables
+//==============================================================================
+private:
+
+	struct Entry {
+		Task task;
+		Group *group;
+	};
+
+	struct Queue {
+		std::mutex lock;
+		std::deque<Entry> entries;
+	};
+
+	// Queue 0 belongs to the threads outside the pool, the rest to the
+	// pool's own threads.
+	std::vector<Queue *> myQueues;
+	std::vector<std::thread> myThreads;
+	std::atomic<unsigned long> myQueued;
+	std::mutex myLock;
+	std::condition_variable myWake;
+	bool myStopping;
+
+//==============================================================================
+// Public Methods
+//==============================================================================
+public:
+
+	//----------------------------------------------------------------------
+	// Constructors
+
+	///---------------------------------------------------------------------
+	/// Creates a pool in which threads threads, counting the one waiting,
+	/// run tasks.  0 means one per hardware core.
+	///---------------------------------------------------------------------
+	WorkPool( unsigned int threads );
+
+
+	//----------------------------------------------------------------------
+	// Destructor
+
+	///---------------------------------------------------------------------
+	/// Stops the threads.  Any tasks not yet run are dropped, so wait()
+	/// for them first.
+	///---------------------------------------------------------------------
+	virtual ~WorkPool();
+
+
+	//----------------------------------------------------------------------
+	// Getters
+
+	///---------------------------------------------------------------------
+	/// The number of threads that run tasks, counting the one waiting.
+	///---------------------------------------------------------------------
+	unsigned int threadCount() const {
+		return myQueues.size();
+	}
+
+
+	///---------------------------------------------------------------------
+	/// The queue of the calling thread, from 0 up to threadCount() - 1.
+	/// Every thread outside the pool shares queue 0, so a task can keep
+	/// per thread state in a slot per queue as long as only one thread
+	/// outside the pool waits at a time.
+	///---------------------------------------------------------------------
+	unsigned int currentQueue() const {
+		return self();
+	}
+
+
+	//----------------------------------------------------------------------
+	// Public API
+
+	///---------------------------------------------------------------------
+	/// Adds task to group and queues it to run.
+	///---------------------------------------------------------------------
+	void push( Group &group, Task task );
+
+
+	///---------------------------------------------------------------------
+	/// Runs tasks until every task of group is done.  Throws the first
+	/// exception one of them threw, if any did, leaving group empty and
+	/// ready to use again.
+	///---------------------------------------------------------------------
+	void wait( Group &group );
+
+//==============================================================================
+// Private Methods
+//==============================================================================
+private:
+
+	///---------------------------------------------------------------------
+	/// The loop run by pool thread self.
+	///---------------------------------------------------------------------
+	void work( unsigned int self );
+
+
+	///---------------------------------------------------------------------
+	/// Runs one task, from the back of queue self if there is one there
+	/// and otherwise stolen from the front of another queue.  A task whose
+	/// group has failed is dropped rather than run, and what a task throws
+	/// is kept in its group.
+	///
+	/// @return false if there was no task to run.
+	///---------------------------------------------------------------------
+	bool runOne( unsigned int self );
+
+
+	///---------------------------------------------------------------------
+	/// The queue of the calling thread.
+	///---------------------------------------------------------------------
+	unsigned int self() const;
+
+	// Not copyable, the threads belong to one pool.
+	WorkPool( const WorkPool & );
+	WorkPool &operator=( const WorkPool & );
+
+}; // End of WorkPool
+
+} // End of LSystem namespace
+
+#endif